@@ -0,0 +1,211 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+
+namespace kiloader {
+namespace a64 {
+
+// Instruction classes the analysis passes care about
+enum class Op : uint8_t {
+    Unknown,
+    B,          // B label
+    Bl,         // BL label
+    BCond,      // B.cond label
+    Cbz,        // CBZ Rt, label
+    Cbnz,       // CBNZ Rt, label
+    Tbz,        // TBZ Rt, #bit, label
+    Tbnz,       // TBNZ Rt, #bit, label
+    Br,         // BR / BRAA / BRAAZ ...
+    Blr,        // BLR / BLRAA / BLRAAZ ...
+    Ret,        // RET / RETAA / RETAB
+    Adr,        // ADR Rd, label
+    Adrp,       // ADRP Rd, page
+    AddImm,     // ADD Rd, Rn, #imm{, lsl #12} (32/64-bit, incl. MOV to/from SP)
+    LdrImm,     // LDR/LDRB/LDRH Rt, [Rn, #uimm] (integer, unsigned offset)
+    StrImm,     // STR/STRB/STRH Rt, [Rn, #uimm]
+    Count
+};
+
+// One decoded word. Fields that don't apply to the class are 0.
+struct Decoded {
+    Op op = Op::Unknown;
+    uint8_t rd = 0;         // Rd / Rt (transfer or tested register)
+    uint8_t rn = 0;         // Rn (base or source register; branch register for BR/BLR/RET)
+    uint8_t size = 0;       // log2 of the access size for LDR/STR
+    uint8_t cond = 0;       // Condition for B.cond, bit number for TBZ/TBNZ
+    bool is64 = false;      // 64-bit register form
+    int64_t imm = 0;        // ADD immediate or LDR/STR byte offset
+    uint64_t target = 0;    // Branch target, or the ADR/ADRP result (any value, 0 included)
+    
+    bool isBranch() const {
+        return op == Op::B || op == Op::BCond || op == Op::Cbz || op == Op::Cbnz ||
+               op == Op::Tbz || op == Op::Tbnz || op == Op::Br;
+    }
+    bool isCall() const { return op == Op::Bl || op == Op::Blr; }
+    bool isReturn() const { return op == Op::Ret; }
+    // Direct branch: target is where it goes
+    bool hasTarget() const {
+        return op == Op::B || op == Op::Bl || op == Op::BCond || op == Op::Cbz || op == Op::Cbnz ||
+               op == Op::Tbz || op == Op::Tbnz;
+    }
+    // ADR/ADRP: target is the address formed
+    bool hasAddress() const { return op == Op::Adr || op == Op::Adrp; }
+};
+
+// Encoding of a class: (word & mask) == value
+struct Pattern {
+    uint32_t mask;
+    uint32_t value;
+    Op op;
+};
+
+// More specific encodings first; the first match wins
+constexpr Pattern PATTERNS[] = {
+    {0xFC000000, 0x14000000, Op::B},
+    {0xFC000000, 0x94000000, Op::Bl},
+    {0xFF000010, 0x54000000, Op::BCond},
+    {0x7F000000, 0x34000000, Op::Cbz},
+    {0x7F000000, 0x35000000, Op::Cbnz},
+    {0x7F000000, 0x36000000, Op::Tbz},
+    {0x7F000000, 0x37000000, Op::Tbnz},
+    {0xFFFFFC1F, 0xD61F0000, Op::Br},
+    {0xFFFFF81F, 0xD61F081F, Op::Br},    // BRAAZ, BRABZ
+    {0xFFFFF800, 0xD71F0800, Op::Br},    // BRAA, BRAB
+    {0xFFFFFC1F, 0xD63F0000, Op::Blr},
+    {0xFFFFF81F, 0xD63F081F, Op::Blr},   // BLRAAZ, BLRABZ
+    {0xFFFFF800, 0xD73F0800, Op::Blr},   // BLRAA, BLRAB
+    {0xFFFFFC1F, 0xD65F0000, Op::Ret},
+    {0xFFFFFBFF, 0xD65F0BFF, Op::Ret},   // RETAA, RETAB
+    {0x9F000000, 0x10000000, Op::Adr},
+    {0x9F000000, 0x90000000, Op::Adrp},
+    {0x7F800000, 0x11000000, Op::AddImm},
+    {0x3FC00000, 0x39400000, Op::LdrImm},
+    {0x3FC00000, 0x39000000, Op::StrImm},
+};
+
+constexpr size_t PATTERN_COUNT = sizeof(PATTERNS) / sizeof(PATTERNS[0]);
+
+// Candidate patterns per top byte, built at compile time. A pattern is a
+// candidate for byte b when b agrees with it on the top byte of its mask.
+constexpr size_t MAX_CANDIDATES = 8;
+
+struct TopByteTable {
+    std::array<std::array<uint8_t, MAX_CANDIDATES>, 256> index{};
+    std::array<uint8_t, 256> count{};
+};
+
+constexpr TopByteTable buildTopByteTable() {
+    TopByteTable table{};
+    for (size_t b = 0; b < 256; b++) {
+        for (size_t p = 0; p < PATTERN_COUNT; p++) {
+            uint32_t top_mask = PATTERNS[p].mask >> 24;
+            uint32_t top_value = PATTERNS[p].value >> 24;
+            if ((b & top_mask) == top_value && table.count[b] < MAX_CANDIDATES) {
+                table.index[b][table.count[b]++] = static_cast<uint8_t>(p);
+            }
+        }
+    }
+    return table;
+}
+
+constexpr TopByteTable TOP_BYTE_TABLE = buildTopByteTable();
+
+// Class only (no field extraction)
+inline Op classify(uint32_t word) {
+    uint32_t top = word >> 24;
+    for (size_t i = 0; i < TOP_BYTE_TABLE.count[top]; i++) {
+        const Pattern& p = PATTERNS[TOP_BYTE_TABLE.index[top][i]];
+        if ((word & p.mask) == p.value) {
+            return p.op;
+        }
+    }
+    return Op::Unknown;
+}
+
+// Sign-extend the low bits of value
+inline int64_t signExtend(uint64_t value, unsigned bits) {
+    uint64_t sign = 1ULL << (bits - 1);
+    return static_cast<int64_t>((value ^ sign) - sign);
+}
+
+// Classify a word at address and extract its operands
+inline Decoded decode(uint32_t word, uint64_t address) {
+    Decoded d;
+    d.op = classify(word);
+    
+    switch (d.op) {
+        case Op::B:
+        case Op::Bl:
+            d.target = address + (signExtend(word & 0x03FFFFFF, 26) << 2);
+            break;
+        case Op::BCond:
+            d.cond = word & 0xF;
+            d.target = address + (signExtend((word >> 5) & 0x7FFFF, 19) << 2);
+            break;
+        case Op::Cbz:
+        case Op::Cbnz:
+            d.rd = word & 0x1F;
+            d.is64 = (word >> 31) != 0;
+            d.target = address + (signExtend((word >> 5) & 0x7FFFF, 19) << 2);
+            break;
+        case Op::Tbz:
+        case Op::Tbnz:
+            d.rd = word & 0x1F;
+            d.cond = static_cast<uint8_t>(((word >> 26) & 0x20) | ((word >> 19) & 0x1F));
+            d.is64 = (word >> 31) != 0;
+            d.target = address + (signExtend((word >> 5) & 0x3FFF, 14) << 2);
+            break;
+        case Op::Br:
+        case Op::Blr:
+        case Op::Ret:
+            d.rn = (word >> 5) & 0x1F;
+            d.is64 = true;
+            break;
+        case Op::Adr:
+        case Op::Adrp: {
+            d.rd = word & 0x1F;
+            d.is64 = true;
+            int64_t imm = signExtend((((word >> 5) & 0x7FFFF) << 2) | ((word >> 29) & 0x3), 21);
+            if (d.op == Op::Adrp) {
+                d.target = (address & ~0xFFFULL) + (static_cast<uint64_t>(imm) << 12);
+            } else {
+                d.target = address + imm;
+            }
+            d.imm = imm;
+            break;
+        }
+        case Op::AddImm:
+            d.rd = word & 0x1F;
+            d.rn = (word >> 5) & 0x1F;
+            d.is64 = (word >> 31) != 0;
+            d.imm = ((word >> 10) & 0xFFF) << (((word >> 22) & 1) ? 12 : 0);
+            break;
+        case Op::LdrImm:
+        case Op::StrImm:
+            d.rd = word & 0x1F;
+            d.rn = (word >> 5) & 0x1F;
+            d.size = static_cast<uint8_t>(word >> 30);
+            d.is64 = d.size == 3;
+            d.imm = static_cast<int64_t>((word >> 10) & 0xFFF) << d.size;
+            break;
+        default:
+            break;
+    }
+    
+    return d;
+}
+
+// Name of a class, for reports
+inline const char* opName(Op op) {
+    static const char* const names[] = {
+        "unknown", "b", "bl", "b.cond", "cbz", "cbnz", "tbz", "tbnz",
+        "br", "blr", "ret", "adr", "adrp", "add-imm", "ldr-imm", "str-imm"
+    };
+    static_assert(sizeof(names) / sizeof(names[0]) == static_cast<size_t>(Op::Count), "opName table out of date");
+    return names[static_cast<size_t>(op)];
+}
+
+} // namespace a64
+} // namespace kiloader
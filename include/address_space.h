@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include "nso_loader.h"
+#include "symbol_table.h"
+
+namespace kiloader {
+
+// A loaded module and where it sits in the address space
+struct Module {
+    std::string name;               // "rtld", "main", "subsdk0", "sdk", ...
+    std::unique_ptr<NsoFile> nso;
+    uint64_t base;                  // Load address
+    uint64_t end;                   // One past the page-aligned image (incl. bss)
+};
+
+// Process address space built from one or more NSO modules.
+// A single NSO sits at the default base; an ExeFS directory is laid out the
+// way the Horizon loader does it: rtld, main, subsdk0..9, sdk, each module
+// page-aligned and packed directly after the previous one.
+class AddressSpace {
+public:
+    AddressSpace() = default;
+    
+    // Modules hold resolvers pointing back here
+    AddressSpace(const AddressSpace&) = delete;
+    AddressSpace& operator=(const AddressSpace&) = delete;
+    
+    // Load a single NSO file
+    bool loadNso(const std::string& path, const NsoLoadOptions& options = {});
+    
+    // Load every known module from an ExeFS directory
+    bool loadExeFs(const std::string& dir, const NsoLoadOptions& options = {});
+    
+    // Check if loaded
+    bool isLoaded() const { return !modules_.empty(); }
+    
+    // Modules, sorted by base address
+    size_t getModuleCount() const { return modules_.size(); }
+    const Module& getModule(size_t index) const { return modules_[index]; }
+    
+    // Module whose image contains the address (nullptr if none)
+    const Module* getModuleAt(uint64_t vaddr) const;
+    
+    // Module by name (nullptr if not loaded)
+    const Module* findModule(const std::string& name) const;
+    
+    // Primary module: "main" when present, otherwise the first one.
+    // Returns an unloaded placeholder before anything is loaded.
+    NsoFile& getMainModule();
+    const NsoFile& getMainModule() const;
+    
+    // Memory access across all modules (see NsoFile for semantics)
+    bool readMemory(uint64_t vaddr, void* buf, size_t size) const;
+    MemoryView view(uint64_t vaddr, size_t size) const;
+    std::string_view cstringAt(uint64_t vaddr, size_t max_len = 256) const;
+    const Segment* getSegmentAt(uint64_t vaddr) const;
+    
+    template <typename T>
+    bool read(uint64_t vaddr, T& out) const {
+        const Module* mod = getModuleAt(vaddr);
+        return mod && mod->nso->read(vaddr, out);
+    }
+    
+    // Dynamic symbols of all modules (read on first use)
+    const SymbolTable& getSymbols() const;
+    
+    // Check if address is inside an executable segment
+    bool isCode(uint64_t vaddr) const;
+    
+    // Decompress and relocate all pending segments of all modules in parallel
+    bool decompressAll();
+    
+    // Patch overlay over all modules (see NsoFile::patch)
+    bool patch(uint64_t vaddr, const uint8_t* bytes, size_t size);
+    void clearPatches();
+    size_t getPatchedPageCount() const;
+    
+    // Apply an IPS/IPS32 file. It targets the module whose build ID starts
+    // with the file name (the usual "<build id>.ips" layout), else main.
+    bool applyPatchFile(const std::string& path);
+    
+    // Dirty page addresses of all modules since the last call, sorted
+    std::vector<uint64_t> takeDirtyPages();
+    
+    // Get error message
+    std::string getError() const { return error_; }
+    
+    // Default Switch base for the first module
+    static constexpr uint64_t DEFAULT_BASE = 0x7100000000;
+    
+private:
+    void layoutModules();
+    bool resolveImport(std::string_view name, uint64_t& address) const;
+    
+    std::vector<Module> modules_;
+    size_t main_index_ = 0;
+    std::string error_;
+    
+    mutable SymbolTable symbols_;
+    mutable std::mutex symbols_mutex_;
+    mutable std::atomic<bool> symbols_ready_{false};
+};
+
+} // namespace kiloader
@@ -5,8 +5,9 @@
 #include <vector>
 #include <memory>
 #include <functional>
-#include "nso_loader.h"
+#include "address_space.h"
 #include "disassembler.h"
+#include "decode_table.h"
 #include "function_finder.h"
 #include "xref_analyzer.h"
 #include "pseudocode.h"
@@ -20,15 +21,31 @@ public:
     Analyzer();
     ~Analyzer();
     
-    // Load NSO file
+    // Load NSO file (an ExeFS directory loads every module in it)
     bool loadNso(const std::string& path);
     
+    // Load all modules of an ExeFS directory into one address space
+    bool loadExeFs(const std::string& dir);
+    
+    // Options used by subsequent loads
+    void setLoadOptions(const NsoLoadOptions& options) { load_options_ = options; }
+    const NsoLoadOptions& getLoadOptions() const { return load_options_; }
+    
     // Run full analysis
     void analyze();
     
+    // Patch the loaded image (IPS/IPS32 file, or raw bytes at an address) or
+    // revert every patch. After analysis only the functions, xrefs and
+    // strings on the touched pages are recomputed.
+    bool applyPatchFile(const std::string& path);
+    bool patchBytes(uint64_t address, const std::vector<uint8_t>& bytes);
+    void clearPatches();
+    
     // Get components
-    NsoFile& getNso() { return *nso_; }
+    NsoFile& getNso() { return space_->getMainModule(); }
+    AddressSpace& getAddressSpace() { return *space_; }
     Disassembler& getDisassembler() { return *disasm_; }
+    DecodeTable& getDecodeTable() { return *decode_table_; }
     FunctionFinder& getFunctionFinder() { return *func_finder_; }
     XRefAnalyzer& getXRefAnalyzer() { return *xref_analyzer_; }
     StringTable& getStringTable() { return *string_table_; }
@@ -39,9 +56,23 @@ public:
     // Disassemble at address
     std::vector<Instruction> disassembleAt(uint64_t address, size_t count = 20);
     
+    // Called for each streamed instruction in order; return false to stop
+    using InstructionVisitor = std::function<bool(const Instruction&)>;
+    
+    // Stream the instructions in [start, end) without collecting them.
+    // Stops at the first undecodable word, at the end of the segment, or
+    // when fn returns false. Returns the number visited.
+    size_t disassembleRange(uint64_t start, uint64_t end, const InstructionVisitor& fn);
+    
+    // Same for up to count instructions from address
+    size_t disassembleCount(uint64_t address, size_t count, const InstructionVisitor& fn);
+    
     // Get function at address
     Function* getFunctionAt(uint64_t address);
     
+    // Resolve a function or symbol name to its address (0 if unknown)
+    uint64_t findFunctionByName(const std::string& name);
+    
     // Get pseudocode for function
     std::string getPseudocodeAt(uint64_t address);
     
@@ -73,13 +104,20 @@ public:
     void printStrings(const std::string& pattern);
     
 private:
-    std::unique_ptr<NsoFile> nso_;
+    bool initComponents();
+    void printLoadReport(const NsoFile& nso);
+    void reanalyzePatched();
+    size_t streamInstructions(uint64_t address, uint64_t end, size_t count, const InstructionVisitor& fn);
+    
+    std::unique_ptr<AddressSpace> space_;
     std::unique_ptr<Disassembler> disasm_;
+    std::unique_ptr<DecodeTable> decode_table_;
     std::unique_ptr<FunctionFinder> func_finder_;
     std::unique_ptr<XRefAnalyzer> xref_analyzer_;
     std::unique_ptr<StringTable> string_table_;
     std::unique_ptr<PseudocodeGenerator> pseudocode_;
     
+    NsoLoadOptions load_options_;
     bool loaded_ = false;
     bool analyzed_ = false;
 };
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace kiloader {
+
+// Hardware event counter for the calling thread (Linux perf_event_open).
+// Unavailable elsewhere or when perf is restricted; stop() then returns 0.
+class PerfCounter {
+public:
+    enum class Event {
+        DtlbMisses,     // dTLB read misses
+        Instructions,
+        CacheMisses     // Last-level cache misses
+    };
+    
+    explicit PerfCounter(Event event);
+    ~PerfCounter();
+    
+    PerfCounter(const PerfCounter&) = delete;
+    PerfCounter& operator=(const PerfCounter&) = delete;
+    
+    bool isAvailable() const { return fd_ >= 0; }
+    
+    void start();
+    uint64_t stop();
+    
+private:
+    int fd_ = -1;
+};
+
+// Benchmarks behind "kiloader bench <name> <file>".
+// Returns the process exit code.
+int runBench(const std::vector<std::string>& args);
+
+} // namespace kiloader
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace kiloader {
+
+// What a text word holds
+enum class WordKind : uint8_t {
+    Code,
+    Data,       // Literal pools, jump tables, ...
+    Padding     // Zero words, NOP runs after a terminator
+};
+
+// Code/data/padding map over the words of a text segment (bit i = word i).
+// Built in parallel from three signals:
+//  - direct branch targets, which are always code, followed to the next
+//    unconditional branch or return
+//  - the decode-validity bitmap: a word Capstone rejects is never code
+//  - instruction bigram statistics learned from the code reached that way
+//    (classes are the top byte of each word): the remaining words are data
+//    where they make a run of pairs improbable for code
+// Padding (zero words, unreached NOP runs after a terminator) is exact;
+// data is a statistical verdict, good for filtering candidates but not for
+// cutting function bodies.
+class CodeMap {
+public:
+    // Classify words of code at base; bit i of invalid is set when word i
+    // doesn't decode
+    void build(const uint8_t* code, size_t words, uint64_t base, const uint64_t* invalid);
+    
+    // Reclassify words [first, last) after their bytes changed (bit k of
+    // invalid is word first + k), keeping the bigram model and what the
+    // rest of the segment reaches
+    void update(const uint8_t* code, uint64_t base, size_t first, size_t last, const uint64_t* invalid);
+    
+    size_t getWordCount() const { return words_; }
+    
+    WordKind kindOf(size_t index) const {
+        if (index >= words_) {
+            return WordKind::Code;
+        }
+        if ((padding_[index / 64] >> (index % 64)) & 1) {
+            return WordKind::Padding;
+        }
+        return (data_[index / 64] >> (index % 64)) & 1 ? WordKind::Data : WordKind::Code;
+    }
+    
+    bool isPadding(size_t index) const {
+        return index < words_ && (padding_[index / 64] >> (index % 64)) & 1;
+    }
+    
+    bool isCode(size_t index) const {
+        return index >= words_ || ((data_[index / 64] | padding_[index / 64]) >> (index % 64) & 1) == 0;
+    }
+    
+    // Check whether a word is reached from a direct branch target
+    bool isReached(size_t index) const {
+        return index < words_ && (reached_[index / 64] >> (index % 64)) & 1;
+    }
+    
+    // Number of words of a kind
+    size_t count(WordKind kind) const;
+    
+private:
+    // Direct branch between text words, by word index; ordered by target
+    struct Seed {
+        uint32_t source;
+        uint32_t target;
+        
+        bool operator<(const Seed& other) const { return target < other.target; }
+    };
+    
+    // Mark words reached from the pending word indices: up to an
+    // unconditional branch, return, zero or undecodable word, following
+    // direct branches on the way
+    void flood(const uint8_t* code, uint64_t base, std::vector<size_t>& pending);
+    
+    // Clear the reach walked from the pending word indices, appending the
+    // cleared words; [first, last) is the changed range
+    void unflood(const uint8_t* code, uint64_t base, size_t first, size_t last,
+                 std::vector<size_t>& pending, std::vector<size_t>& cleared);
+    
+    // Decodable, non-zero word in a window improbable for code
+    bool isImprobable(const uint8_t* code, size_t index) const;
+    
+    // Mean bigram log-probability of the pairs around a word
+    double windowScore(const uint8_t* code, size_t index) const;
+    
+    // Redo the padding bits of [first, last), extended to whole NOP runs
+    void markPadding(const uint8_t* code, size_t first, size_t last);
+    
+    size_t words_ = 0;
+    std::vector<uint64_t> data_;
+    std::vector<uint64_t> padding_;
+    std::vector<uint64_t> reached_;     // Reached from a branch target
+    std::vector<uint64_t> invalid_;     // Undecodable
+    std::vector<Seed> seeds_;           // Live direct branches, by target
+    std::vector<float> log_prob_;       // Bigram model, CLASSES x CLASSES
+    double threshold_ = 0.0;            // Window score below which a word is improbable
+};
+
+} // namespace kiloader
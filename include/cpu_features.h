@@ -0,0 +1,35 @@
+#pragma once
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+
+namespace kiloader {
+
+// True when the CPU has AVX2 and the OS saves YMM state on context
+// switches. The CPUID feature bit alone isn't enough: with OSXSAVE off or
+// XCR0 not enabling SSE and AVX state (VMs, noxsave), AVX2 code raises
+// SIGILL.
+inline bool cpuHasUsableAvx2() {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+    bool osxsave = (ecx & (1u << 27)) != 0;
+    bool avx = (ecx & (1u << 28)) != 0;
+    if (!osxsave || !avx) {
+        return false;
+    }
+    
+    // XGETBV(0), as asm so no -mxsave is needed
+    unsigned int xcr0_lo, xcr0_hi;
+    __asm__ volatile("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+    if ((xcr0_lo & 6) != 6) {
+        return false;
+    }
+    
+    return __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & (1u << 5)) != 0;
+}
+
+} // namespace kiloader
+
+#endif
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include "address_space.h"
+#include "disassembler.h"
+#include "opcode_scan.h"
+#include "code_map.h"
+
+namespace kiloader {
+
+// Decode result of one text word: the Instruction flags and interned
+// mnemonic, or Invalid if Capstone rejects the word
+struct DecodeEntry {
+    enum : uint16_t {
+        Invalid = 1 << 15
+    };
+    
+    uint16_t flags;
+    uint16_t mnemonic_id;
+};
+
+static_assert(sizeof(DecodeEntry) == 4, "DecodeEntry should stay one word");
+
+// Decode table over the text segments of an address space, one entry per
+// 4-byte word at (address - text_base) / 4. Pages are decoded once, either
+// all together by decodeAll() or on first access, and every analysis pass
+// and view reads instructions from here instead of running Capstone again.
+// Lookups are thread-safe; invalidate() is not safe against concurrent
+// readers (like NsoFile::patch).
+class DecodeTable {
+public:
+    DecodeTable(AddressSpace& space, Disassembler& disasm);
+    
+    DecodeTable(const DecodeTable&) = delete;
+    DecodeTable& operator=(const DecodeTable&) = delete;
+    
+    // Decode every pending page of every module in parallel
+    void decodeAll();
+    
+    // Check if address is covered (inside some module's text)
+    bool contains(uint64_t address) const;
+    
+    // Instruction at address (false outside text or if undecodable)
+    bool get(uint64_t address, Instruction& out);
+    
+    // Call fn(insn) for each instruction in [address, end), in order,
+    // stopping after max_count, at the first undecodable word, at the end
+    // of text, or when fn returns false. Returns the number visited.
+    template <typename Fn>
+    size_t visit(uint64_t address, uint64_t end, size_t max_count, Fn&& fn) {
+        ModuleTable* mod = find(address);
+        if (!mod || (address & 3) != 0 || end <= address) {
+            return 0;
+        }
+        
+        size_t index = (address - mod->base) / 4;
+        size_t last = std::min<uint64_t>(mod->words, (end - mod->base + 3) / 4);
+        size_t visited = 0;
+        Instruction insn;
+        for (size_t i = index; i < last && visited < max_count; i++) {
+            const DecodeEntry& e = entry(*mod, i);
+            if (e.flags & DecodeEntry::Invalid) {
+                break;
+            }
+            makeInstruction(*mod, i, e, insn);
+            visited++;
+            if (!fn(insn)) {
+                break;
+            }
+        }
+        return visited;
+    }
+    
+    // Up to count instructions from address, stopping at the first
+    // undecodable word or the end of text. Appends to out and returns the
+    // number added.
+    size_t decode(uint64_t address, size_t count, std::vector<Instruction>& out);
+    
+    // Like decode, but also stops after the first return and before the
+    // first padding word
+    size_t decodeFunction(uint64_t address, size_t max_count, std::vector<Instruction>& out);
+    
+    // Forget the pages overlapping the given pages (page_size aligned) so
+    // they are decoded again from the current bytes. Once classified, their
+    // words are decoded and reclassified right away.
+    void invalidate(const std::vector<uint64_t>& pages, uint64_t page_size);
+    
+    // Build the opcode-class bitmaps (opcode_scan.h) of every module's text.
+    // The forEachClass calls do this on first use.
+    void scanClasses();
+    
+    // Call fn(address, word) for every text word in [start, end) that is in
+    // any class of class_mask, in increasing address order
+    template <typename Fn>
+    void forEachClass(uint32_t class_mask, uint64_t start, uint64_t end, Fn&& fn) {
+        scanClasses();
+        for (const auto& mod : modules_) {
+            uint64_t mod_end = mod.base + mod.words * 4;
+            if (end <= mod.base || start >= mod_end) {
+                continue;
+            }
+            const uint8_t* code = mod.nso->getTextSegment().data.data();
+            size_t first = start > mod.base ? (start - mod.base + 3) / 4 : 0;
+            size_t last = (std::min(end, mod_end) - mod.base + 3) / 4;
+            mod.scan.forEach(class_mask, first, last, [&](size_t index) {
+                uint32_t word;
+                std::memcpy(&word, code + index * 4, sizeof(word));
+                fn(mod.base + index * 4, word);
+            });
+        }
+    }
+    
+    // Same over all text
+    template <typename Fn>
+    void forEachClass(uint32_t class_mask, Fn&& fn) {
+        forEachClass(class_mask, 0, UINT64_MAX, std::forward<Fn>(fn));
+    }
+    
+    // Classify every module's text words as code, data or padding
+    // (code_map.h), decoding all pages first. isData and decodeFunction do
+    // this on first use.
+    void classifyWords();
+    
+    // Check whether address is a text word classified as data or padding
+    // (for filtering function candidates)
+    bool isData(uint64_t address);
+    
+    // Number of text words of a kind, over all modules
+    size_t countWords(WordKind kind);
+    
+    // Words per table page
+    static constexpr uint64_t PAGE_SIZE = NsoFile::PATCH_PAGE_SIZE;
+    static constexpr size_t PAGE_WORDS = PAGE_SIZE / 4;
+    
+private:
+    enum PageState : uint8_t {
+        Pending,
+        Filling,
+        Ready
+    };
+    
+    struct ModuleTable {
+        const NsoFile* nso;
+        uint64_t base;              // Text start address
+        size_t words;
+        std::unique_ptr<DecodeEntry[]> entries;
+        std::unique_ptr<std::atomic<uint8_t>[]> pages;
+        size_t page_count;
+        OpcodeScan scan;
+        CodeMap regions;
+    };
+    
+    const ModuleTable* find(uint64_t address) const;
+    ModuleTable* find(uint64_t address);
+    
+    // Entry for a word, decoding its page first if needed
+    const DecodeEntry& entry(ModuleTable& mod, size_t index);
+    void ensurePage(ModuleTable& mod, size_t page);
+    void fillPage(ModuleTable& mod, size_t page, DisasmWorker* worker);
+    
+    // Redo the classification of words [first, last) after a patch
+    void reclassify(ModuleTable& mod, size_t first, size_t last);
+    
+    // Build an Instruction from a ready entry
+    static void makeInstruction(const ModuleTable& mod, size_t index, const DecodeEntry& e, Instruction& out);
+    
+    AddressSpace& space_;
+    Disassembler& disasm_;
+    std::vector<ModuleTable> modules_;  // Sorted by base address
+    std::mutex scan_mutex_;
+    std::atomic<bool> scanned_{false};
+    std::mutex classify_mutex_;
+    std::atomic<bool> classified_{false};
+};
+
+} // namespace kiloader
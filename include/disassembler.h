@@ -4,37 +4,165 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <mutex>
+#include <type_traits>
 #include <capstone/capstone.h>
 
 namespace kiloader {
 
-// Disassembled instruction
+// Disassembled instruction: a 16-byte POD. Only the word and what the
+// analysis passes test per instruction are stored; the branch target is
+// decoded from the word, and text is rendered on demand.
 struct Instruction {
-    uint64_t address;
-    std::vector<uint8_t> bytes;
-    std::string mnemonic;
-    std::string operands;
-    
-    // Parsed operand info
-    bool is_branch;
-    bool is_call;
-    bool is_return;
-    bool is_load;
-    bool is_store;
-    uint64_t branch_target;
+    enum Flags : uint16_t {
+        Branch = 1 << 0,
+        Call   = 1 << 1,
+        Return = 1 << 2,
+        Load   = 1 << 3,
+        Store  = 1 << 4,
+    };
+    
+    uint64_t address = 0;
+    uint32_t word = 0;
+    uint16_t flags = 0;
+    uint16_t mnemonic_id = 0;   // Interned mnemonic (0: not interned)
+    
+    bool isBranch() const { return (flags & Branch) != 0; }
+    bool isCall() const { return (flags & Call) != 0; }
+    bool isReturn() const { return (flags & Return) != 0; }
+    bool isLoad() const { return (flags & Load) != 0; }
+    bool isStore() const { return (flags & Store) != 0; }
+    
+    // AArch64 instructions are always one word
+    static constexpr size_t size() { return 4; }
+    
+    // Instruction byte i (little endian)
+    uint8_t byte(size_t i) const { return static_cast<uint8_t>(word >> (i * 8)); }
+    
+    // Direct branch/call target; false for other instructions
+    bool branchTarget(uint64_t& target) const;
+    
+    // Mnemonic text (interned; never null)
+    const char* mnemonic() const;
+    
+    // Operand text (re-disassembled)
+    std::string operands() const;
     
     std::string toString() const;
 };
 
-// ARM64 Disassembler using Capstone
+static_assert(sizeof(Instruction) == 16, "Instruction should stay 16 bytes");
+static_assert(std::is_trivially_copyable<Instruction>::value, "Instruction should stay POD");
+
+// One Capstone handle and its error state. Capstone handles must not be
+// shared between threads, so every worker thread uses its own. Decoding
+// goes through cs_disasm_iter into one cs_insn owned by the worker, so no
+// call allocates beyond the output vector.
+class DisasmWorker {
+public:
+    DisasmWorker() = default;
+    ~DisasmWorker();
+    
+    DisasmWorker(const DisasmWorker&) = delete;
+    DisasmWorker& operator=(const DisasmWorker&) = delete;
+    
+    // Open the handle
+    bool initialize();
+    
+    // Capstone operand detail (CS_OPT_DETAIL). Off by default: control flow
+    // comes from the native decoder and text needs no detail.
+    bool setDetail(bool enabled);
+    bool getDetail() const { return detail_; }
+    
+    // Capstone's record of the last decoded instruction (null before the
+    // first decode; detail is only filled with setDetail(true))
+    const cs_insn* lastInsn() const { return insn_; }
+    
+    // Disassemble a single instruction
+    bool disassembleOne(const uint8_t* code, size_t size, uint64_t address, Instruction& out);
+    
+    // Decode the instruction at code and step code, size and address past
+    // it, for streaming over memory without a vector. False at the end or
+    // at an undecodable word.
+    bool decodeStep(const uint8_t*& code, size_t& size, uint64_t& address, Instruction& out);
+    
+    // Disassemble a block of code
+    std::vector<Instruction> disassemble(const uint8_t* code, size_t size, uint64_t address, size_t count = 0);
+    
+    // Same, appending to out. Returns the number of instructions added.
+    size_t disassemble(const uint8_t* code, size_t size, uint64_t address, size_t count,
+                       std::vector<Instruction>& out);
+    
+    // Disassemble until return or invalid
+    std::vector<Instruction> disassembleFunction(const uint8_t* code, size_t max_size, uint64_t address);
+    
+    // Same, appending to out. Returns the number of instructions added.
+    size_t disassembleFunction(const uint8_t* code, size_t max_size, uint64_t address,
+                               std::vector<Instruction>& out);
+    
+    // Check if instruction is valid
+    bool isValidInstruction(const uint8_t* code, size_t size, uint64_t address);
+    
+    // Render the text of one word (either output may be null)
+    bool renderText(uint32_t word, uint64_t address, std::string* mnemonic, std::string* operands);
+    
+    // Same without copying: both point into this worker's instruction
+    // record and stay valid until its next decode
+    bool textOf(uint32_t word, uint64_t address, const char*& mnemonic, const char*& operands);
+    
+    // Worker owned by the calling thread, for rendering text on demand
+    // (null if its handle could not be opened)
+    static DisasmWorker* forThread();
+    
+    // Get error message
+    std::string getError() const { return error_; }
+    
+private:
+    // Decode one instruction into insn_
+    bool decodeNext(const uint8_t*& code, size_t& size, uint64_t& address);
+    
+    csh handle_ = 0;
+    cs_insn* insn_ = nullptr;
+    bool initialized_ = false;
+    bool detail_ = false;
+    std::string error_;
+};
+
+// ARM64 Disassembler using Capstone.
+// The methods below use a single handle and are for one thread at a time.
+// Parallel passes take a worker each with acquire(); workers go back to a
+// pool when the lease ends, so handles are opened once per session.
 class Disassembler {
 public:
+    // Exclusive use of a pooled worker
+    class Lease {
+    public:
+        Lease(Disassembler& owner, std::unique_ptr<DisasmWorker> worker)
+            : owner_(&owner), worker_(std::move(worker)) {}
+        Lease(Lease&& other) noexcept = default;
+        Lease& operator=(Lease&& other) = delete;
+        ~Lease();
+        
+        // Null if the handle could not be opened
+        DisasmWorker* get() const { return worker_.get(); }
+        DisasmWorker* operator->() const { return worker_.get(); }
+        DisasmWorker& operator*() const { return *worker_; }
+        explicit operator bool() const { return worker_ != nullptr; }
+    
+    private:
+        Disassembler* owner_;
+        std::unique_ptr<DisasmWorker> worker_;
+    };
+    
     Disassembler();
     ~Disassembler();
     
     // Initialize (must call before use)
     bool initialize();
     
+    // Take a worker for the calling thread (thread-safe)
+    Lease acquire();
+    
     // Disassemble a single instruction
     bool disassembleOne(const uint8_t* code, size_t size, uint64_t address, Instruction& out);
     
@@ -47,14 +175,20 @@ public:
     // Check if instruction is valid
     bool isValidInstruction(const uint8_t* code, size_t size, uint64_t address);
     
+    // Capstone operand detail for the main handle and for workers handed
+    // out from now on (off by default)
+    bool setDetail(bool enabled);
+    
     // Get error message
-    std::string getError() const { return error_; }
+    std::string getError() const;
     
 private:
-    void parseInstruction(cs_insn* insn, Instruction& out);
+    void release(std::unique_ptr<DisasmWorker> worker);
     
-    csh handle_ = 0;
-    bool initialized_ = false;
+    DisasmWorker main_;
+    mutable std::mutex pool_mutex_;
+    std::vector<std::unique_ptr<DisasmWorker>> idle_;
+    bool detail_ = false;
     std::string error_;
 };
 
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+
+namespace kiloader {
+
+// MOD0 header. Located through the u32 at text+4; every offset in it is
+// relative to the MOD0 header itself.
+struct Mod0Header {
+    uint32_t magic;                 // "MOD0" = 0x30444F4D
+    int32_t dynamic_offset;
+    int32_t bss_start_offset;
+    int32_t bss_end_offset;
+    int32_t eh_frame_hdr_start_offset;
+    int32_t eh_frame_hdr_end_offset;
+    int32_t module_object_offset;
+};
+
+// ELF64 dynamic section entry
+struct Elf64Dyn {
+    int64_t tag;
+    uint64_t val;
+};
+
+// ELF64 relocation with addend
+struct Elf64Rela {
+    uint64_t offset;
+    uint64_t info;                  // symbol index << 32 | type
+    int64_t addend;
+};
+
+// ELF64 symbol
+struct Elf64Sym {
+    uint32_t name;                  // Offset into dynstr
+    uint8_t info;                   // binding << 4 | type
+    uint8_t other;
+    uint16_t shndx;                 // 0 = undefined (imported)
+    uint64_t value;
+    uint64_t size;
+};
+
+// Dynamic tags
+constexpr int64_t DT_NULL = 0;
+constexpr int64_t DT_PLTRELSZ = 2;
+constexpr int64_t DT_STRTAB = 5;
+constexpr int64_t DT_SYMTAB = 6;
+constexpr int64_t DT_RELA = 7;
+constexpr int64_t DT_RELASZ = 8;
+constexpr int64_t DT_STRSZ = 10;
+constexpr int64_t DT_JMPREL = 23;
+constexpr int64_t DT_RELACOUNT = 0x6FFFFFF9;
+
+// Symbol types and bindings
+constexpr uint8_t STT_OBJECT = 1;
+constexpr uint8_t STT_FUNC = 2;
+constexpr uint8_t STB_LOCAL = 0;
+constexpr uint8_t STB_GLOBAL = 1;
+constexpr uint8_t STB_WEAK = 2;
+
+// AArch64 relocation types
+constexpr uint32_t R_AARCH64_ABS64 = 257;
+constexpr uint32_t R_AARCH64_GLOB_DAT = 1025;
+constexpr uint32_t R_AARCH64_JUMP_SLOT = 1026;
+constexpr uint32_t R_AARCH64_RELATIVE = 1027;
+
+} // namespace kiloader
@@ -1,12 +1,17 @@
 #pragma once
 
 #include <cstdint>
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <map>
 #include <set>
-#include "nso_loader.h"
+#include <unordered_map>
+#include <memory>
+#include <atomic>
+#include "address_space.h"
 #include "disassembler.h"
+#include "decode_table.h"
 
 namespace kiloader {
 
@@ -16,7 +21,7 @@ struct Function {
     uint64_t end_address;
     size_t size;
     std::string name;
-    std::vector<Instruction> instructions;
+    std::vector<Instruction> instructions;  // Lifted on demand (ir::liftInstructions)
     
     // Callees and callers
     std::set<uint64_t> calls_to;      // Functions this function calls
@@ -33,11 +38,14 @@ struct Function {
 // Function finder - detects functions in binary
 class FunctionFinder {
 public:
-    FunctionFinder(NsoFile& nso, Disassembler& disasm);
+    FunctionFinder(AddressSpace& space, DecodeTable& table);
     
     // Find all functions
     void findFunctions();
     
+    // Seed functions from exported dynamic symbols
+    void findFunctionsBySymbols();
+    
     // Find functions by pattern
     void findFunctionsByPrologue();
     
@@ -47,15 +55,33 @@ public:
     // Analyze a specific function
     Function* analyzeFunction(uint64_t address);
     
+    // Analyze many candidates on all cores with work stealing, reading
+    // instructions from the decode table. Each candidate lands in its own
+    // slot and slots are inserted in input order, so the outcome doesn't
+    // depend on the thread count or the schedule.
+    void analyzeFunctions(const std::vector<uint64_t>& addresses);
+    
+    // Redo functions overlapping the given pages (page_size aligned) after
+    // their bytes changed, keeping assigned names, and pick up new entry
+    // points (prologues, BL targets) in those pages. Returns the addresses of
+    // every function that was redone, added or dropped.
+    std::vector<uint64_t> reanalyzePages(const std::vector<uint64_t>& pages, uint64_t page_size);
+    
     // Get all functions
     const std::map<uint64_t, Function>& getFunctions() const { return functions_; }
     
     // Get function at address
     Function* getFunction(uint64_t address);
     
-    // Get function containing address
+    // Get function containing address (the lowest-addressed one where
+    // functions overlap). O(log n) through the containing index, which the
+    // analyze/reanalyze calls keep up to date, so this only reads and may
+    // run on several threads while no functions are added or removed.
     Function* getFunctionContaining(uint64_t address);
     
+    // Get function by name (symbol or user-assigned)
+    Function* findFunctionByName(const std::string& name);
+    
     // Name a function
     void nameFunction(uint64_t address, const std::string& name);
     
@@ -65,12 +91,44 @@ public:
 private:
     bool isPrologue(const uint8_t* code, size_t size);
     bool isEpilogue(const Instruction& insn);
+    bool decodeFunction(uint64_t address, Function& func) const;
+    
+    // analyzeFunction without the index update, for batches
+    Function* addFunction(uint64_t address);
     void analyzeBasicBlocks(Function& func);
     
-    NsoFile& nso_;
-    Disassembler& disasm_;
+    // Visited set: claim an address for analysis (true only for the first
+    // caller, from any thread), or release it to be analyzed again.
+    // Addresses outside text or not word-aligned can't be claimed.
+    bool claim(uint64_t address);
+    void unclaim(uint64_t address);
+    
+    // Note a function added or removed at address; updateIndex() redoes the
+    // containing index from the lowest such address on. Every public call
+    // that adds or removes functions ends with it.
+    void markIndexDirty(uint64_t address) { index_dirty_from_ = std::min(index_dirty_from_, address); }
+    void updateIndex();
+    
+    AddressSpace& space_;
+    DecodeTable& table_;
     std::map<uint64_t, Function> functions_;
-    std::set<uint64_t> analyzed_addresses_;
+    std::unordered_map<std::string, uint64_t> name_index_;  // name -> address (non-default names)
+    
+    // One visited bit per text word, per module (sorted by base)
+    struct VisitedBits {
+        uint64_t base;
+        size_t words;
+        std::unique_ptr<std::atomic<uint64_t>[]> bits;
+    };
+    std::vector<VisitedBits> visited_;
+    
+    // Containing index: functions in address order with the running
+    // maximum of their end addresses. The first entry whose running maximum
+    // passes an address is the lowest function that can contain it.
+    std::vector<uint64_t> index_starts_;
+    std::vector<uint64_t> index_max_ends_;
+    std::vector<Function*> index_funcs_;
+    uint64_t index_dirty_from_ = 0;     // UINT64_MAX: up to date
 };
 
 } // namespace kiloader
@@ -4,19 +4,13 @@
 #include <string>
 #include <vector>
 #include <cstdint>
+#include "insn_formatter.h"
 
 namespace kiloader {
 namespace gui {
 
 class App;
 
-struct DisasmLine {
-    uint64_t address;
-    std::string bytes;
-    std::string mnemonic;
-    std::string operands;
-};
-
 class DisasmView {
 public:
     DisasmView(App& app);
@@ -29,10 +23,15 @@ public:
 private:
     void disassemble();
     
+    // Address of a line (instructions are 4 bytes, with no gaps)
+    uint64_t lineAddress(int idx) const { return current_addr_ + static_cast<uint64_t>(idx) * 4; }
+    
     App& app_;
     
     uint64_t current_addr_ = 0;
-    std::vector<DisasmLine> lines_;
+    int line_count_ = 0;
+    std::vector<Instruction> visible_;  // Lines on screen, decoded when drawn
+    InsnFormatter formatter_;
     int scroll_offset_ = 0;
     int selected_ = 0;
 };
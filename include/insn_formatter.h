@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include "disassembler.h"
+
+namespace kiloader {
+
+// Instruction text written into caller buffers with no heap traffic.
+// Mnemonics come from the intern table; operand text is rendered by a
+// Capstone worker straight into its reused instruction record. A formatter
+// is for one thread at a time.
+//
+// Every function writes at most size bytes including the terminating NUL
+// (size > 0), truncating to fit, and returns the length written.
+class InsnFormatter {
+public:
+    // Render operands with the calling thread's own worker
+    InsnFormatter();
+    
+    // Render operands with the given worker
+    explicit InsnFormatter(DisasmWorker& worker);
+    
+    // Room for any line formatLine writes
+    static constexpr size_t LINE_SIZE = 256;
+    
+    // "0x<address>: B0 B1 B2 B3 <mnemonic> <operands>"
+    size_t formatLine(const Instruction& insn, char* buf, size_t size);
+    
+    // Operand text (empty if the word doesn't decode)
+    size_t formatOperands(const Instruction& insn, char* buf, size_t size);
+    
+    // Lowercase hex, zero-padded to min_digits, without a prefix
+    static size_t formatHex(uint64_t value, char* buf, size_t size, int min_digits = 1);
+    
+    // Instruction bytes in memory order as uppercase hex pairs, each
+    // followed by sep unless sep is '\0'
+    static size_t formatBytes(const Instruction& insn, char* buf, size_t size, char sep = ' ');
+    
+private:
+    DisasmWorker* worker_;
+};
+
+} // namespace kiloader
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <iosfwd>
+#include "nso_loader.h"
+
+namespace kiloader {
+
+// What the header says about one NSO on disk
+struct InventoryEntry {
+    std::string path;
+    std::string build_id;           // Hex, as NsoFile::getBuildId()
+    std::string module_name;
+    uint32_t flags = 0;             // Compression (bits 0-2) and hash check (bits 3-5) flags
+    uint32_t sizes[3] = {};         // Decompressed text/rodata/data
+    uint32_t stored_sizes[3] = {};  // Bytes in the file
+    uint32_t bss_size = 0;
+    uint64_t file_size = 0;
+};
+
+// Header-only index of a directory tree of NSO files.
+// Each file costs two positioned reads (the 0x100-byte header and the module
+// name); nothing is mapped or decompressed. Files are read in parallel.
+class Inventory {
+public:
+    // Index every NSO below dir (other files are skipped)
+    bool scan(const std::string& dir);
+    
+    // Read one file's header (false if it isn't an NSO)
+    static bool readEntry(const std::string& path, InventoryEntry& entry);
+    
+    // Entries sorted by build ID, then path
+    const std::vector<InventoryEntry>& getEntries() const { return entries_; }
+    
+    // Entries whose build ID starts with prefix (case-insensitive)
+    std::vector<const InventoryEntry*> findByBuildId(const std::string& prefix) const;
+    
+    // Write the index as tab-separated text with a header row
+    bool writeIndex(std::ostream& out) const;
+    
+    // Scan counters
+    size_t getFileCount() const { return file_count_; }
+    double getScanMs() const { return scan_ms_; }
+    
+    // Get error message
+    std::string getError() const { return error_; }
+    
+private:
+    std::vector<InventoryEntry> entries_;
+    size_t file_count_ = 0;
+    double scan_ms_ = 0;
+    std::string error_;
+};
+
+} // namespace kiloader
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace kiloader {
+
+// One contiguous write from a patch file
+struct PatchRecord {
+    uint64_t offset;                // Offset in the module image
+    std::vector<uint8_t> bytes;
+};
+
+// IPS / IPS32 patch, as used for ExeFS patches.
+// Offsets in the file count the 0x100-byte NSO header; records are stored
+// relative to the module image instead.
+class IpsPatch {
+public:
+    // Parse a patch file
+    bool load(const std::string& path);
+    
+    const std::vector<PatchRecord>& getRecords() const { return records_; }
+    
+    // Get error message
+    std::string getError() const { return error_; }
+    
+    static constexpr uint64_t NSO_HEADER_SIZE = 0x100;
+    
+private:
+    std::vector<PatchRecord> records_;
+    std::string error_;
+};
+
+} // namespace kiloader
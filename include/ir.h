@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace kiloader {
+
+struct Instruction;
+
+namespace ir {
+
+// Register numbers. General registers keep their encoding numbers; 31 is
+// always SP, the zero register has its own number.
+enum Reg : uint8_t {
+    FP = 29,
+    LR = 30,
+    SP = 31,
+    ZR = 32,        // Reads as 0, writes are discarded
+    FLAGS = 33,     // NZCV
+    T0 = 34,        // Temporary, only live within one instruction's statements
+    V0 = 64,        // V0..V31 (FP/SIMD)
+    IMM = 0xFE,     // Operand b: the value is Stmt::imm
+    NONE = 0xFF
+};
+
+// Three-address operations. Below, b stands for register b shifted left by
+// Stmt::shift (after the Extend* attribute, if any), or imm when b is IMM.
+enum class Op : uint8_t {
+    Nop,            // No modelled effect (hints, barriers, prefetches)
+    Unknown,        // Not lifted: may read or write anything
+    Clobber,        // d = unknown value
+    Mov,            // d = b
+    Add,            // d = a + b
+    Sub,            // d = a - b
+    Mul,            // d = a * b
+    UDiv,           // d = a / b, unsigned
+    SDiv,           // d = a / b, signed
+    And,            // d = a & b
+    Or,             // d = a | b
+    Xor,            // d = a ^ b
+    Not,            // d = ~b
+    Shl,            // d = a << b
+    Lsr,            // d = a >> b, logical
+    Asr,            // d = a >> b, arithmetic
+    Ror,            // d = a rotated right by b
+    Sext,           // d = the low imm bits of a, sign-extended
+    Select,         // d = cond ? a : b
+    Load,           // d = [a + b] (a NONE: [b])
+    Store,          // [a + b] = d (d NONE: a value not modelled, e.g. LDADD)
+    ReadSys,        // d = system register imm (MRS)
+    WriteSys,       // system register imm = a (MSR)
+    Jump,           // goto imm
+    JumpCond,       // if cond goto imm
+    JumpZero,       // if a == 0 goto imm
+    JumpNonZero,    // if a != 0 goto imm
+    JumpBitClear,   // if bit cond of a is 0 goto imm
+    JumpBitSet,     // if bit cond of a is 1 goto imm
+    JumpReg,        // goto a
+    Call,           // call imm
+    CallReg,        // call a
+    Ret,            // return to a
+    Syscall,        // SVC #imm
+    Trap,           // BRK, UDF
+    Count
+};
+
+enum Attr : uint8_t {
+    SetsFlags  = 1 << 0,    // Also writes FLAGS (ADDS, SUBS, ANDS)
+    Signed     = 1 << 1,    // Load: sign-extend the value
+    Dest32     = 1 << 2,    // Signed load: into a W register
+    IsAddress  = 1 << 3,    // Mov: imm is an address (ADR, ADRP)
+    ExtendUxtw = 1 << 4,    // Register b is a W register, zero-extended
+    ExtendSxtw = 1 << 5,    // Register b is a W register, sign-extended
+};
+
+// One statement. An instruction lifts to 1..MAX_STMTS statements, which
+// share its offset.
+struct Stmt {
+    Op op = Op::Nop;
+    uint8_t d = NONE;
+    uint8_t a = NONE;
+    uint8_t b = NONE;
+    uint8_t width = 3;      // log2 bytes: operation width, or Load/Store access size
+    uint8_t cond = 0;       // Condition code (JumpCond, Select) or bit number (JumpBit*)
+    uint8_t shift = 0;      // Left shift of register b
+    uint8_t attrs = 0;
+    uint32_t offset = 0;    // Byte offset of the instruction in its function
+    int64_t imm = 0;
+    
+    bool writesDest() const {
+        return (op >= Op::Clobber && op <= Op::Load) || op == Op::ReadSys;
+    }
+    bool isControl() const { return op >= Op::Jump && op <= Op::Trap; }
+    bool hasTarget() const { return (op >= Op::Jump && op <= Op::JumpBitSet) || op == Op::Call; }
+};
+
+static_assert(sizeof(Stmt) == 24, "Stmt should stay 24 bytes");
+
+// Most statements one instruction lifts to
+constexpr size_t MAX_STMTS = 4;
+
+// Lift the word at address into out (MAX_STMTS slots). Covers integer data
+// processing, loads and stores, branches and the common system
+// instructions; FP/SIMD data processing only as a Clobber of its
+// destination. Returns the number of statements written (at least 1), with
+// offset 0.
+size_t lift(uint32_t word, uint64_t address, Stmt* out);
+
+// Lift a run of instructions into one contiguous block, appending to out.
+// Offsets are relative to base.
+void liftInstructions(const std::vector<Instruction>& insns, uint64_t base, std::vector<Stmt>& out);
+
+// Names for reports and pseudocode
+const char* opName(Op op);
+const char* condName(uint8_t cond);
+
+// Register name at a width: x0/w0, sp/wsp, xzr/wzr, q0/d0/s0/h0/b0, ...
+const char* regName(uint8_t reg, uint8_t width);
+
+} // namespace ir
+} // namespace kiloader
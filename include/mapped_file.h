@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+namespace kiloader {
+
+// Memory-mapped view of a file on disk.
+// Pages are mapped private (copy-on-write), so in-memory edits such as
+// relocations or patches never reach the file itself.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    
+    // Map the whole file
+    bool open(const std::string& path);
+    
+    // Unmap (safe to call when not open)
+    void close();
+    
+    bool isOpen() const { return data_ != nullptr; }
+    uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+    
+    // Get error message
+    std::string getError() const { return error_; }
+    
+private:
+    uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+    std::string error_;
+#ifdef _WIN32
+    void* mapping_ = nullptr;
+#endif
+};
+
+} // namespace kiloader
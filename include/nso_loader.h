@@ -2,8 +2,18 @@
 
 #include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <memory>
+#include <cstring>
+#include <type_traits>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <future>
+#include "mapped_file.h"
+#include "segment_buffer.h"
+#include "elf_types.h"
 
 namespace kiloader {
 
@@ -61,16 +71,140 @@ enum class SegmentType {
     Data
 };
 
+// Segment bytes. Either owns a buffer (decompressed segments) or views
+// memory owned by the NsoFile (uncompressed segments inside the file mapping).
+// Owned buffers carry SegmentBuffer::PADDING readable bytes past the end;
+// views do not.
+class SegmentData {
+public:
+    SegmentData() = default;
+    SegmentData(const SegmentData& other);
+    SegmentData& operator=(const SegmentData& other);
+    SegmentData(SegmentData&& other) noexcept;
+    SegmentData& operator=(SegmentData&& other) noexcept;
+    
+    // Allocate an owned buffer (contents undefined) and return it for filling
+    uint8_t* allocate(size_t size);
+    
+    // Point at memory owned by someone else
+    void view(uint8_t* ptr, size_t size);
+    
+    void clear();
+    
+    uint8_t* data() { return ptr_; }
+    const uint8_t* data() const { return ptr_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    bool isView() const { return ptr_ != nullptr && owned_.empty(); }
+    bool hasPadding() const { return !owned_.empty(); }
+    
+    const uint8_t& operator[](size_t i) const { return ptr_[i]; }
+    const uint8_t* begin() const { return ptr_; }
+    const uint8_t* end() const { return ptr_ + size_; }
+    
+private:
+    SegmentBuffer owned_;
+    uint8_t* ptr_ = nullptr;
+    size_t size_ = 0;
+};
+
 // Segment info
 struct Segment {
     SegmentType type;
     uint64_t mem_offset;
     uint64_t size;
-    std::vector<uint8_t> data;
+    SegmentData data;
     bool is_executable;
     bool is_writable;
 };
 
+// Read-only span of loaded memory. Empty (false) when the requested range
+// is not fully inside one segment.
+struct MemoryView {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    
+    explicit operator bool() const { return data != nullptr; }
+    const uint8_t* begin() const { return data; }
+    const uint8_t* end() const { return data + size; }
+};
+
+// Load options
+struct NsoLoadOptions {
+    bool use_mmap = true;       // Map the file instead of reading it into memory
+    bool verify_hashes = false; // Check each segment against its header SHA-256
+    bool lazy = true;           // Decompress segments on first access (ignored with verify_hashes)
+    
+    // Directory for the decompressed-segment cache of a build ID (empty
+    // function = no cache, the default). Hits are checked against the
+    // segment hash and mapped instead of decompressed.
+    std::function<std::string(const std::string& build_id)> cache_dir;
+};
+
+// Per-segment part of the load report
+struct NsoSegmentStats {
+    size_t size = 0;
+    bool compressed = false;
+    bool decoded = false;   // False while a lazy segment is still compressed
+    bool mapped = false;    // Served straight from the file mapping
+    bool cache_hit = false; // Mapped from the segment cache
+    bool cache_stored = false; // Written to the segment cache in the background
+    double decompress_ms = 0;
+    bool hash_checked = false;
+    bool hash_ok = false;
+    double hash_ms = 0;
+};
+
+// Relocation part of the load report
+struct NsoRelocStats {
+    bool applied = false;   // False until rodata/data are first touched
+    bool has_mod0 = false;
+    size_t relative = 0;    // R_AARCH64_RELATIVE
+    size_t symbolic = 0;    // GLOB_DAT / JUMP_SLOT / ABS64 with a resolved symbol
+    size_t unresolved = 0;  // Imports nobody could resolve (left untouched)
+    size_t skipped = 0;     // Unsupported type or target outside data/rodata
+    double ms = 0;
+};
+
+// Load report
+struct NsoLoadStats {
+    bool used_mmap = false;
+    double load_ms = 0;     // Total time spent in load()
+    double decode_ms = 0;   // Wall time of the parallel decode/verify stage
+    NsoSegmentStats segments[3];  // Indexed by SegmentType
+    NsoRelocStats relocs;
+    size_t file_size = 0;
+};
+
+// What MOD0 and .dynamic describe. Offsets are relative to the module base.
+struct NsoDynamicInfo {
+    bool has_mod0 = false;
+    uint64_t mod0_offset = 0;
+    uint64_t dynamic_offset = 0;
+    uint64_t rela_offset = 0;
+    uint64_t rela_size = 0;
+    uint64_t rela_count = 0;      // Leading RELATIVE entries (DT_RELACOUNT)
+    uint64_t jmprel_offset = 0;
+    uint64_t jmprel_size = 0;
+    uint64_t symtab_offset = 0;
+    uint64_t symbol_count = 0;
+    uint64_t strtab_offset = 0;
+    uint64_t strtab_size = 0;
+};
+
+// Entry of the module's dynamic symbol table
+struct NsoSymbol {
+    std::string name;
+    uint64_t address;   // Absolute; 0 for imports
+    uint64_t size;
+    uint8_t type;       // STT_*
+    uint8_t binding;    // STB_*
+    bool is_import;
+};
+
+// Resolves an imported symbol name to an address (false if unknown)
+using SymbolResolver = std::function<bool(std::string_view name, uint64_t& address)>;
+
 // NSO file representation
 class NsoFile {
 public:
@@ -78,7 +212,7 @@ public:
     ~NsoFile() = default;
     
     // Load NSO from file
-    bool load(const std::string& path);
+    bool load(const std::string& path, const NsoLoadOptions& options = {});
     
     // Check if loaded
     bool isLoaded() const { return loaded_; }
@@ -86,42 +220,168 @@ public:
     // Get loaded file path
     const std::string& getFilePath() const { return file_path_; }
     
-    // Get segments
-    const Segment& getTextSegment() const { return text_; }
-    const Segment& getRodataSegment() const { return rodata_; }
-    const Segment& getDataSegment() const { return data_; }
+    // Get segments (decompressed on first access; rodata and data are
+    // relocated before they are handed out)
+    const Segment& getTextSegment() const { ensureSegment(0); return text_; }
+    const Segment& getRodataSegment() const { ensureSegment(1); return rodata_; }
+    const Segment& getDataSegment() const { ensureSegment(2); return data_; }
+    
+    // Decompress every pending segment in parallel
+    bool decompressAll();
+    
+    // Apply .rela.dyn and .rela.plt at the current base address. Runs once;
+    // the rodata/data accessors call it automatically.
+    void applyRelocations() const { ensureRelocated(); }
+    
+    // Check if the 8-byte word at address was written by a relocation
+    bool isRelocated(uint64_t vaddr) const;
+    
+    // MOD0 / .dynamic contents (parsed during relocation)
+    const NsoDynamicInfo& getDynamicInfo() const { ensureRelocated(); return dynamic_; }
+    
+    // Dynamic symbols (dynsym/dynstr from the header). Reads rodata without
+    // waiting on relocation, so resolvers may call it.
+    std::vector<NsoSymbol> readSymbols() const;
+    
+    // Resolver for imported symbols, used by GLOB_DAT/JUMP_SLOT/ABS64
+    void setSymbolResolver(SymbolResolver resolver) { resolver_ = std::move(resolver); }
     
     // Get header
     const NsoHeader& getHeader() const { return header_; }
     
+    // Module name stored after the header (module_name_offset/size)
+    const std::string& getModuleName() const { return module_name_; }
+    
+    // Segment bytes as they belong in a file: current contents, patches
+    // included, with relocated words put back to their stored values.
+    // out receives exactly the segment size.
+    bool copyFileSegment(SegmentType type, std::vector<uint8_t>& out) const;
+    
     // Get build ID as string
     std::string getBuildId() const;
     
-    // Get base address (default for Switch)
+    // Get base address (default for Switch). Set it before touching any
+    // segment: relocations are applied against it.
     uint64_t getBaseAddress() const { return base_address_; }
     void setBaseAddress(uint64_t addr) { base_address_ = addr; }
     
+    // Size of the loaded image: highest segment end incl. bss, page-aligned
+    uint64_t getImageSize() const;
+    
     // Read memory at virtual address
     bool readMemory(uint64_t vaddr, void* buf, size_t size) const;
     
+    // Zero-copy access to segment memory (no copy, bounds-checked)
+    MemoryView view(uint64_t vaddr, size_t size) const;
+    
+    // NUL-terminated string at address, without the terminator.
+    // Stops after max_len bytes or at the segment end; empty if unmapped.
+    std::string_view cstringAt(uint64_t vaddr, size_t max_len = 256) const;
+    
+    // Typed read of a trivially copyable value
+    template <typename T>
+    bool read(uint64_t vaddr, T& out) const {
+        static_assert(std::is_trivially_copyable<T>::value, "read<T> needs a trivially copyable type");
+        MemoryView v = view(vaddr, sizeof(T));
+        if (!v) {
+            return false;
+        }
+        std::memcpy(&out, v.data, sizeof(T));
+        return true;
+    }
+    
     // Get segment containing address
     const Segment* getSegmentAt(uint64_t vaddr) const;
     
+    // Patch overlay. Writes go straight into the private segment memory
+    // (decoded buffers, or copy-on-write file pages when mapped); the first
+    // write to a page saves its original bytes so clearPatches() can revert.
+    // A write may not cross a segment end or land in bss. Not safe against
+    // concurrent readers.
+    bool patch(uint64_t vaddr, const uint8_t* bytes, size_t size);
+    void clearPatches();
+    bool isPatched(uint64_t vaddr) const;
+    size_t getPatchedPageCount() const { return patch_pages_.size(); }
+    
+    // Page addresses written or reverted since the last call (sorted, unique)
+    std::vector<uint64_t> takeDirtyPages();
+    
+    static constexpr uint64_t PATCH_PAGE_SIZE = 0x1000;
+    
     // Total size
     size_t getTotalSize() const;
     
+    // Stats from the last load
+    const NsoLoadStats& getLoadStats() const { return stats_; }
+    
+    // Get error message
+    std::string getError() const;
+    
 private:
+    // Decode state of one segment. Decoding happens at most once, from
+    // whichever thread touches the segment first.
+    struct SegmentState {
+        std::mutex mutex;
+        std::atomic<bool> ready{false};
+        bool ok = false;
+        std::string error;
+    };
+    
+    Segment& segment(int index) const;
+    int segmentIndexAt(uint64_t vaddr, uint64_t& seg_offset) const;
+    bool ensureSegment(int index) const;
+    bool ensureDecoded(int index) const;
+    bool ensureRelocated() const;
+    bool loadSegment(int index) const;
+    uint8_t* imageAt(uint64_t offset, size_t size) const;
+    bool parseDynamic() const;
+    void relocate() const;
+    void applyRelaTable(uint64_t offset, uint64_t size) const;
+    bool resolveSymbol(uint32_t index, uint64_t& address) const;
+    void releaseFileData() const;
     bool decompressSegment(const uint8_t* compressed, size_t comp_size, 
-                          std::vector<uint8_t>& output, size_t decomp_size);
+                          SegmentData& output, size_t decomp_size) const;
     
     NsoHeader header_{};
-    Segment text_;
-    Segment rodata_;
-    Segment data_;
     uint64_t base_address_ = 0x7100000000;  // Default Switch base
-    std::vector<uint8_t> raw_data_;
+    NsoLoadOptions options_;
     bool loaded_ = false;
     std::string file_path_;
+    std::string module_name_;
+    std::string error_;
+    
+    // Filled in lazily by const accessors
+    mutable Segment text_;
+    mutable Segment rodata_;
+    mutable Segment data_;
+    mutable SegmentState state_[3];
+    mutable std::atomic<int> pending_{0};
+    mutable SegmentState reloc_state_;
+    mutable NsoDynamicInfo dynamic_;
+    mutable std::vector<uint64_t> reloc_bitmap_;  // One bit per 8-byte word of the image
+    mutable std::vector<std::pair<uint64_t, uint64_t>> reloc_originals_;  // Image offset -> stored word
+    SymbolResolver resolver_;
+    mutable NsoLoadStats stats_;
+    
+    // Source bytes, kept while a segment is pending or views them
+    mutable std::unique_ptr<MappedFile> mapping_;
+    mutable std::vector<uint8_t> file_buf_;
+    uint8_t* file_data_ = nullptr;
+    
+    // Original bytes of a patched page (clipped to its segment)
+    struct PatchPage {
+        uint64_t offset;            // Image offset of the first saved byte
+        std::vector<uint8_t> original;
+    };
+    std::vector<uint32_t> patch_table_;   // Page -> 1 + index into patch_pages_, 0 = clean
+    std::vector<PatchPage> patch_pages_;
+    std::vector<uint64_t> dirty_pages_;
+    
+    // Segment cache location for this build, mapped cache hits, and cache
+    // writes still in flight (waited for on reload and destruction)
+    std::string cache_dir_;
+    mutable std::unique_ptr<MappedFile> cache_maps_[3];
+    mutable std::future<bool> cache_writes_[3];
 };
 
 } // namespace kiloader
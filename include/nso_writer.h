@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include "nso_loader.h"
+
+namespace kiloader {
+
+// Write options
+struct NsoWriteOptions {
+    bool compress = true;           // LZ4-compress the segments
+    bool high_compression = false;  // Use LZ4-HC instead of the fast compressor
+    int hc_level = 9;               // LZ4-HC level (1-12)
+};
+
+// Per-segment part of the write report
+struct NsoWriteSegmentStats {
+    size_t size = 0;
+    size_t stored_size = 0;         // Bytes in the file (compressed or not)
+    bool compressed = false;
+    double compress_ms = 0;
+    double hash_ms = 0;
+};
+
+// Write report
+struct NsoWriteStats {
+    NsoWriteSegmentStats segments[3];  // Indexed by SegmentType
+    size_t file_size = 0;
+    double encode_ms = 0;   // Wall time of the parallel compress/hash stage
+    double write_ms = 0;
+    double total_ms = 0;
+    
+    // Uncompressed segment bytes per second of total time
+    double getThroughputMBps() const;
+};
+
+// Serializes a loaded (possibly patched) NsoFile back into an NSO.
+// Segments are compressed and hashed concurrently; the header keeps the
+// build ID, module name and dynsym/api info of the source and gets new file
+// offsets, sizes, flags and SHA-256 hashes. Relocations applied in memory
+// are undone, so untouched segments round-trip byte for byte.
+class NsoWriter {
+public:
+    // Write nso to path (written to a temporary file, then renamed)
+    bool write(const NsoFile& nso, const std::string& path, const NsoWriteOptions& options = {});
+    
+    // Stats from the last write
+    const NsoWriteStats& getStats() const { return stats_; }
+    
+    // Get error message
+    std::string getError() const { return error_; }
+    
+private:
+    NsoWriteStats stats_;
+    std::string error_;
+};
+
+} // namespace kiloader
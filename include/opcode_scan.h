@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace kiloader {
+
+// Word classes marked by OpcodeScan
+enum class OpClass : uint8_t {
+    FrameSave,      // STP X29, X30, [SP, #imm]!
+    StackAlloc,     // SUB SP, SP, #imm
+    Paciasp,        // PACIASP
+    Bl,             // BL label
+    B,              // B label
+    Adrp,           // ADRP Rd, page
+    Ret,            // RET / RETAA / RETAB
+    Count
+};
+
+constexpr uint32_t opClassBit(OpClass c) {
+    return 1u << static_cast<unsigned>(c);
+}
+
+// Words FunctionFinder takes as a function start
+constexpr uint32_t PROLOGUE_CLASSES =
+    opClassBit(OpClass::FrameSave) | opClassBit(OpClass::StackAlloc) | opClassBit(OpClass::Paciasp);
+
+// One bitmap per class over the words of a code buffer (bit i = word i).
+// Every word is tested against all class patterns in a single pass. The
+// kernel is picked at first use: AVX2 or SSE2 on x86, NEON on AArch64,
+// otherwise portable C++.
+class OpcodeScan {
+public:
+    // Classify size / 4 words of code in parallel
+    void build(const uint8_t* code, size_t size);
+    
+    // Reclassify words [first, last) after their bytes changed
+    void update(const uint8_t* code, size_t first, size_t last);
+    
+    size_t getWordCount() const { return words_; }
+    
+    // Check whether word index is in class c
+    bool test(OpClass c, size_t index) const {
+        return index < words_ && (bits_[static_cast<size_t>(c)][index / 64] >> (index % 64)) & 1;
+    }
+    
+    // Call fn(index) for every word in [first, last) that is in any class
+    // of class_mask, in increasing order
+    template <typename Fn>
+    void forEach(uint32_t class_mask, size_t first, size_t last, Fn&& fn) const {
+        if (last > words_) {
+            last = words_;
+        }
+        if (first >= last) {
+            return;
+        }
+        for (size_t w = first / 64; w <= (last - 1) / 64; w++) {
+            uint64_t set = 0;
+            for (size_t c = 0; c < CLASS_COUNT; c++) {
+                if (class_mask & (1u << c)) {
+                    set |= bits_[c][w];
+                }
+            }
+            if (w == first / 64) {
+                set &= ~0ULL << (first % 64);
+            }
+            if (w == (last - 1) / 64 && last % 64 != 0) {
+                set &= ~0ULL >> (64 - last % 64);
+            }
+            while (set != 0) {
+                fn(w * 64 + countTrailingZeros(set));
+                set &= set - 1;
+            }
+        }
+    }
+    
+    // Classes of one word, as opClassBit flags
+    static uint32_t classify(uint32_t word);
+    
+    // Name of the kernel in use (e.g. "avx2")
+    static const char* getKernelName();
+    
+    static constexpr size_t CLASS_COUNT = static_cast<size_t>(OpClass::Count);
+    
+private:
+    static unsigned countTrailingZeros(uint64_t x) {
+#if defined(__GNUC__)
+        return static_cast<unsigned>(__builtin_ctzll(x));
+#else
+        unsigned n = 0;
+        while ((x & 1) == 0) {
+            x >>= 1;
+            n++;
+        }
+        return n;
+#endif
+    }
+    
+    size_t words_ = 0;
+    std::vector<uint64_t> bits_[CLASS_COUNT];
+};
+
+} // namespace kiloader
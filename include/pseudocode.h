@@ -5,6 +5,7 @@
 #include <vector>
 #include <map>
 #include "function_finder.h"
+#include "ir.h"
 #include "xref_analyzer.h"
 
 namespace kiloader {
@@ -14,7 +15,7 @@ namespace kiloader {
 
 class PseudocodeGenerator {
 public:
-    PseudocodeGenerator(NsoFile& nso, FunctionFinder& func_finder, XRefAnalyzer& xref);
+    PseudocodeGenerator(AddressSpace& space, FunctionFinder& func_finder, XRefAnalyzer& xref);
     
     // Generate pseudocode for a function
     std::string generate(uint64_t func_address);
@@ -24,13 +25,15 @@ public:
     std::map<uint64_t, std::string> generateAll();
     
 private:
-    std::string translateInstruction(const Instruction& insn);
-    std::string formatRegister(const std::string& reg);
+    std::string translateStatement(const ir::Stmt& s);
+    std::string formatRegister(uint8_t reg, uint8_t width);
+    std::string formatOperand(const ir::Stmt& s);
+    std::string formatMemory(const ir::Stmt& s);
     std::string formatImmediate(int64_t value);
     std::string formatAddress(uint64_t addr);
     std::string getStringAt(uint64_t addr);
     
-    NsoFile& nso_;
+    AddressSpace& space_;
     FunctionFinder& func_finder_;
     XRefAnalyzer& xref_;
 };
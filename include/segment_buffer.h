@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace kiloader {
+
+// Owned storage for segment bytes.
+// Unlike std::vector it does not zero-fill (LZ4 overwrites every byte anyway),
+// the start is aligned for vector loads, and PADDING zero bytes follow the end
+// so SIMD scanners may read a full vector past the last byte. Large buffers
+// are 2 MiB aligned and hinted for transparent huge pages on Linux.
+class SegmentBuffer {
+public:
+    static constexpr size_t ALIGNMENT = 64;
+    static constexpr size_t PADDING = 64;
+    static constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+    
+    SegmentBuffer() = default;
+    ~SegmentBuffer();
+    
+    SegmentBuffer(const SegmentBuffer& other);
+    SegmentBuffer& operator=(const SegmentBuffer& other);
+    SegmentBuffer(SegmentBuffer&& other) noexcept;
+    SegmentBuffer& operator=(SegmentBuffer&& other) noexcept;
+    
+    // Allocate size bytes with undefined contents (padding is zeroed)
+    uint8_t* allocate(size_t size);
+    
+    // Free the buffer
+    void reset();
+    
+    uint8_t* data() { return data_; }
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool empty() const { return data_ == nullptr; }
+    
+    // Whether the huge page hint was applied
+    bool isHugePageHinted() const { return huge_; }
+    
+private:
+    uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+    bool huge_ = false;
+};
+
+} // namespace kiloader
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <memory>
+#include "mapped_file.h"
+
+namespace kiloader {
+
+// On-disk cache of decompressed NSO segments.
+// Each file is a 64-byte header (magic, version, size, the segment's SHA-256
+// from the NSO header) followed by the raw segment bytes.
+class SegmentCache {
+public:
+    // Map a cached segment. Returns null if the file is missing or was
+    // written for a different hash/size. Bytes start at HEADER_SIZE.
+    static std::unique_ptr<MappedFile> open(const std::string& path, const uint8_t hash[32], size_t size);
+    
+    // Write a segment atomically (temp file + rename)
+    static bool store(const std::string& path, const uint8_t hash[32], const uint8_t* data, size_t size);
+    
+    static constexpr size_t HEADER_SIZE = 64;
+};
+
+} // namespace kiloader
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace kiloader {
+
+// SHA-256 (FIPS 180-4), used to check NSO segment hashes.
+// The block function is picked at first use: SHA-NI or AVX2 on x86,
+// the ARMv8 SHA2 instructions on AArch64, otherwise portable C++.
+class Sha256 {
+public:
+    Sha256();
+    
+    // Feed more data
+    void update(const void* data, size_t size);
+    
+    // Write the 32-byte digest. The object must not be updated afterwards.
+    void finish(uint8_t digest[32]);
+    
+    // One-shot hash
+    static void hash(const void* data, size_t size, uint8_t digest[32]);
+    
+    // Name of the block function in use (e.g. "sha-ni")
+    static const char* getKernelName();
+    
+private:
+    uint32_t state_[8];
+    uint8_t block_[64];
+    size_t block_len_ = 0;
+    uint64_t total_len_ = 0;
+};
+
+} // namespace kiloader
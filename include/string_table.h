@@ -4,7 +4,7 @@
 #include <string>
 #include <vector>
 #include <map>
-#include "nso_loader.h"
+#include "address_space.h"
 
 namespace kiloader {
 
@@ -19,9 +19,9 @@ struct StringEntry {
 // String table - finds and manages strings in the binary
 class StringTable {
 public:
-    StringTable(NsoFile& nso);
+    StringTable(AddressSpace& space);
     
-    // Find all strings in rodata
+    // Find all strings in rodata of every module
     void findStrings(size_t min_length = 4);
     
     // Search for strings containing pattern
@@ -43,7 +43,7 @@ private:
     bool isAsciiPrintable(uint8_t c) const;
     bool isValidStringChar(uint8_t c) const;
     
-    NsoFile& nso_;
+    AddressSpace& space_;
     std::vector<StringEntry> strings_;
     std::map<uint64_t, size_t> address_map_;  // address -> index in strings_
 };
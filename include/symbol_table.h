@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "nso_loader.h"
+
+namespace kiloader {
+
+// Dynamic symbol of one module in the address space
+struct Symbol {
+    std::string name;
+    uint64_t address;   // 0 for imports
+    uint64_t size;
+    size_t module;      // Index of the owning module
+    bool is_function;
+    bool is_import;
+};
+
+// Symbol table - dynsym entries of every module, hashed by name and address
+class SymbolTable {
+public:
+    void clear();
+    
+    // Add all symbols of a module. Call in load order: the first definition
+    // of a name wins, like the dynamic linker's lookup.
+    void addModule(size_t module, const std::vector<NsoSymbol>& symbols);
+    
+    // Exported (defined) symbol by name
+    const Symbol* findByName(const std::string& name) const;
+    
+    // Defined symbol at address
+    const Symbol* findByAddress(uint64_t address) const;
+    
+    // All symbols, imports included
+    const std::vector<Symbol>& getSymbols() const { return symbols_; }
+    
+private:
+    std::vector<Symbol> symbols_;
+    std::unordered_map<std::string, size_t> by_name_;    // name -> index in symbols_
+    std::unordered_map<uint64_t, size_t> by_address_;    // address -> index in symbols_
+};
+
+} // namespace kiloader
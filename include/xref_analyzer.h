@@ -5,7 +5,7 @@
 #include <vector>
 #include <map>
 #include <set>
-#include "nso_loader.h"
+#include "address_space.h"
 #include "disassembler.h"
 #include "function_finder.h"
 
@@ -36,11 +36,15 @@ struct XRef {
 // Cross-reference analyzer
 class XRefAnalyzer {
 public:
-    XRefAnalyzer(NsoFile& nso, Disassembler& disasm, FunctionFinder& func_finder);
+    XRefAnalyzer(AddressSpace& space, FunctionFinder& func_finder);
     
     // Analyze all cross-references
     void analyze();
     
+    // Drop and recompute the references made by the given functions
+    // (after FunctionFinder::reanalyzePages)
+    void reanalyzeFunctions(const std::vector<uint64_t>& func_addrs);
+    
     // Get references TO an address
     std::vector<XRef> getRefsTo(uint64_t address) const;
     
@@ -56,18 +60,18 @@ public:
     // Find references to a string
     std::vector<XRef> getStringRefs(const std::string& str) const;
     
-    // Find all data references in rodata range
+    // Find all data references in rodata ranges (all modules)
     std::vector<XRef> getRodataRefs() const;
     
     // Get all xrefs
     const std::vector<XRef>& getAllXRefs() const { return xrefs_; }
     
 private:
-    void analyzeInstruction(const Instruction& insn, uint64_t func_addr);
-    void analyzeAdrpSequence(uint64_t address);
+    // References made by one function, from its lifted statements
+    void collectRefs(const Function& func, std::vector<XRef>& out) const;
+    void buildIndex();
     
-    NsoFile& nso_;
-    Disassembler& disasm_;
+    AddressSpace& space_;
     FunctionFinder& func_finder_;
     
     std::vector<XRef> xrefs_;
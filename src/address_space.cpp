@@ -0,0 +1,315 @@
+#include "address_space.h"
+#include "ips_patch.h"
+#include <algorithm>
+#include <filesystem>
+#include <thread>
+
+namespace kiloader {
+
+namespace fs = std::filesystem;
+
+// ExeFS modules in the order the loader places them
+static const char* const EXEFS_MODULES[] = {
+    "rtld", "main",
+    "subsdk0", "subsdk1", "subsdk2", "subsdk3", "subsdk4",
+    "subsdk5", "subsdk6", "subsdk7", "subsdk8", "subsdk9",
+    "sdk"
+};
+
+bool AddressSpace::loadNso(const std::string& path, const NsoLoadOptions& options) {
+    modules_.clear();
+    main_index_ = 0;
+    error_.clear();
+    symbols_.clear();
+    symbols_ready_ = false;
+    
+    Module mod;
+    mod.name = fs::path(path).stem().string();
+    mod.nso = std::make_unique<NsoFile>();
+    if (!mod.nso->load(path, options)) {
+        error_ = mod.nso->getError();
+        return false;
+    }
+    
+    modules_.push_back(std::move(mod));
+    layoutModules();
+    return true;
+}
+
+bool AddressSpace::loadExeFs(const std::string& dir, const NsoLoadOptions& options) {
+    modules_.clear();
+    main_index_ = 0;
+    error_.clear();
+    symbols_.clear();
+    symbols_ready_ = false;
+    
+    // Collect the modules present. ExeFS files have no extension, but
+    // accept extracted "main.nso"-style names as well.
+    std::vector<std::string> paths;
+    for (const char* name : EXEFS_MODULES) {
+        fs::path path = fs::path(dir) / name;
+        std::error_code ec;
+        if (!fs::is_regular_file(path, ec)) {
+            path += ".nso";
+            if (!fs::is_regular_file(path, ec)) {
+                continue;
+            }
+        }
+        
+        Module mod;
+        mod.name = name;
+        mod.nso = std::make_unique<NsoFile>();
+        modules_.push_back(std::move(mod));
+        paths.push_back(path.string());
+    }
+    
+    if (modules_.empty()) {
+        error_ = "No NSO modules found in: " + dir;
+        return false;
+    }
+    
+    // Modules are independent, so load them concurrently
+    std::vector<char> ok(modules_.size(), 0);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < modules_.size(); i++) {
+        threads.emplace_back([&, i]() {
+            ok[i] = modules_[i].nso->load(paths[i], options);
+        });
+    }
+    
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    
+    for (size_t i = 0; i < modules_.size(); i++) {
+        if (!ok[i]) {
+            error_ = modules_[i].name + ": " + modules_[i].nso->getError();
+            modules_.clear();
+            return false;
+        }
+    }
+    
+    layoutModules();
+    return true;
+}
+
+void AddressSpace::layoutModules() {
+    uint64_t next = DEFAULT_BASE;
+    
+    for (size_t i = 0; i < modules_.size(); i++) {
+        Module& mod = modules_[i];
+        mod.base = next;
+        mod.end = next + mod.nso->getImageSize();
+        mod.nso->setBaseAddress(mod.base);
+        mod.nso->setSymbolResolver([this](std::string_view name, uint64_t& address) {
+            return resolveImport(name, address);
+        });
+        next = mod.end;
+        
+        if (mod.name == "main") {
+            main_index_ = i;
+        }
+    }
+}
+
+NsoFile& AddressSpace::getMainModule() {
+    static NsoFile unloaded;
+    return modules_.empty() ? unloaded : *modules_[main_index_].nso;
+}
+
+const NsoFile& AddressSpace::getMainModule() const {
+    return const_cast<AddressSpace*>(this)->getMainModule();
+}
+
+const Module* AddressSpace::getModuleAt(uint64_t vaddr) const {
+    // Last module starting at or below the address
+    auto it = std::upper_bound(modules_.begin(), modules_.end(), vaddr,
+        [](uint64_t addr, const Module& mod) { return addr < mod.base; });
+    if (it == modules_.begin()) {
+        return nullptr;
+    }
+    
+    --it;
+    return vaddr < it->end ? &*it : nullptr;
+}
+
+const Module* AddressSpace::findModule(const std::string& name) const {
+    for (const Module& mod : modules_) {
+        if (mod.name == name) {
+            return &mod;
+        }
+    }
+    return nullptr;
+}
+
+bool AddressSpace::readMemory(uint64_t vaddr, void* buf, size_t size) const {
+    const Module* mod = getModuleAt(vaddr);
+    return mod && mod->nso->readMemory(vaddr, buf, size);
+}
+
+MemoryView AddressSpace::view(uint64_t vaddr, size_t size) const {
+    const Module* mod = getModuleAt(vaddr);
+    return mod ? mod->nso->view(vaddr, size) : MemoryView{};
+}
+
+std::string_view AddressSpace::cstringAt(uint64_t vaddr, size_t max_len) const {
+    const Module* mod = getModuleAt(vaddr);
+    return mod ? mod->nso->cstringAt(vaddr, max_len) : std::string_view{};
+}
+
+const Segment* AddressSpace::getSegmentAt(uint64_t vaddr) const {
+    const Module* mod = getModuleAt(vaddr);
+    return mod ? mod->nso->getSegmentAt(vaddr) : nullptr;
+}
+
+const SymbolTable& AddressSpace::getSymbols() const {
+    if (symbols_ready_.load(std::memory_order_acquire)) {
+        return symbols_;
+    }
+    
+    std::lock_guard<std::mutex> lock(symbols_mutex_);
+    if (!symbols_ready_.load(std::memory_order_relaxed)) {
+        // Read each module's dynsym concurrently (this may decode rodata),
+        // then index them in load order so lookups match the linker's
+        std::vector<std::vector<NsoSymbol>> module_symbols(modules_.size());
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < modules_.size(); i++) {
+            threads.emplace_back([&, i]() {
+                module_symbols[i] = modules_[i].nso->readSymbols();
+            });
+        }
+        
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        
+        for (size_t i = 0; i < modules_.size(); i++) {
+            symbols_.addModule(i, module_symbols[i]);
+        }
+        symbols_ready_.store(true, std::memory_order_release);
+    }
+    return symbols_;
+}
+
+bool AddressSpace::resolveImport(std::string_view name, uint64_t& address) const {
+    // Called while a module is relocating; getSymbols() only needs decoded
+    // rodata, never relocated segments, so this cannot wait on itself
+    const Symbol* sym = getSymbols().findByName(std::string(name));
+    if (!sym) {
+        return false;
+    }
+    address = sym->address;
+    return true;
+}
+
+bool AddressSpace::isCode(uint64_t vaddr) const {
+    const Module* mod = getModuleAt(vaddr);
+    if (!mod) {
+        return false;
+    }
+    
+    // Header ranges only, so this never forces a decode
+    const NsoHeader& header = mod->nso->getHeader();
+    uint64_t text_start = mod->base + header.text.mem_offset;
+    return vaddr >= text_start && vaddr < text_start + header.text.size;
+}
+
+bool AddressSpace::decompressAll() {
+    // Each module decodes its own segments in parallel; run the modules
+    // side by side as well, relocating each once its segments are in
+    std::vector<char> ok(modules_.size(), 0);
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < modules_.size(); i++) {
+        threads.emplace_back([&, i]() {
+            ok[i] = modules_[i].nso->decompressAll();
+            modules_[i].nso->applyRelocations();
+        });
+    }
+    if (!modules_.empty()) {
+        ok[0] = modules_[0].nso->decompressAll();
+        modules_[0].nso->applyRelocations();
+    }
+    
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    
+    for (size_t i = 0; i < modules_.size(); i++) {
+        if (!ok[i]) {
+            error_ = modules_[i].name + ": " + modules_[i].nso->getError();
+            return false;
+        }
+    }
+    return !modules_.empty();
+}
+
+bool AddressSpace::patch(uint64_t vaddr, const uint8_t* bytes, size_t size) {
+    const Module* mod = getModuleAt(vaddr);
+    if (!mod) {
+        error_ = "Address not mapped";
+        return false;
+    }
+    if (!mod->nso->patch(vaddr, bytes, size)) {
+        error_ = mod->nso->getError();
+        return false;
+    }
+    return true;
+}
+
+void AddressSpace::clearPatches() {
+    for (Module& mod : modules_) {
+        mod.nso->clearPatches();
+    }
+}
+
+size_t AddressSpace::getPatchedPageCount() const {
+    size_t count = 0;
+    for (const Module& mod : modules_) {
+        count += mod.nso->getPatchedPageCount();
+    }
+    return count;
+}
+
+bool AddressSpace::applyPatchFile(const std::string& path) {
+    if (modules_.empty()) {
+        error_ = "Nothing loaded";
+        return false;
+    }
+    
+    IpsPatch ips;
+    if (!ips.load(path)) {
+        error_ = ips.getError();
+        return false;
+    }
+    
+    // Patch files are named after the (possibly truncated) build ID
+    std::string stem = fs::path(path).stem().string();
+    std::transform(stem.begin(), stem.end(), stem.begin(), ::toupper);
+    Module* target = &modules_[main_index_];
+    for (Module& mod : modules_) {
+        if (!stem.empty() && mod.nso->getBuildId().compare(0, stem.size(), stem) == 0) {
+            target = &mod;
+            break;
+        }
+    }
+    
+    for (const PatchRecord& record : ips.getRecords()) {
+        if (!target->nso->patch(target->base + record.offset, record.bytes.data(), record.bytes.size())) {
+            error_ = target->name + ": " + target->nso->getError();
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<uint64_t> AddressSpace::takeDirtyPages() {
+    // Modules are sorted by base, so the concatenation stays sorted
+    std::vector<uint64_t> pages;
+    for (Module& mod : modules_) {
+        std::vector<uint64_t> dirty = mod.nso->takeDirtyPages();
+        pages.insert(pages.end(), dirty.begin(), dirty.end());
+    }
+    return pages;
+}
+
+} // namespace kiloader
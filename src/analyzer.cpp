@@ -1,42 +1,177 @@
 #include "analyzer.h"
+#include "sha256.h"
+#include "insn_formatter.h"
 #include <fstream>
 #include <iostream>
 #include <iomanip>
+#include <filesystem>
+#include <chrono>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
 
 namespace kiloader {
 
+// Peak resident set size of this process in bytes (0 if unknown)
+static size_t getPeakRss() {
+#ifdef _WIN32
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return static_cast<size_t>(usage.ru_maxrss);         // bytes
+#else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;  // kilobytes
+#endif
+#endif
+}
+
 Analyzer::Analyzer() {
-    nso_ = std::make_unique<NsoFile>();
+    space_ = std::make_unique<AddressSpace>();
     disasm_ = std::make_unique<Disassembler>();
 }
 
 Analyzer::~Analyzer() = default;
 
 bool Analyzer::loadNso(const std::string& path) {
-    if (!nso_->load(path)) {
-        std::cerr << "Failed to load NSO: " << path << std::endl;
+    std::error_code ec;
+    if (std::filesystem::is_directory(path, ec)) {
+        return loadExeFs(path);
+    }
+    
+    if (!space_->loadNso(path, load_options_)) {
+        loaded_ = false;
+        std::cerr << "Failed to load NSO: " << path << " (" << space_->getError() << ")" << std::endl;
         return false;
     }
     
+    if (!initComponents()) {
+        return false;
+    }
+    
+    const NsoFile& nso = space_->getMainModule();
+    std::cout << "Loaded NSO: " << path << std::endl;
+    std::cout << "  Build ID: " << nso.getBuildId() << std::endl;
+    std::cout << "  Text size: 0x" << std::hex << nso.getHeader().text.size << std::endl;
+    std::cout << "  Rodata size: 0x" << nso.getHeader().rodata.size << std::endl;
+    std::cout << "  Data size: 0x" << nso.getHeader().data.size << std::dec << std::endl;
+    
+    printLoadReport(nso);
+    
+    return true;
+}
+
+bool Analyzer::loadExeFs(const std::string& dir) {
+    if (!space_->loadExeFs(dir, load_options_)) {
+        loaded_ = false;
+        std::cerr << "Failed to load ExeFS: " << dir << " (" << space_->getError() << ")" << std::endl;
+        return false;
+    }
+    
+    if (!initComponents()) {
+        return false;
+    }
+    
+    std::cout << "Loaded ExeFS: " << dir << " (" << space_->getModuleCount() << " modules)" << std::endl;
+    for (size_t i = 0; i < space_->getModuleCount(); i++) {
+        const Module& mod = space_->getModule(i);
+        std::cout << "  " << mod.name << ": 0x" << std::hex << mod.base << "-0x" << mod.end
+                  << std::dec << "  Build ID: " << mod.nso->getBuildId() << std::endl;
+        printLoadReport(*mod.nso);
+    }
+    
+    return true;
+}
+
+bool Analyzer::initComponents() {
     if (!disasm_->initialize()) {
         std::cerr << "Failed to initialize disassembler: " << disasm_->getError() << std::endl;
         return false;
     }
     
     // Create other components
-    func_finder_ = std::make_unique<FunctionFinder>(*nso_, *disasm_);
-    string_table_ = std::make_unique<StringTable>(*nso_);
+    decode_table_ = std::make_unique<DecodeTable>(*space_, *disasm_);
+    func_finder_ = std::make_unique<FunctionFinder>(*space_, *decode_table_);
+    string_table_ = std::make_unique<StringTable>(*space_);
+    xref_analyzer_.reset();
+    pseudocode_.reset();
     
     loaded_ = true;
     analyzed_ = false;
+    return true;
+}
+
+void Analyzer::printLoadReport(const NsoFile& nso) {
+    const NsoLoadStats& stats = nso.getLoadStats();
     
-    std::cout << "Loaded NSO: " << path << std::endl;
-    std::cout << "  Build ID: " << nso_->getBuildId() << std::endl;
-    std::cout << "  Text size: 0x" << std::hex << nso_->getTextSegment().size << std::endl;
-    std::cout << "  Rodata size: 0x" << nso_->getRodataSegment().size << std::endl;
-    std::cout << "  Data size: 0x" << nso_->getDataSegment().size << std::dec << std::endl;
+    size_t mapped_bytes = 0;
+    size_t owned_bytes = 0;
+    for (const auto& seg : stats.segments) {
+        if (seg.mapped) {
+            mapped_bytes += seg.size;
+        } else if (seg.decoded) {
+            owned_bytes += seg.size;
+        }
+    }
     
-    return true;
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "  Load: " << stats.load_ms << " ms (" << (stats.used_mmap ? "mmap" : "read") << "), "
+              << mapped_bytes / (1024.0 * 1024.0) << " MB mapped, "
+              << owned_bytes / (1024.0 * 1024.0) << " MB decompressed" << std::endl;
+    
+    static const char* segment_names[3] = {"text", "rodata", "data"};
+    std::cout << "  Decode stage: " << stats.decode_ms << " ms" << std::endl;
+    for (int i = 0; i < 3; i++) {
+        const NsoSegmentStats& seg = stats.segments[i];
+        std::cout << "    " << std::left << std::setw(7) << segment_names[i] << std::right
+                  << (seg.compressed ? "lz4 " : "raw ");
+        if (!seg.decoded) {
+            std::cout << "pending (decoded on first use)" << std::endl;
+            continue;
+        }
+        std::cout << seg.decompress_ms << " ms";
+        if (seg.cache_hit) {
+            std::cout << " (from cache)";
+        } else if (seg.cache_stored) {
+            std::cout << " (cached)";
+        }
+        if (seg.hash_checked) {
+            double mb = seg.size / (1024.0 * 1024.0);
+            std::cout << ", sha256 " << seg.hash_ms << " ms";
+            if (seg.hash_ms > 0) {
+                std::cout << " (" << mb / (seg.hash_ms / 1000.0) << " MB/s)";
+            }
+            std::cout << " " << (seg.hash_ok ? "OK" : "MISMATCH");
+        }
+        std::cout << std::endl;
+    }
+    if (load_options_.verify_hashes) {
+        double hash_total_ms = 0;
+        size_t hashed = 0;
+        for (const auto& seg : stats.segments) {
+            hash_total_ms += seg.hash_ms;
+            hashed += seg.size;
+        }
+        std::cout << "  Verify: " << hashed / (1024.0 * 1024.0) << " MB hashed with "
+                  << Sha256::getKernelName() << ", " << hash_total_ms << " ms CPU";
+        if (hash_total_ms > 0) {
+            std::cout << " (" << (hashed / (1024.0 * 1024.0)) / (hash_total_ms / 1000.0) << " MB/s)";
+        }
+        std::cout << std::endl;
+    }
+    const NsoRelocStats& relocs = stats.relocs;
+    if (relocs.applied) {
+        std::cout << "  Relocations: " << relocs.relative << " relative, " << relocs.symbolic
+                  << " symbolic, " << relocs.unresolved << " unresolved, " << relocs.ms << " ms" << std::endl;
+    } else {
+        std::cout << "  Relocations: applied on first use" << std::endl;
+    }
+    std::cout << "  Peak RSS: " << getPeakRss() / (1024.0 * 1024.0) << " MB" << std::endl;
+    std::cout << std::defaultfloat;
 }
 
 void Analyzer::analyze() {
@@ -45,6 +180,43 @@ void Analyzer::analyze() {
         return;
     }
     
+    // Analysis reads every segment; decode any still-compressed ones in parallel
+    if (!space_->decompressAll()) {
+        std::cerr << "Failed to decompress NSO: " << space_->getError() << std::endl;
+        return;
+    }
+    
+    // A full pass sees every patch made so far
+    decode_table_->invalidate(space_->takeDirtyPages(), NsoFile::PATCH_PAGE_SIZE);
+    
+    NsoRelocStats relocs;
+    for (size_t i = 0; i < space_->getModuleCount(); i++) {
+        const NsoRelocStats& mod = space_->getModule(i).nso->getLoadStats().relocs;
+        relocs.relative += mod.relative;
+        relocs.symbolic += mod.symbolic;
+        relocs.unresolved += mod.unresolved;
+        relocs.ms += mod.ms;
+    }
+    std::cout << "Applied " << relocs.relative + relocs.symbolic << " relocations ("
+              << relocs.unresolved << " unresolved imports) in " << std::fixed << std::setprecision(1)
+              << relocs.ms << " ms" << std::defaultfloat << std::endl;
+    
+    std::cout << "\nDecoding text..." << std::endl;
+    auto decode_start = std::chrono::steady_clock::now();
+    decode_table_->decodeAll();
+    double decode_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - decode_start).count();
+    std::cout << "  Decoded in " << std::fixed << std::setprecision(1) << decode_ms << " ms"
+              << std::defaultfloat << std::endl;
+    
+    std::cout << "\nClassifying text..." << std::endl;
+    auto classify_start = std::chrono::steady_clock::now();
+    decode_table_->classifyWords();
+    double classify_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - classify_start).count();
+    std::cout << "  " << decode_table_->countWords(WordKind::Code) << " code, "
+              << decode_table_->countWords(WordKind::Data) << " data, "
+              << decode_table_->countWords(WordKind::Padding) << " padding words in "
+              << std::fixed << std::setprecision(1) << classify_ms << " ms" << std::defaultfloat << std::endl;
+    
     std::cout << "\nFinding strings..." << std::endl;
     string_table_->findStrings();
     std::cout << "  Found " << string_table_->getStrings().size() << " strings" << std::endl;
@@ -54,28 +226,139 @@ void Analyzer::analyze() {
     std::cout << "  Found " << func_finder_->getFunctions().size() << " functions" << std::endl;
     
     std::cout << "\nAnalyzing cross-references..." << std::endl;
-    xref_analyzer_ = std::make_unique<XRefAnalyzer>(*nso_, *disasm_, *func_finder_);
+    xref_analyzer_ = std::make_unique<XRefAnalyzer>(*space_, *func_finder_);
     xref_analyzer_->analyze();
     std::cout << "  Found " << xref_analyzer_->getAllXRefs().size() << " xrefs" << std::endl;
     
     // Create pseudocode generator
-    pseudocode_ = std::make_unique<PseudocodeGenerator>(*nso_, *func_finder_, *xref_analyzer_);
+    pseudocode_ = std::make_unique<PseudocodeGenerator>(*space_, *func_finder_, *xref_analyzer_);
     
     analyzed_ = true;
     std::cout << "\nAnalysis complete!" << std::endl;
 }
 
-std::vector<Instruction> Analyzer::disassembleAt(uint64_t address, size_t count) {
-    if (!loaded_) return {};
+bool Analyzer::applyPatchFile(const std::string& path) {
+    if (!loaded_) {
+        std::cerr << "No NSO loaded" << std::endl;
+        return false;
+    }
     
-    uint8_t buf[1024];
-    size_t size = std::min(count * 4, sizeof(buf));
+    if (!space_->applyPatchFile(path)) {
+        std::cerr << "Failed to apply patch: " << space_->getError() << std::endl;
+        reanalyzePatched();  // Records before the failing one are in
+        return false;
+    }
+    
+    reanalyzePatched();
+    return true;
+}
+
+bool Analyzer::patchBytes(uint64_t address, const std::vector<uint8_t>& bytes) {
+    if (!loaded_) {
+        std::cerr << "No NSO loaded" << std::endl;
+        return false;
+    }
     
-    if (!nso_->readMemory(address, buf, size)) {
-        return {};
+    if (!space_->patch(address, bytes.data(), bytes.size())) {
+        std::cerr << "Failed to patch: " << space_->getError() << std::endl;
+        return false;
     }
     
-    return disasm_->disassemble(buf, size, address, count);
+    reanalyzePatched();
+    return true;
+}
+
+void Analyzer::clearPatches() {
+    if (!loaded_) return;
+    
+    space_->clearPatches();
+    reanalyzePatched();
+}
+
+void Analyzer::reanalyzePatched() {
+    std::vector<uint64_t> pages = space_->takeDirtyPages();
+    decode_table_->invalidate(pages, NsoFile::PATCH_PAGE_SIZE);
+    std::cout << space_->getPatchedPageCount() << " patched pages" << std::endl;
+    if (!analyzed_ || pages.empty()) {
+        return;
+    }
+    
+    auto start = std::chrono::steady_clock::now();
+    
+    std::vector<uint64_t> funcs = func_finder_->reanalyzePages(pages, NsoFile::PATCH_PAGE_SIZE);
+    xref_analyzer_->reanalyzeFunctions(funcs);
+    
+    bool rodata_dirty = false;
+    for (uint64_t page : pages) {
+        const Segment* seg = space_->getSegmentAt(page);
+        if (seg && seg->type == SegmentType::Rodata) {
+            rodata_dirty = true;
+            break;
+        }
+    }
+    if (rodata_dirty) {
+        string_table_->findStrings();
+    }
+    
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Reanalyzed " << funcs.size() << " functions on " << pages.size() << " dirty pages"
+              << (rodata_dirty ? " (strings rescanned)" : "") << " in " << std::fixed
+              << std::setprecision(1) << ms << " ms" << std::defaultfloat << std::endl;
+}
+
+std::vector<Instruction> Analyzer::disassembleAt(uint64_t address, size_t count) {
+    std::vector<Instruction> result;
+    disassembleCount(address, count, [&](const Instruction& insn) {
+        result.push_back(insn);
+        return true;
+    });
+    return result;
+}
+
+size_t Analyzer::disassembleRange(uint64_t start, uint64_t end, const InstructionVisitor& fn) {
+    return streamInstructions(start, end, SIZE_MAX, fn);
+}
+
+size_t Analyzer::disassembleCount(uint64_t address, size_t count, const InstructionVisitor& fn) {
+    return streamInstructions(address, UINT64_MAX, count, fn);
+}
+
+size_t Analyzer::streamInstructions(uint64_t address, uint64_t end, size_t count, const InstructionVisitor& fn) {
+    if (!loaded_ || count == 0 || end <= address) return 0;
+    
+    // Text is read from the decode table
+    if (decode_table_->contains(address)) {
+        return decode_table_->visit(address, end, count, fn);
+    }
+    
+    // Anything else (data viewed as code) is decoded in place from segment
+    // memory, up to the segment end
+    const Module* mod = space_->getModuleAt(address);
+    const Segment* seg = space_->getSegmentAt(address);
+    if (!mod || !seg) return 0;
+    
+    uint64_t seg_end = mod->base + seg->mem_offset + seg->data.size();
+    if (address >= seg_end) return 0;
+    
+    // Whole words that start before end
+    uint64_t span = std::min(seg_end - address, end - address);
+    span = std::min<uint64_t>(seg_end - address, (span + 3) & ~3ULL);
+    MemoryView mem = space_->view(address, span);
+    auto worker = disasm_->acquire();
+    if (!mem || !worker) return 0;
+    
+    const uint8_t* code = mem.data;
+    size_t size = mem.size;
+    uint64_t pc = address;
+    size_t visited = 0;
+    Instruction insn;
+    while (visited < count && worker->decodeStep(code, size, pc, insn)) {
+        visited++;
+        if (!fn(insn)) {
+            break;
+        }
+    }
+    return visited;
 }
 
 Function* Analyzer::getFunctionAt(uint64_t address) {
@@ -83,6 +366,20 @@ Function* Analyzer::getFunctionAt(uint64_t address) {
     return func_finder_->getFunction(address);
 }
 
+uint64_t Analyzer::findFunctionByName(const std::string& name) {
+    if (!loaded_) return 0;
+    
+    if (analyzed_) {
+        if (Function* func = func_finder_->findFunctionByName(name)) {
+            return func->address;
+        }
+    }
+    
+    // Exported symbols resolve even before analysis
+    const Symbol* sym = space_->getSymbols().findByName(name);
+    return sym ? sym->address : 0;
+}
+
 std::string Analyzer::getPseudocodeAt(uint64_t address) {
     if (!analyzed_) return "";
     return pseudocode_->generate(address);
@@ -122,7 +419,7 @@ void Analyzer::exportToFile(const std::string& path) {
     
     f << "KILOADER ANALYSIS DUMP\n";
     f << "======================\n\n";
-    f << "Build ID: " << nso_->getBuildId() << "\n\n";
+    f << "Build ID: " << space_->getMainModule().getBuildId() << "\n\n";
     
     // Strings
     f << "STRINGS\n";
@@ -170,10 +467,14 @@ void Analyzer::exportStrings(const std::string& path) {
 }
 
 void Analyzer::printDisassembly(uint64_t address, size_t count) {
-    auto insns = disassembleAt(address, count);
-    for (const auto& insn : insns) {
-        std::cout << insn.toString() << std::endl;
-    }
+    InsnFormatter formatter;
+    char line[InsnFormatter::LINE_SIZE];
+    disassembleCount(address, count, [&](const Instruction& insn) {
+        size_t length = formatter.formatLine(insn, line, sizeof(line));
+        std::cout.write(line, length) << '\n';
+        return true;
+    });
+    std::cout.flush();
 }
 
 void Analyzer::printFunction(uint64_t address) {
@@ -189,9 +490,14 @@ void Analyzer::printFunction(uint64_t address) {
     std::cout << "Leaf: " << (func->is_leaf ? "yes" : "no") << std::endl;
     std::cout << "\nDisassembly:\n";
     
+    InsnFormatter formatter;
+    char line[InsnFormatter::LINE_SIZE];
     for (const auto& insn : func->instructions) {
-        std::cout << "  " << insn.toString() << std::endl;
+        size_t length = formatter.formatLine(insn, line, sizeof(line));
+        std::cout << "  ";
+        std::cout.write(line, length) << '\n';
     }
+    std::cout.flush();
 }
 
 void Analyzer::printXRefs(uint64_t address) {
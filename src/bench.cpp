@@ -0,0 +1,1074 @@
+#include "bench.h"
+#include "nso_loader.h"
+#include "segment_buffer.h"
+#include "disassembler.h"
+#include "a64_decoder.h"
+#include "analyzer.h"
+#include "opcode_scan.h"
+#include "insn_formatter.h"
+#include "ir.h"
+#include "code_map.h"
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <cstdio>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <atomic>
+#include <lz4.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+namespace kiloader {
+
+PerfCounter::PerfCounter(Event event) {
+#ifdef __linux__
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    
+    switch (event) {
+        case Event::DtlbMisses:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                          (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        case Event::Instructions:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case Event::CacheMisses:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CACHE_MISSES;
+            break;
+    }
+    
+    fd_ = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#else
+    (void)event;
+#endif
+}
+
+PerfCounter::~PerfCounter() {
+#ifdef __linux__
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+#endif
+}
+
+void PerfCounter::start() {
+#ifdef __linux__
+    if (fd_ >= 0) {
+        ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+}
+
+uint64_t PerfCounter::stop() {
+    uint64_t value = 0;
+#ifdef __linux__
+    if (fd_ >= 0) {
+        ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd_, &value, sizeof(value)) != sizeof(value)) {
+            value = 0;
+        }
+    }
+#endif
+    return value;
+}
+
+// Minor page faults so far (0 if unknown)
+static uint64_t getMinorFaults() {
+#ifdef _WIN32
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+    return static_cast<uint64_t>(usage.ru_minflt);
+#endif
+}
+
+// Peak resident set size in bytes (0 if unknown)
+static uint64_t getPeakRss() {
+#ifdef _WIN32
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return static_cast<uint64_t>(usage.ru_maxrss);         // Bytes
+#else
+    return static_cast<uint64_t>(usage.ru_maxrss) * 1024;  // KiB
+#endif
+#endif
+}
+
+static double msSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// One measured run: wall time, minor faults and dTLB misses
+struct BenchSample {
+    double ms = 0;
+    uint64_t faults = 0;
+    uint64_t tlb_misses = 0;
+};
+
+template <typename Fn>
+static BenchSample measure(PerfCounter& tlb, Fn&& fn) {
+    BenchSample sample;
+    uint64_t faults = getMinorFaults();
+    tlb.start();
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    sample.ms = msSince(start);
+    sample.tlb_misses = tlb.stop();
+    sample.faults = getMinorFaults() - faults;
+    return sample;
+}
+
+static void printSample(const char* label, const BenchSample& sample, const PerfCounter& tlb) {
+    std::cout << "    " << std::left << std::setw(24) << label << std::right
+              << std::setw(9) << sample.ms << " ms"
+              << std::setw(10) << sample.faults << " faults";
+    if (tlb.isAvailable()) {
+        std::cout << std::setw(12) << sample.tlb_misses << " dTLB misses";
+    }
+    std::cout << std::endl;
+}
+
+// Same predicates as FunctionFinder::isPrologue, as a flat loop
+static size_t scanPrologues(const uint8_t* code, size_t size) {
+    size_t count = 0;
+    for (size_t offset = 0; offset + 4 <= size; offset += 4) {
+        uint32_t insn;
+        std::memcpy(&insn, code + offset, sizeof(insn));
+        if ((insn & 0xFFC07FFF) == 0xA9807BFD ||
+            (insn & 0xFF8003FF) == 0xD10003FF ||
+            insn == 0xD503233F) {
+            count++;
+        }
+    }
+    return count;
+}
+
+// Same acceptance rule as StringTable::findStrings (printable run + NUL)
+static size_t scanStrings(const uint8_t* data, size_t size, size_t min_length = 4) {
+    size_t count = 0;
+    size_t run = 0;
+    for (size_t i = 0; i < size; i++) {
+        uint8_t c = data[i];
+        if ((c >= 0x20 && c <= 0x7E) || c == '\t' || c == '\n' || c == '\r') {
+            run++;
+        } else {
+            if (c == 0 && run >= min_length) {
+                count++;
+            }
+            run = 0;
+        }
+    }
+    return count;
+}
+
+// Decompress every LZ4 segment into a zero-filled std::vector and into a
+// SegmentBuffer, then time full loads
+static int benchLoad(const std::string& path, int iterations) {
+    MappedFile file;
+    if (!file.open(path) || file.size() < sizeof(NsoHeader)) {
+        std::cerr << "Failed to open: " << path << std::endl;
+        return 1;
+    }
+    NsoHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    
+    PerfCounter tlb(PerfCounter::Event::DtlbMisses);
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "Segment decode (" << iterations << " runs, best):" << std::endl;
+    
+    const NsoSegmentHeader* segs[3] = {&header.text, &header.rodata, &header.data};
+    const uint32_t comp_sizes[3] = {header.text_compressed_size, header.rodata_compressed_size,
+                                    header.data_compressed_size};
+    static const char* names[3] = {"text", "rodata", "data"};
+    
+    for (int i = 0; i < 3; i++) {
+        if (!(header.flags & (1u << i)) ||
+            static_cast<uint64_t>(segs[i]->file_offset) + comp_sizes[i] > file.size()) {
+            continue;
+        }
+        const char* src = reinterpret_cast<const char*>(file.data() + segs[i]->file_offset);
+        size_t size = segs[i]->size;
+        
+        BenchSample best_vec, best_buf;
+        best_vec.ms = best_buf.ms = 1e30;
+        for (int it = 0; it < iterations; it++) {
+            BenchSample vec = measure(tlb, [&]() {
+                std::vector<uint8_t> out;
+                out.resize(size);
+                LZ4_decompress_safe(src, reinterpret_cast<char*>(out.data()),
+                                    static_cast<int>(comp_sizes[i]), static_cast<int>(size));
+            });
+            BenchSample buf = measure(tlb, [&]() {
+                SegmentBuffer out;
+                LZ4_decompress_safe(src, reinterpret_cast<char*>(out.allocate(size)),
+                                    static_cast<int>(comp_sizes[i]), static_cast<int>(size));
+            });
+            if (vec.ms < best_vec.ms) best_vec = vec;
+            if (buf.ms < best_buf.ms) best_buf = buf;
+        }
+        
+        std::cout << "  " << names[i] << " (" << size / (1024.0 * 1024.0) << " MB)" << std::endl;
+        printSample("std::vector (resize)", best_vec, tlb);
+        printSample("SegmentBuffer", best_buf, tlb);
+    }
+    
+    std::cout << "Full load, eager, no cache (" << iterations << " runs):" << std::endl;
+    for (int it = 0; it < iterations; it++) {
+        NsoFile nso;
+        NsoLoadOptions options;
+        options.lazy = false;
+        BenchSample sample = measure(tlb, [&]() { nso.load(path, options); });
+        if (!nso.isLoaded()) {
+            std::cerr << "Failed to load: " << nso.getError() << std::endl;
+            return 1;
+        }
+        std::string label = "run " + std::to_string(it + 1);
+        printSample(label.c_str(), sample, tlb);
+    }
+    
+    if (!tlb.isAvailable()) {
+        std::cout << "(dTLB counter unavailable: perf_event_open not permitted)" << std::endl;
+    }
+    return 0;
+}
+
+// Run the prologue and string scan kernels over segment copies held in a
+// std::vector and in a huge-page hinted SegmentBuffer
+static int benchScan(const std::string& path, int iterations) {
+    NsoFile nso;
+    NsoLoadOptions options;
+    options.lazy = false;
+    if (!nso.load(path, options)) {
+        std::cerr << "Failed to load: " << nso.getError() << std::endl;
+        return 1;
+    }
+    
+    PerfCounter tlb(PerfCounter::Event::DtlbMisses);
+    std::cout << std::fixed << std::setprecision(2);
+    
+    struct Target {
+        const char* name;
+        const SegmentData* data;
+        size_t (*scan)(const uint8_t*, size_t, size_t);
+    };
+    auto prologues = [](const uint8_t* p, size_t n, size_t) { return scanPrologues(p, n); };
+    auto strings = [](const uint8_t* p, size_t n, size_t min) { return scanStrings(p, n, min); };
+    Target targets[2] = {
+        {"prologue scan (text)", &nso.getTextSegment().data, prologues},
+        {"string scan (rodata)", &nso.getRodataSegment().data, strings}
+    };
+    
+    for (const Target& target : targets) {
+        const SegmentData& seg = *target.data;
+        std::vector<uint8_t> vec(seg.begin(), seg.end());
+        SegmentBuffer buf;
+        std::memcpy(buf.allocate(seg.size()), seg.data(), seg.size());
+        
+        BenchSample best_vec, best_buf;
+        best_vec.ms = best_buf.ms = 1e30;
+        size_t found = 0;
+        for (int it = 0; it < iterations; it++) {
+            BenchSample a = measure(tlb, [&]() { found = target.scan(vec.data(), vec.size(), 4); });
+            BenchSample b = measure(tlb, [&]() { found = target.scan(buf.data(), buf.size(), 4); });
+            if (a.ms < best_vec.ms) best_vec = a;
+            if (b.ms < best_buf.ms) best_buf = b;
+        }
+        
+        std::cout << "  " << target.name << ": " << seg.size() / (1024.0 * 1024.0) << " MB, "
+                  << found << " hits" << (buf.isHugePageHinted() ? ", huge pages hinted" : "") << std::endl;
+        printSample("std::vector", best_vec, tlb);
+        printSample("SegmentBuffer", best_buf, tlb);
+    }
+    
+    // Every class the discovery passes use, in one parallel pass
+    const SegmentData& text = nso.getTextSegment().data;
+    OpcodeScan scan;
+    BenchSample best_scan;
+    best_scan.ms = 1e30;
+    for (int it = 0; it < iterations; it++) {
+        BenchSample sample = measure(tlb, [&]() { scan.build(text.data(), text.size()); });
+        if (sample.ms < best_scan.ms) best_scan = sample;
+    }
+    std::cout << "  opcode-class bitmaps (text, " << OpcodeScan::getKernelName() << "):" << std::endl;
+    printSample("all classes", best_scan, tlb);
+    static const char* class_names[OpcodeScan::CLASS_COUNT] = {
+        "stp x29, x30", "sub sp", "paciasp", "bl", "b", "adrp", "ret"
+    };
+    for (size_t c = 0; c < OpcodeScan::CLASS_COUNT; c++) {
+        size_t hits = 0;
+        scan.forEach(1u << c, 0, scan.getWordCount(), [&](size_t) { hits++; });
+        std::cout << "    " << std::left << std::setw(14) << class_names[c] << std::right
+                  << std::setw(10) << hits << std::endl;
+    }
+    
+    if (!tlb.isAvailable()) {
+        std::cout << "(dTLB counter unavailable: perf_event_open not permitted)" << std::endl;
+    }
+    return 0;
+}
+
+// Linear Capstone decode of [start, end) of text, 4 KiB per call.
+// Undecodable words are skipped. Returns the instruction count.
+static size_t decodeRange(DisasmWorker& worker, const uint8_t* code, uint64_t base, size_t start, size_t end) {
+    constexpr size_t BLOCK = 4096;
+    size_t count = 0;
+    size_t offset = start;
+    std::vector<Instruction> insns;
+    while (offset + 4 <= end) {
+        size_t size = std::min(BLOCK, end - offset);
+        insns.clear();
+        size_t decoded = worker.disassemble(code + offset, size, base + offset, 0, insns);
+        if (decoded == 0) {
+            offset += 4;
+            continue;
+        }
+        count += decoded;
+        offset += decoded * 4;
+    }
+    return count;
+}
+
+// Single-thread per-instruction decode of [0, size) of text: cs_disasm with
+// a fresh cs_insn per word (the old disassembleOne), then the worker's
+// cs_disasm_iter path with detail off and on
+static void benchPerInstruction(Disassembler& disasm, const uint8_t* code, uint64_t base,
+                                size_t size, int iterations) {
+    auto worker = disasm.acquire();
+    if (!worker) {
+        return;
+    }
+    csh handle;
+    if (cs_open(CS_ARCH_ARM64, CS_MODE_LITTLE_ENDIAN, &handle) != CS_ERR_OK) {
+        return;
+    }
+    cs_option(handle, CS_OPT_DETAIL, CS_OPT_OFF);
+    
+    double best_alloc = 1e30, best_iter = 1e30, best_detail = 1e30;
+    size_t decoded = 0;
+    uint64_t sink = 0;
+    for (int it = 0; it < iterations; it++) {
+        auto start = std::chrono::steady_clock::now();
+        decoded = 0;
+        for (size_t offset = 0; offset + 4 <= size; offset += 4) {
+            cs_insn* insn = nullptr;
+            if (cs_disasm(handle, code + offset, 4, base + offset, 1, &insn) == 1) {
+                sink += insn->id;
+                decoded++;
+            }
+            cs_free(insn, 1);
+        }
+        best_alloc = std::min(best_alloc, msSince(start));
+        
+        for (bool detail : {false, true}) {
+            worker->setDetail(detail);
+            start = std::chrono::steady_clock::now();
+            Instruction inst;
+            for (size_t offset = 0; offset + 4 <= size; offset += 4) {
+                if (worker->disassembleOne(code + offset, 4, base + offset, inst)) {
+                    sink += inst.word;
+                }
+            }
+            double& best = detail ? best_detail : best_iter;
+            best = std::min(best, msSince(start));
+        }
+    }
+    worker->setDetail(false);
+    cs_close(&handle);
+    
+    auto rate = [&](double ms) { return decoded / (ms / 1000.0) / 1e6; };
+    std::cout << "Per-instruction decode, 1 thread (" << iterations << " runs, best):" << std::endl;
+    std::cout << "  cs_disasm + cs_free     " << std::setw(10) << best_alloc << " ms"
+              << std::setw(10) << rate(best_alloc) << " M insn/s" << std::endl;
+    std::cout << "  cs_disasm_iter          " << std::setw(10) << best_iter << " ms"
+              << std::setw(10) << rate(best_iter) << " M insn/s" << std::endl;
+    std::cout << "  cs_disasm_iter + detail " << std::setw(10) << best_detail << " ms"
+              << std::setw(10) << rate(best_detail) << " M insn/s" << std::endl;
+    std::cout << "  (checksum " << (sink & 0xFFFF) << ")" << std::endl;
+}
+
+// Decode the whole main text with 1, 2, 4, ... threads, each on its own
+// pooled Capstone worker, and report the scaling
+static int benchDisasm(const std::string& path, int iterations) {
+    NsoFile nso;
+    NsoLoadOptions options;
+    options.lazy = false;
+    if (!nso.load(path, options)) {
+        std::cerr << "Failed to load: " << nso.getError() << std::endl;
+        return 1;
+    }
+    
+    Disassembler disasm;
+    if (!disasm.initialize()) {
+        std::cerr << "Failed to initialize disassembler: " << disasm.getError() << std::endl;
+        return 1;
+    }
+    
+    const Segment& text = nso.getTextSegment();
+    const uint8_t* code = text.data.data();
+    size_t size = text.data.size() & ~static_cast<size_t>(3);
+    uint64_t base = nso.getBaseAddress() + text.mem_offset;
+    
+    size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<size_t> counts;
+    for (size_t n = 1; n < max_threads; n *= 2) {
+        counts.push_back(n);
+    }
+    counts.push_back(max_threads);
+    
+    std::cout << std::fixed << std::setprecision(2);
+    benchPerInstruction(disasm, code, base, size, iterations);
+    
+    std::cout << "Linear decode of text (" << size / (1024.0 * 1024.0) << " MB, "
+              << iterations << " runs, best):" << std::endl;
+    
+    double single_ms = 0;
+    for (size_t threads_used : counts) {
+        double best = 1e30;
+        size_t total = 0;
+        for (int it = 0; it < iterations + 1; it++) {  // First run opens the handles
+            std::atomic<size_t> decoded{0};
+            std::vector<std::thread> threads;
+            size_t chunk_size = (size / 4 / threads_used + 1) * 4;
+            
+            auto start = std::chrono::steady_clock::now();
+            for (size_t t = 0; t < threads_used; t++) {
+                threads.emplace_back([&, t]() {
+                    auto worker = disasm.acquire();
+                    size_t begin = std::min(t * chunk_size, size);
+                    size_t end = std::min(begin + chunk_size, size);
+                    if (worker) {
+                        decoded += decodeRange(*worker, code, base, begin, end);
+                    }
+                });
+            }
+            for (auto& thread : threads) {
+                thread.join();
+            }
+            double ms = msSince(start);
+            
+            if (it > 0 && ms < best) {
+                best = ms;
+            }
+            total = decoded;
+        }
+        if (threads_used == 1) {
+            single_ms = best;
+        }
+        
+        std::cout << "  " << std::setw(3) << threads_used << " threads"
+                  << std::setw(10) << best << " ms"
+                  << std::setw(10) << total / (best / 1000.0) / 1e6 << " M insn/s"
+                  << std::setw(8) << single_ms / best << "x" << std::endl;
+    }
+    return 0;
+}
+
+// The Instruction::toString formatting this tree used before InsnFormatter:
+// ostringstream plus snprintf per byte
+static std::string formatLegacy(const Instruction& insn) {
+    std::ostringstream ss;
+    ss << std::hex << "0x" << insn.address << ": ";
+    for (size_t i = 0; i < Instruction::size(); i++) {
+        char buf[4];
+        snprintf(buf, sizeof(buf), "%02X ", insn.byte(i));
+        ss << buf;
+    }
+    ss << insn.mnemonic() << " " << insn.operands();
+    return ss.str();
+}
+
+// Format a full listing of the main text, line by line, the old way and
+// with InsnFormatter. Decoding is not timed.
+static int benchFormat(const std::string& path, int iterations) {
+    NsoFile nso;
+    NsoLoadOptions options;
+    options.lazy = false;
+    if (!nso.load(path, options)) {
+        std::cerr << "Failed to load: " << nso.getError() << std::endl;
+        return 1;
+    }
+    
+    Disassembler disasm;
+    if (!disasm.initialize()) {
+        std::cerr << "Failed to initialize disassembler: " << disasm.getError() << std::endl;
+        return 1;
+    }
+    auto worker = disasm.acquire();
+    if (!worker) {
+        std::cerr << "Failed to open a Capstone worker: " << disasm.getError() << std::endl;
+        return 1;
+    }
+    
+    const Segment& text = nso.getTextSegment();
+    const uint8_t* code = text.data.data();
+    size_t size = text.data.size() & ~static_cast<size_t>(3);
+    uint64_t base = nso.getBaseAddress() + text.mem_offset;
+    
+    InsnFormatter formatter(*worker);
+    double best_legacy = 1e30, best_formatter = 1e30;
+    size_t lines = 0;
+    uint64_t sink = 0;
+    for (int it = 0; it < iterations; it++) {
+        double legacy_ms = 0, formatter_ms = 0;
+        lines = 0;
+        std::vector<Instruction> insns;
+        size_t offset = 0;
+        while (offset + 4 <= size) {
+            insns.clear();
+            size_t decoded = worker->disassemble(code + offset, std::min<size_t>(16384, size - offset),
+                                                 base + offset, 0, insns);
+            if (decoded == 0) {
+                offset += 4;
+                continue;
+            }
+            offset += decoded * 4;
+            lines += decoded;
+            
+            auto start = std::chrono::steady_clock::now();
+            for (const Instruction& insn : insns) {
+                sink += formatLegacy(insn).size();
+            }
+            legacy_ms += msSince(start);
+            
+            start = std::chrono::steady_clock::now();
+            char line[InsnFormatter::LINE_SIZE];
+            for (const Instruction& insn : insns) {
+                sink += formatter.formatLine(insn, line, sizeof(line));
+            }
+            formatter_ms += msSince(start);
+        }
+        best_legacy = std::min(best_legacy, legacy_ms);
+        best_formatter = std::min(best_formatter, formatter_ms);
+    }
+    
+    auto rate = [&](double ms) { return lines / (ms / 1000.0) / 1e6; };
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "Full-text listing, " << lines << " lines (" << iterations << " runs, best):" << std::endl;
+    std::cout << "  ostringstream  " << std::setw(10) << best_legacy << " ms"
+              << std::setw(10) << rate(best_legacy) << " M lines/s" << std::endl;
+    std::cout << "  InsnFormatter  " << std::setw(10) << best_formatter << " ms"
+              << std::setw(10) << rate(best_formatter) << " M lines/s" << std::endl;
+    std::cout << "  (checksum " << (sink & 0xFFFF) << ")" << std::endl;
+    return 0;
+}
+
+// Class Capstone assigns to an instruction, judged by its mnemonic.
+// Only the branch classes and ADR/ADRP are decided this way; ADD and LDR/STR
+// share mnemonics with forms the native decoder doesn't claim.
+static a64::Op capstoneClass(const cs_insn* insn) {
+    std::string m = insn->mnemonic;
+    if (m == "b") return a64::Op::B;
+    if (m == "bl") return a64::Op::Bl;
+    if (m.size() > 2 && m.compare(0, 2, "b.") == 0) return a64::Op::BCond;
+    if (m == "cbz") return a64::Op::Cbz;
+    if (m == "cbnz") return a64::Op::Cbnz;
+    if (m == "tbz") return a64::Op::Tbz;
+    if (m == "tbnz") return a64::Op::Tbnz;
+    if (m.compare(0, 3, "blr") == 0) return a64::Op::Blr;
+    if (m.compare(0, 2, "br") == 0) return a64::Op::Br;
+    if (m.compare(0, 3, "ret") == 0) return a64::Op::Ret;
+    if (m == "adr") return a64::Op::Adr;
+    if (m == "adrp") return a64::Op::Adrp;
+    return a64::Op::Unknown;
+}
+
+// Whether Capstone's rendering is consistent with a native ADD/LDR/STR claim
+static bool capstoneAgreesOnData(a64::Op op, const cs_insn* insn) {
+    std::string m = insn->mnemonic;
+    std::string ops = insn->op_str;
+    switch (op) {
+        case a64::Op::AddImm:
+            return m == "add" || m == "mov";
+        case a64::Op::LdrImm:
+            return (m == "ldr" || m == "ldrb" || m == "ldrh") && ops.find("]!") == std::string::npos;
+        case a64::Op::StrImm:
+            return (m == "str" || m == "strb" || m == "strh") && ops.find("]!") == std::string::npos;
+        default:
+            return true;
+    }
+}
+
+// Last immediate operand (Capstone puts branch and ADR targets there)
+static bool capstoneImm(const cs_insn* insn, uint64_t& imm) {
+    if (!insn->detail) {
+        return false;
+    }
+    const cs_arm64& arm64 = insn->detail->arm64;
+    bool found = false;
+    for (int i = 0; i < arm64.op_count; i++) {
+        if (arm64.operands[i].type == ARM64_OP_IMM) {
+            imm = static_cast<uint64_t>(arm64.operands[i].imm);
+            found = true;
+        }
+    }
+    return found;
+}
+
+// Differential check of the native decoder against Capstone over every word
+// of the main text, then the per-word cost of each
+static int benchDecode(const std::string& path, int iterations) {
+    NsoFile nso;
+    NsoLoadOptions options;
+    options.lazy = false;
+    if (!nso.load(path, options)) {
+        std::cerr << "Failed to load: " << nso.getError() << std::endl;
+        return 1;
+    }
+    
+    csh handle;
+    if (cs_open(CS_ARCH_ARM64, CS_MODE_LITTLE_ENDIAN, &handle) != CS_ERR_OK) {
+        std::cerr << "Failed to open Capstone" << std::endl;
+        return 1;
+    }
+    cs_option(handle, CS_OPT_DETAIL, CS_OPT_ON);
+    cs_insn* insn = cs_malloc(handle);
+    
+    const Segment& text = nso.getTextSegment();
+    const uint8_t* code = text.data.data();
+    size_t words = text.data.size() / 4;
+    uint64_t base = nso.getBaseAddress() + text.mem_offset;
+    
+    size_t class_counts[static_cast<size_t>(a64::Op::Count)] = {};
+    size_t class_mismatches = 0;
+    size_t target_mismatches = 0;
+    size_t shown = 0;
+    
+    for (size_t i = 0; i < words; i++) {
+        uint32_t word;
+        std::memcpy(&word, code + i * 4, sizeof(word));
+        uint64_t address = base + i * 4;
+        a64::Decoded native = a64::decode(word, address);
+        class_counts[static_cast<size_t>(native.op)]++;
+        
+        const uint8_t* ptr = code + i * 4;
+        size_t size = 4;
+        uint64_t addr = address;
+        bool valid = cs_disasm_iter(handle, &ptr, &size, &addr, insn);
+        
+        const char* problem = nullptr;
+        if (!valid) {
+            if (native.op != a64::Op::Unknown) {
+                problem = "capstone rejects";
+            }
+        } else {
+            a64::Op expected = capstoneClass(insn);
+            bool native_is_data = native.op == a64::Op::AddImm || native.op == a64::Op::LdrImm ||
+                                  native.op == a64::Op::StrImm;
+            if (native_is_data ? !capstoneAgreesOnData(native.op, insn) || expected != a64::Op::Unknown
+                               : expected != native.op) {
+                problem = "class";
+                class_mismatches++;
+            } else if (native.hasTarget() || native.hasAddress()) {
+                uint64_t imm = 0;
+                if (capstoneImm(insn, imm) && imm != native.target) {
+                    problem = "target";
+                    target_mismatches++;
+                }
+            }
+        }
+        if (!valid && problem) {
+            class_mismatches++;
+        }
+        
+        if (problem && shown < 20) {
+            char word_hex[16];
+            snprintf(word_hex, sizeof(word_hex), "%08X", word);
+            std::cout << "  mismatch (" << problem << ") at 0x" << std::hex << address << std::dec
+                      << ": " << word_hex << " native=" << a64::opName(native.op);
+            if (valid) {
+                std::cout << " capstone=\"" << insn->mnemonic << " " << insn->op_str << "\"";
+            }
+            std::cout << std::endl;
+            shown++;
+        }
+    }
+    
+    std::cout << "Differential check over " << words << " words:" << std::endl;
+    for (size_t op = 1; op < static_cast<size_t>(a64::Op::Count); op++) {
+        std::cout << "  " << std::left << std::setw(8) << a64::opName(static_cast<a64::Op>(op)) << std::right
+                  << std::setw(10) << class_counts[op] << std::endl;
+    }
+    std::cout << "  class mismatches:  " << class_mismatches << std::endl;
+    std::cout << "  target mismatches: " << target_mismatches << std::endl;
+    
+    // Per-word cost: native decode and IR lift vs Capstone with detail
+    std::cout << std::fixed << std::setprecision(2);
+    double best_native = 1e30, best_lift = 1e30, best_capstone = 1e30;
+    size_t stmt_count = 0;
+    uint64_t sink = 0;
+    for (int it = 0; it < iterations; it++) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < words; i++) {
+            uint32_t word;
+            std::memcpy(&word, code + i * 4, sizeof(word));
+            a64::Decoded d = a64::decode(word, base + i * 4);
+            sink += d.target + static_cast<uint64_t>(d.op);
+        }
+        best_native = std::min(best_native, msSince(start));
+        
+        start = std::chrono::steady_clock::now();
+        ir::Stmt stmts[ir::MAX_STMTS];
+        stmt_count = 0;
+        for (size_t i = 0; i < words; i++) {
+            uint32_t word;
+            std::memcpy(&word, code + i * 4, sizeof(word));
+            size_t n = ir::lift(word, base + i * 4, stmts);
+            stmt_count += n;
+            sink += static_cast<uint64_t>(stmts[n - 1].op);
+        }
+        best_lift = std::min(best_lift, msSince(start));
+        
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < words; i++) {
+            const uint8_t* ptr = code + i * 4;
+            size_t size = 4;
+            uint64_t addr = base + i * 4;
+            if (cs_disasm_iter(handle, &ptr, &size, &addr, insn)) {
+                sink += insn->id;
+            }
+        }
+        best_capstone = std::min(best_capstone, msSince(start));
+    }
+    
+    std::cout << "Decode cost (" << iterations << " runs, best):" << std::endl;
+    std::cout << "  native    " << std::setw(10) << best_native << " ms  "
+              << best_native * 1e6 / std::max<size_t>(words, 1) << " ns/word" << std::endl;
+    std::cout << "  ir lift   " << std::setw(10) << best_lift << " ms  "
+              << best_lift * 1e6 / std::max<size_t>(words, 1) << " ns/word  ("
+              << static_cast<double>(stmt_count) / std::max<size_t>(words, 1) << " stmts/word)" << std::endl;
+    std::cout << "  capstone  " << std::setw(10) << best_capstone << " ms  "
+              << best_capstone * 1e6 / std::max<size_t>(words, 1) << " ns/word" << std::endl;
+    std::cout << "  (checksum " << (sink & 0xFFFF) << ")" << std::endl;
+    
+    cs_free(insn, 1);
+    cs_close(&handle);
+    return class_mismatches + target_mismatches == 0 ? 0 : 2;
+}
+
+// Full Analyzer::analyze run: wall time, peak RSS, what the kept
+// Function::instructions vectors cost and what lifting them takes
+static int benchAnalyze(const std::string& path) {
+    Analyzer analyzer;
+    if (!analyzer.loadNso(path)) {
+        return 1;
+    }
+    uint64_t rss_loaded = getPeakRss();
+    
+    auto start = std::chrono::steady_clock::now();
+    analyzer.analyze();
+    double ms = msSince(start);
+    uint64_t rss_analyzed = getPeakRss();
+    
+    size_t functions = 0;
+    size_t instructions = 0;
+    size_t capacity = 0;
+    size_t stmts = 0;
+    size_t ir_capacity = 0;
+    for (const auto& [addr, func] : analyzer.getFunctionFinder().getFunctions()) {
+        functions++;
+        instructions += func.instructions.size();
+        capacity += func.instructions.capacity();
+    }
+    
+    // The xref and pseudocode passes lift each function as they read it
+    std::vector<ir::Stmt> lifted;
+    auto lift_start = std::chrono::steady_clock::now();
+    for (const auto& [addr, func] : analyzer.getFunctionFinder().getFunctions()) {
+        lifted.clear();
+        ir::liftInstructions(func.instructions, addr, lifted);
+        stmts += lifted.size();
+        ir_capacity = std::max(ir_capacity, lifted.capacity());
+    }
+    double lift_ms = msSince(lift_start);
+    
+    const double mb = 1024.0 * 1024.0;
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "Analysis:" << std::endl;
+    std::cout << "  time              " << std::setw(12) << ms << " ms" << std::endl;
+    std::cout << "  functions         " << std::setw(12) << functions << std::endl;
+    std::cout << "  instructions      " << std::setw(12) << instructions
+              << "  (" << sizeof(Instruction) << " bytes each)" << std::endl;
+    std::cout << "  instruction store " << std::setw(12) << capacity * sizeof(Instruction) / mb << " MB" << std::endl;
+    std::cout << "  ir statements     " << std::setw(12) << stmts
+              << "  (" << sizeof(ir::Stmt) << " bytes each)" << std::endl;
+    std::cout << "  ir lift, all      " << std::setw(12) << lift_ms << " ms" << std::endl;
+    std::cout << "  ir largest buffer " << std::setw(12) << ir_capacity * sizeof(ir::Stmt) / mb << " MB" << std::endl;
+    if (rss_analyzed != 0) {
+        std::cout << "  peak RSS loaded   " << std::setw(12) << rss_loaded / mb << " MB" << std::endl;
+        std::cout << "  peak RSS analyzed " << std::setw(12) << rss_analyzed / mb << " MB" << std::endl;
+    }
+    return 0;
+}
+
+// CodeMap build time and word kinds, then a patch check on a copy of
+// text: NOP out BLs that are the only way to their target, update, and
+// require the target to lose its reach; put them back and require the map
+// to match the original
+static int benchClassify(const std::string& path, int iterations) {
+    NsoFile nso;
+    NsoLoadOptions options;
+    options.lazy = false;
+    if (!nso.load(path, options)) {
+        std::cerr << "Failed to load: " << nso.getError() << std::endl;
+        return 1;
+    }
+    
+    Disassembler disasm;
+    if (!disasm.initialize()) {
+        std::cerr << "Failed to initialize disassembler: " << disasm.getError() << std::endl;
+        return 1;
+    }
+    
+    const Segment& text = nso.getTextSegment();
+    std::vector<uint8_t> code(text.data.begin(), text.data.end());
+    size_t words = code.size() / 4;
+    uint64_t base = nso.getBaseAddress() + text.mem_offset;
+    
+    auto wordAt = [&](size_t i) {
+        uint32_t word;
+        std::memcpy(&word, code.data() + i * 4, sizeof(word));
+        return word;
+    };
+    auto setWord = [&](size_t i, uint32_t word) { std::memcpy(code.data() + i * 4, &word, sizeof(word)); };
+    
+    std::vector<uint64_t> invalid((words + 63) / 64, 0);
+    {
+        auto worker = disasm.acquire();
+        Instruction inst;
+        for (size_t i = 0; i < words; i++) {
+            if (!worker->disassembleOne(code.data() + i * 4, 4, base + i * 4, inst)) {
+                invalid[i / 64] |= 1ULL << (i % 64);
+            }
+        }
+    }
+    auto isInvalid = [&](size_t i) { return (invalid[i / 64] >> (i % 64)) & 1; };
+    
+    std::cout << std::fixed << std::setprecision(2);
+    CodeMap map;
+    double best = 1e30;
+    for (int it = 0; it < iterations; it++) {
+        auto start = std::chrono::steady_clock::now();
+        map.build(code.data(), words, base, invalid.data());
+        best = std::min(best, msSince(start));
+    }
+    std::cout << "Classify (" << words << " words, " << iterations << " runs, best):" << std::endl;
+    std::cout << "  build     " << std::setw(10) << best << " ms" << std::endl;
+    std::cout << "  code      " << std::setw(10) << map.count(WordKind::Code) << std::endl;
+    std::cout << "  data      " << std::setw(10) << map.count(WordKind::Data) << std::endl;
+    std::cout << "  padding   " << std::setw(10) << map.count(WordKind::Padding) << std::endl;
+    
+    // Direct branches into each word, from decodable words
+    std::vector<uint8_t> refs(words, 0);
+    auto targetOf = [&](size_t i, size_t& target) {
+        a64::Decoded d = a64::decode(wordAt(i), base + i * 4);
+        if (!d.hasTarget() || d.target < base || d.target >= base + words * 4) {
+            return false;
+        }
+        target = (d.target - base) / 4;
+        return true;
+    };
+    for (size_t i = 0; i < words; i++) {
+        size_t target;
+        if (!isInvalid(i) && targetOf(i, target) && refs[target] < 255) {
+            refs[target]++;
+        }
+    }
+    
+    // Targets reached only through one BL, not fallen into from before
+    constexpr size_t MAX_PATCHES = 1000;
+    constexpr uint32_t NOP_WORD = 0xD503201F;
+    CodeMap patched = map;
+    uint64_t clear_bit = 0;
+    size_t tried = 0, still_reached = 0, not_restored = 0;
+    double update_ms = 0.0;
+    for (size_t i = 0; i < words && tried < MAX_PATCHES; i++) {
+        uint32_t word = wordAt(i);
+        size_t target;
+        if (isInvalid(i) || a64::classify(word) != a64::Op::Bl || !targetOf(i, target) ||
+            refs[target] != 1 || target == 0 || target == i || !map.isReached(target)) {
+            continue;
+        }
+        a64::Op before = a64::classify(wordAt(target - 1));
+        if (!isInvalid(target - 1) && wordAt(target - 1) != 0 &&
+            before != a64::Op::B && before != a64::Op::Br && before != a64::Op::Ret) {
+            continue;
+        }
+        
+        tried++;
+        auto start = std::chrono::steady_clock::now();
+        setWord(i, NOP_WORD);
+        patched.update(code.data(), base, i, i + 1, &clear_bit);
+        if (patched.isReached(target)) {
+            still_reached++;
+        }
+        setWord(i, word);
+        patched.update(code.data(), base, i, i + 1, &clear_bit);
+        if (!patched.isReached(target)) {
+            not_restored++;
+        }
+        update_ms += msSince(start);
+    }
+    
+    size_t differences = 0;
+    for (size_t i = 0; i < words; i++) {
+        if (patched.kindOf(i) != map.kindOf(i) || patched.isReached(i) != map.isReached(i)) {
+            differences++;
+        }
+    }
+    std::cout << "Patch check (" << tried << " BLs out and back):" << std::endl;
+    std::cout << "  update    " << std::setw(10) << (tried ? update_ms * 1e3 / (2 * tried) : 0.0) << " us" << std::endl;
+    std::cout << "  target still reached " << still_reached << std::endl;
+    std::cout << "  target not restored  " << not_restored << std::endl;
+    std::cout << "  words differing      " << differences << std::endl;
+    return still_reached + not_restored + differences == 0 ? 0 : 2;
+}
+
+// Containing-function lookups at every address-forming statement (the
+// per-ADRP query the xref pass used to make): the index against the linear
+// scan it replaced, plus the xref phase itself
+static int benchLookup(const std::string& path, int iterations) {
+    Analyzer analyzer;
+    if (!analyzer.loadNso(path)) {
+        return 1;
+    }
+    analyzer.analyze();
+    
+    FunctionFinder& finder = analyzer.getFunctionFinder();
+    const auto& functions = finder.getFunctions();
+    std::vector<uint64_t> queries;
+    std::vector<ir::Stmt> stmts;
+    for (const auto& [addr, func] : functions) {
+        stmts.clear();
+        ir::liftInstructions(func.instructions, addr, stmts);
+        for (const ir::Stmt& stmt : stmts) {
+            if (stmt.attrs & ir::IsAddress) {
+                queries.push_back(addr + stmt.offset);
+            }
+        }
+    }
+    if (queries.empty()) {
+        std::cout << "No address loads to look up" << std::endl;
+        return 1;
+    }
+    
+    // The linear scan is quadratic overall; time a prefix and scale
+    size_t linear_count = std::min<size_t>(queries.size(), 20000);
+    
+    std::cout << std::fixed << std::setprecision(2);
+    double best_index = 1e30, best_linear = 1e30, best_xref = 1e30;
+    uint64_t sink = 0;
+    size_t mismatches = 0;
+    for (int it = 0; it < iterations; it++) {
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t address : queries) {
+            Function* func = finder.getFunctionContaining(address);
+            sink += func ? func->address : 0;
+        }
+        best_index = std::min(best_index, msSince(start));
+        
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < linear_count; i++) {
+            const Function* found = nullptr;
+            for (const auto& [addr, func] : functions) {
+                if (queries[i] >= func.address && queries[i] < func.end_address) {
+                    found = &func;
+                    break;
+                }
+            }
+            sink += found ? found->address : 0;
+            if (it == 0 && found != finder.getFunctionContaining(queries[i])) {
+                mismatches++;
+            }
+        }
+        best_linear = std::min(best_linear, msSince(start));
+        
+        start = std::chrono::steady_clock::now();
+        analyzer.getXRefAnalyzer().analyze();
+        best_xref = std::min(best_xref, msSince(start));
+    }
+    double linear_ns = best_linear * 1e6 / linear_count;
+    
+    std::cout << "Containing-function lookup (" << functions.size() << " functions, " << queries.size()
+              << " queries, " << iterations << " runs, best):" << std::endl;
+    std::cout << "  index     " << std::setw(10) << best_index << " ms  "
+              << best_index * 1e6 / queries.size() << " ns/query" << std::endl;
+    std::cout << "  linear    " << std::setw(10) << linear_ns * queries.size() / 1e6 << " ms  "
+              << linear_ns << " ns/query  (scaled from " << linear_count << ")" << std::endl;
+    std::cout << "  mismatches " << mismatches << std::endl;
+    std::cout << "Xref phase:" << std::endl;
+    std::cout << "  analyze   " << std::setw(10) << best_xref << " ms  ("
+              << analyzer.getXRefAnalyzer().getAllXRefs().size() << " xrefs)" << std::endl;
+    std::cout << "  (checksum " << (sink & 0xFFFF) << ")" << std::endl;
+    return mismatches == 0 ? 0 : 2;
+}
+
+int runBench(const std::vector<std::string>& args) {
+    if (args.size() < 2) {
+        std::cout << "Usage: kiloader bench <load|scan|disasm|decode|format|analyze|lookup|classify> <file.nso> [iterations]" << std::endl;
+        return 1;
+    }
+    
+    const std::string& name = args[0];
+    const std::string& path = args[1];
+    int iterations = args.size() > 2 ? std::max(1, std::stoi(args[2])) : 5;
+    
+    if (name == "load") {
+        return benchLoad(path, iterations);
+    }
+    if (name == "scan") {
+        return benchScan(path, iterations);
+    }
+    if (name == "disasm") {
+        return benchDisasm(path, iterations);
+    }
+    if (name == "decode") {
+        return benchDecode(path, iterations);
+    }
+    if (name == "format") {
+        return benchFormat(path, iterations);
+    }
+    if (name == "analyze") {
+        return benchAnalyze(path);
+    }
+    if (name == "lookup") {
+        return benchLookup(path, iterations);
+    }
+    if (name == "classify") {
+        return benchClassify(path, iterations);
+    }
+    
+    std::cerr << "Unknown benchmark: " << name << std::endl;
+    return 1;
+}
+
+} // namespace kiloader
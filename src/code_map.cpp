@@ -0,0 +1,402 @@
+#include "code_map.h"
+#include "a64_decoder.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+namespace kiloader {
+
+constexpr int NUM_THREADS = 32;
+
+// Words on each side of a word whose bigrams it is judged by
+constexpr size_t WINDOW_HALF = 4;
+
+// A window averaging this many bits below the mean bigram log-probability
+// of reached code (16x less likely than typical code) is data
+constexpr double DATA_MARGIN_BITS = 4.0;
+
+constexpr uint32_t NOP_WORD = 0xD503201F;
+
+// Word classes for the bigram model: the top byte, which holds the
+// encoding group and most of the opcode
+constexpr size_t CLASSES = 256;
+
+static uint32_t wordAt(const uint8_t* code, size_t index) {
+    uint32_t word;
+    std::memcpy(&word, code + index * 4, sizeof(word));
+    return word;
+}
+
+static bool testBit(const uint64_t* bits, size_t index) {
+    return (bits[index / 64] >> (index % 64)) & 1;
+}
+
+static size_t popCount(uint64_t x) {
+#if defined(__GNUC__)
+    return static_cast<size_t>(__builtin_popcountll(x));
+#else
+    size_t n = 0;
+    for (; x != 0; x &= x - 1) {
+        n++;
+    }
+    return n;
+#endif
+}
+
+// Run fn(t, first, last) over 64-word blocks [0, blocks) on up to
+// NUM_THREADS threads; threads own disjoint bitmap words
+template <typename Fn>
+static void forEachChunk(size_t blocks, Fn&& fn) {
+    int thread_count = static_cast<int>(std::min<size_t>(NUM_THREADS, blocks));
+    size_t chunk_size = blocks / thread_count + 1;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < thread_count; t++) {
+        threads.emplace_back([&, t]() {
+            size_t start = t * chunk_size;
+            size_t end = std::min(start + chunk_size, blocks);
+            if (start < end) {
+                fn(t, start, end);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+static bool endsRun(uint32_t word) {
+    a64::Op op = a64::classify(word);
+    return word == 0 || op == a64::Op::B || op == a64::Op::Br || op == a64::Op::Ret;
+}
+
+void CodeMap::build(const uint8_t* code, size_t words, uint64_t base, const uint64_t* invalid) {
+    words_ = words;
+    size_t blocks = (words + 63) / 64;
+    data_.assign(blocks, 0);
+    padding_.assign(blocks, 0);
+    reached_.assign(blocks, 0);
+    invalid_.assign(invalid, invalid + blocks);
+    log_prob_.assign(CLASSES * CLASSES, 0.0f);
+    threshold_ = -INFINITY;
+    seeds_.clear();
+    if (words < 2) {
+        return;
+    }
+    
+    int thread_count = static_cast<int>(std::min<size_t>(NUM_THREADS, blocks));
+    
+    // Pass 1: direct branches of all decodable words
+    std::vector<std::vector<Seed>> thread_seeds(thread_count);
+    forEachChunk(blocks, [&](int t, size_t first, size_t last) {
+        size_t end = std::min(last * 64, words);
+        for (size_t i = first * 64; i < end; i++) {
+            if (testBit(invalid, i)) {
+                continue;
+            }
+            a64::Decoded d = a64::decode(wordAt(code, i), base + i * 4);
+            if (d.hasTarget() && d.target >= base && d.target < base + words * 4) {
+                thread_seeds[t].push_back({static_cast<uint32_t>(i), static_cast<uint32_t>((d.target - base) / 4)});
+            }
+        }
+    });
+    
+    std::vector<Seed> seeds;
+    for (const auto& ts : thread_seeds) {
+        seeds.insert(seeds.end(), ts.begin(), ts.end());
+    }
+    
+    // Pass 2: branch targets are code, and so is everything reached from
+    // them
+    std::vector<size_t> pending;
+    for (const Seed& seed : seeds) {
+        pending.push_back(seed.target);
+    }
+    flood(code, base, pending);
+    
+    // Pass 3: bigram counts over pairs of reached words
+    std::vector<std::vector<uint32_t>> thread_counts(thread_count);
+    forEachChunk(blocks, [&](int t, size_t first, size_t last) {
+        std::vector<uint32_t>& counts = thread_counts[t];
+        counts.assign(CLASSES * CLASSES, 0);
+        size_t end = std::min(last * 64, words - 1);
+        for (size_t i = first * 64; i < end; i++) {
+            if (testBit(reached_.data(), i) && testBit(reached_.data(), i + 1)) {
+                counts[(wordAt(code, i) >> 24) * CLASSES + (wordAt(code, i + 1) >> 24)]++;
+            }
+        }
+    });
+    
+    std::vector<uint64_t> counts(CLASSES * CLASSES, 0);
+    uint64_t pairs = 0;
+    for (const auto& tc : thread_counts) {
+        for (size_t k = 0; k < tc.size(); k++) {
+            counts[k] += tc[k];
+            pairs += tc[k];
+        }
+    }
+    
+    // Log2 P(a, b) in reached code, add-one smoothed, and its mean over
+    // the reached pairs. Pairs code never has score about -log2(pairs).
+    double log_sum = 0.0;
+    double denominator = static_cast<double>(pairs + CLASSES * CLASSES);
+    for (size_t k = 0; k < CLASSES * CLASSES; k++) {
+        double lp = std::log2(static_cast<double>(counts[k] + 1) / denominator);
+        log_prob_[k] = static_cast<float>(lp);
+        log_sum += lp * counts[k];
+    }
+    if (pairs > 0) {
+        threshold_ = log_sum / pairs - DATA_MARGIN_BITS;
+    }
+    
+    // Pass 4: decodable words whose window is improbable for code
+    std::vector<uint64_t> improbable(blocks, 0);
+    forEachChunk(blocks, [&](int, size_t first, size_t last) {
+        size_t end = std::min(last * 64, words);
+        for (size_t i = first * 64; i < end; i++) {
+            if (isImprobable(code, i)) {
+                improbable[i / 64] |= 1ULL << (i % 64);
+            }
+        }
+    });
+    
+    // Pass 5: a branch encoding in a literal pool is not a branch. Drop
+    // seeds from improbable words the first flood didn't reach and flood
+    // once more from the rest. One extra linear pass, not a fixpoint: a
+    // source reached only through a dropped seed keeps its own.
+    size_t kept = 0;
+    for (const Seed& seed : seeds) {
+        if (!testBit(improbable.data(), seed.source) || testBit(reached_.data(), seed.source)) {
+            seeds[kept++] = seed;
+        }
+    }
+    if (kept != seeds.size()) {
+        seeds.resize(kept);
+        reached_.assign(blocks, 0);
+        pending.clear();
+        for (const Seed& seed : seeds) {
+            pending.push_back(seed.target);
+        }
+        flood(code, base, pending);
+    }
+    
+    // Kept for update(): which live branches land on a word
+    std::sort(seeds.begin(), seeds.end());
+    seeds_ = std::move(seeds);
+    
+    // Pass 6: undecodable words are data, and so are improbable words
+    // nothing reaches (reached ones are code whatever the statistics say)
+    forEachChunk(blocks, [&](int, size_t first, size_t last) {
+        for (size_t b = first; b < last; b++) {
+            data_[b] = (invalid_[b] | improbable[b]) & ~reached_[b];
+        }
+    });
+    
+    // Pass 7: padding
+    markPadding(code, 0, words);
+}
+
+void CodeMap::update(const uint8_t* code, uint64_t base, size_t first, size_t last, const uint64_t* invalid) {
+    last = std::min(last, words_);
+    if (first >= last) {
+        return;
+    }
+    
+    for (size_t i = first; i < last; i++) {
+        uint64_t bit = 1ULL << (i % 64);
+        if ((invalid[(i - first) / 64] >> ((i - first) % 64)) & 1) {
+            invalid_[i / 64] |= bit;
+        } else {
+            invalid_[i / 64] &= ~bit;
+        }
+    }
+    
+    // Branches in the range: the old ones go, the current ones come in
+    std::vector<size_t> starts;
+    std::vector<Seed> added;
+    for (size_t i = first; i < last; i++) {
+        if (testBit(invalid_.data(), i)) {
+            continue;
+        }
+        a64::Decoded d = a64::decode(wordAt(code, i), base + i * 4);
+        if (d.hasTarget() && d.target >= base && d.target < base + words_ * 4) {
+            added.push_back({static_cast<uint32_t>(i), static_cast<uint32_t>((d.target - base) / 4)});
+        }
+    }
+    size_t kept = 0;
+    for (const Seed& seed : seeds_) {
+        if (seed.source >= first && seed.source < last) {
+            starts.push_back(seed.target);
+        } else {
+            seeds_[kept++] = seed;
+        }
+    }
+    seeds_.resize(kept);
+    std::sort(added.begin(), added.end());
+    seeds_.insert(seeds_.end(), added.begin(), added.end());
+    std::inplace_merge(seeds_.begin(), seeds_.begin() + kept, seeds_.end());
+    
+    // Take back everything the range and its old branches reached. Parts
+    // of it that are reached some other way get walked again below.
+    for (size_t i = first; i < last; i++) {
+        if (testBit(reached_.data(), i)) {
+            starts.push_back(i);
+        }
+    }
+    std::vector<size_t> redo;
+    unflood(code, base, first, last, starts, redo);
+    for (size_t i = first; i < last; i++) {
+        redo.push_back(i);
+    }
+    
+    // Walk again from the range's live branches (the rule build keeps
+    // seeds by), from live branches into the words taken back and from
+    // fall-through out of reached code before them
+    std::vector<size_t> pending;
+    for (const Seed& seed : added) {
+        if (!isImprobable(code, seed.source)) {
+            pending.push_back(seed.target);
+        }
+    }
+    for (size_t c : redo) {
+        auto range = std::equal_range(seeds_.begin(), seeds_.end(), Seed{0, static_cast<uint32_t>(c)});
+        for (auto it = range.first; it != range.second; ++it) {
+            if (testBit(reached_.data(), it->source) || !isImprobable(code, it->source)) {
+                pending.push_back(c);
+                break;
+            }
+        }
+        if (c > 0 && testBit(reached_.data(), c - 1) && !endsRun(wordAt(code, c - 1))) {
+            pending.push_back(c);
+        }
+    }
+    flood(code, base, pending);
+    
+    // Data verdicts of the words taken back and of those whose window holds
+    // a changed pair, with the model trained by build
+    auto redoData = [&](size_t i) {
+        uint64_t bit = 1ULL << (i % 64);
+        if (!testBit(reached_.data(), i) && (testBit(invalid_.data(), i) || isImprobable(code, i))) {
+            data_[i / 64] |= bit;
+        } else {
+            data_[i / 64] &= ~bit;
+        }
+    };
+    for (size_t i : redo) {
+        redoData(i);
+    }
+    size_t lo = first >= WINDOW_HALF ? first - WINDOW_HALF : 0;
+    size_t hi = std::min(last + WINDOW_HALF, words_);
+    for (size_t i = lo; i < hi; i++) {
+        redoData(i);
+    }
+    
+    // Padding outside the range stays, so function boundaries only move
+    // in it
+    markPadding(code, first, last);
+}
+
+void CodeMap::unflood(const uint8_t* code, uint64_t base, size_t first, size_t last,
+                      std::vector<size_t>& pending, std::vector<size_t>& cleared) {
+    // The walk flood made, over reached words. Inside [first, last) the
+    // bytes changed, so it runs on to the range end whatever they hold now.
+    while (!pending.empty()) {
+        size_t i = pending.back();
+        pending.pop_back();
+        for (; i < words_ && testBit(reached_.data(), i); i++) {
+            reached_[i / 64] &= ~(1ULL << (i % 64));
+            cleared.push_back(i);
+            
+            uint32_t word = wordAt(code, i);
+            a64::Decoded d = a64::decode(word, base + i * 4);
+            if (d.hasTarget() && d.target >= base && d.target < base + words_ * 4) {
+                pending.push_back((d.target - base) / 4);
+            }
+            if ((i < first || i + 1 >= last) && endsRun(word)) {
+                break;
+            }
+        }
+    }
+}
+
+bool CodeMap::isImprobable(const uint8_t* code, size_t index) const {
+    return wordAt(code, index) != 0 && !testBit(invalid_.data(), index) && windowScore(code, index) < threshold_;
+}
+
+void CodeMap::flood(const uint8_t* code, uint64_t base, std::vector<size_t>& pending) {
+    // Linear: each word is walked once
+    while (!pending.empty()) {
+        size_t i = pending.back();
+        pending.pop_back();
+        for (; i < words_ && !testBit(reached_.data(), i); i++) {
+            uint32_t word = wordAt(code, i);
+            if (word == 0 || testBit(invalid_.data(), i)) {
+                break;
+            }
+            reached_[i / 64] |= 1ULL << (i % 64);
+            data_[i / 64] &= ~(1ULL << (i % 64));
+            
+            a64::Decoded d = a64::decode(word, base + i * 4);
+            if (d.hasTarget() && d.target >= base && d.target < base + words_ * 4) {
+                pending.push_back((d.target - base) / 4);
+            }
+            if (d.op == a64::Op::B || d.op == a64::Op::Br || d.op == a64::Op::Ret) {
+                break;
+            }
+        }
+    }
+}
+
+double CodeMap::windowScore(const uint8_t* code, size_t index) const {
+    // Pairs j = (word j, word j + 1) around index
+    size_t a = index >= WINDOW_HALF ? index - WINDOW_HALF : 0;
+    size_t b = std::min(index + WINDOW_HALF, words_ - 1);
+    if (a >= b) {
+        return 0.0;
+    }
+    double sum = 0.0;
+    for (size_t j = a; j < b; j++) {
+        sum += log_prob_[(wordAt(code, j) >> 24) * CLASSES + (wordAt(code, j + 1) >> 24)];
+    }
+    return sum / static_cast<double>(b - a);
+}
+
+void CodeMap::markPadding(const uint8_t* code, size_t first, size_t last) {
+    // Whole NOP runs, so the run's start decides
+    while (first > 0 && wordAt(code, first - 1) == NOP_WORD) {
+        first--;
+    }
+    while (last < words_ && wordAt(code, last) == NOP_WORD) {
+        last++;
+    }
+    
+    bool after_end = first > 0 && endsRun(wordAt(code, first - 1));
+    for (size_t i = first; i < last; i++) {
+        uint32_t word = wordAt(code, i);
+        uint64_t bit = 1ULL << (i % 64);
+        padding_[i / 64] &= ~bit;
+        if (word == 0 || (word == NOP_WORD && after_end && !testBit(reached_.data(), i))) {
+            padding_[i / 64] |= bit;
+            data_[i / 64] &= ~bit;
+            after_end = true;
+        } else {
+            after_end = endsRun(word);
+        }
+    }
+}
+
+size_t CodeMap::count(WordKind kind) const {
+    size_t data = 0;
+    size_t padding = 0;
+    for (size_t w = 0; w < data_.size(); w++) {
+        data += popCount(data_[w]);
+        padding += popCount(padding_[w]);
+    }
+    switch (kind) {
+        case WordKind::Data: return data;
+        case WordKind::Padding: return padding;
+        default: return words_ - data - padding;
+    }
+}
+
+} // namespace kiloader
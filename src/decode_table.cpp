@@ -0,0 +1,289 @@
+#include "decode_table.h"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+namespace kiloader {
+
+constexpr int NUM_THREADS = 32;
+
+DecodeTable::DecodeTable(AddressSpace& space, Disassembler& disasm)
+    : space_(space), disasm_(disasm) {
+    // Header ranges only; segments are touched when a page is first decoded
+    for (size_t m = 0; m < space_.getModuleCount(); m++) {
+        const Module& module = space_.getModule(m);
+        const NsoHeader& header = module.nso->getHeader();
+        
+        ModuleTable mod;
+        mod.nso = module.nso.get();
+        mod.base = module.base + header.text.mem_offset;
+        mod.words = header.text.size / 4;
+        mod.page_count = (mod.words + PAGE_WORDS - 1) / PAGE_WORDS;
+        mod.entries.reset(new DecodeEntry[mod.words]);  // Filled page by page
+        mod.pages.reset(new std::atomic<uint8_t>[mod.page_count]);
+        for (size_t p = 0; p < mod.page_count; p++) {
+            mod.pages[p].store(Pending, std::memory_order_relaxed);
+        }
+        modules_.push_back(std::move(mod));
+    }
+}
+
+void DecodeTable::decodeAll() {
+    // Flat list of pending pages across modules
+    std::vector<std::pair<ModuleTable*, size_t>> todo;
+    for (auto& mod : modules_) {
+        for (size_t p = 0; p < mod.page_count; p++) {
+            if (mod.pages[p].load(std::memory_order_acquire) != Ready) {
+                todo.emplace_back(&mod, p);
+            }
+        }
+    }
+    if (todo.empty()) {
+        return;
+    }
+    
+    // Pages are claimed one at a time, so dense and sparse regions balance
+    std::atomic<size_t> next{0};
+    std::vector<std::thread> threads;
+    int thread_count = static_cast<int>(std::min<size_t>(NUM_THREADS, todo.size()));
+    
+    for (int t = 0; t < thread_count; t++) {
+        threads.emplace_back([&]() {
+            auto worker = disasm_.acquire();
+            for (size_t i = next++; i < todo.size(); i = next++) {
+                ModuleTable& mod = *todo[i].first;
+                size_t page = todo[i].second;
+                uint8_t expected = Pending;
+                if (mod.pages[page].compare_exchange_strong(expected, Filling, std::memory_order_acquire)) {
+                    fillPage(mod, page, worker.get());
+                }
+            }
+        });
+    }
+    
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+const DecodeTable::ModuleTable* DecodeTable::find(uint64_t address) const {
+    auto it = std::upper_bound(modules_.begin(), modules_.end(), address,
+                               [](uint64_t addr, const ModuleTable& mod) { return addr < mod.base; });
+    if (it == modules_.begin()) {
+        return nullptr;
+    }
+    --it;
+    if (address - it->base >= it->words * 4) {
+        return nullptr;
+    }
+    return &*it;
+}
+
+DecodeTable::ModuleTable* DecodeTable::find(uint64_t address) {
+    return const_cast<ModuleTable*>(static_cast<const DecodeTable*>(this)->find(address));
+}
+
+bool DecodeTable::contains(uint64_t address) const {
+    return find(address) != nullptr;
+}
+
+void DecodeTable::ensurePage(ModuleTable& mod, size_t page) {
+    std::atomic<uint8_t>& state = mod.pages[page];
+    if (state.load(std::memory_order_acquire) == Ready) {
+        return;
+    }
+    
+    uint8_t expected = Pending;
+    if (state.compare_exchange_strong(expected, Filling, std::memory_order_acquire)) {
+        auto worker = disasm_.acquire();
+        fillPage(mod, page, worker.get());
+        return;
+    }
+    
+    // Another thread is decoding it; a page takes microseconds
+    while (state.load(std::memory_order_acquire) != Ready) {
+        std::this_thread::yield();
+    }
+}
+
+void DecodeTable::fillPage(ModuleTable& mod, size_t page, DisasmWorker* worker) {
+    size_t start = page * PAGE_WORDS;
+    size_t end = std::min(start + PAGE_WORDS, mod.words);
+    
+    // A text segment that failed to decode is shorter than its header says
+    const Segment& text = mod.nso->getTextSegment();
+    size_t available = text.data.size() / 4;
+    
+    Instruction inst;
+    for (size_t i = start; i < end; i++) {
+        DecodeEntry& e = mod.entries[i];
+        if (worker && i < available &&
+            worker->disassembleOne(text.data.data() + i * 4, 4, mod.base + i * 4, inst)) {
+            e.flags = inst.flags;
+            e.mnemonic_id = inst.mnemonic_id;
+        } else {
+            e.flags = DecodeEntry::Invalid;
+            e.mnemonic_id = 0;
+        }
+    }
+    
+    mod.pages[page].store(Ready, std::memory_order_release);
+}
+
+const DecodeEntry& DecodeTable::entry(ModuleTable& mod, size_t index) {
+    ensurePage(mod, index / PAGE_WORDS);
+    return mod.entries[index];
+}
+
+void DecodeTable::makeInstruction(const ModuleTable& mod, size_t index, const DecodeEntry& e, Instruction& out) {
+    out.address = mod.base + index * 4;
+    std::memcpy(&out.word, mod.nso->getTextSegment().data.data() + index * 4, sizeof(out.word));
+    out.flags = e.flags;
+    out.mnemonic_id = e.mnemonic_id;
+}
+
+bool DecodeTable::get(uint64_t address, Instruction& out) {
+    ModuleTable* mod = find(address);
+    if (!mod || (address & 3) != 0) {
+        return false;
+    }
+    
+    size_t index = (address - mod->base) / 4;
+    const DecodeEntry& e = entry(*mod, index);
+    if (e.flags & DecodeEntry::Invalid) {
+        return false;
+    }
+    makeInstruction(*mod, index, e, out);
+    return true;
+}
+
+size_t DecodeTable::decode(uint64_t address, size_t count, std::vector<Instruction>& out) {
+    return visit(address, UINT64_MAX, count, [&](const Instruction& insn) {
+        out.push_back(insn);
+        return true;
+    });
+}
+
+size_t DecodeTable::decodeFunction(uint64_t address, size_t max_count, std::vector<Instruction>& out) {
+    classifyWords();
+    const ModuleTable* mod = find(address);
+    if (!mod) {
+        return 0;
+    }
+    
+    // Padding ends a function; data is only a statistical verdict, and
+    // functions reached through pointers would be cut short by a wrong one
+    size_t added = 0;
+    visit(address, UINT64_MAX, max_count, [&](const Instruction& insn) {
+        if (mod->regions.isPadding((insn.address - mod->base) / 4)) {
+            return false;
+        }
+        out.push_back(insn);
+        added++;
+        return !insn.isReturn();
+    });
+    return added;
+}
+
+void DecodeTable::invalidate(const std::vector<uint64_t>& pages, uint64_t page_size) {
+    for (uint64_t page : pages) {
+        for (auto& mod : modules_) {
+            uint64_t start = std::max(page, mod.base);
+            uint64_t end = std::min(page + page_size, mod.base + mod.words * 4);
+            if (start >= end) {
+                continue;
+            }
+            size_t first = (start - mod.base) / 4 / PAGE_WORDS;
+            size_t last = (end - 1 - mod.base) / 4 / PAGE_WORDS;
+            for (size_t p = first; p <= last; p++) {
+                mod.pages[p].store(Pending, std::memory_order_release);
+            }
+            
+            if (scanned_.load(std::memory_order_acquire)) {
+                mod.scan.update(mod.nso->getTextSegment().data.data(),
+                                (start - mod.base) / 4, (end - mod.base + 3) / 4);
+            }
+            if (classified_.load(std::memory_order_acquire)) {
+                reclassify(mod, (start - mod.base) / 4, (end - mod.base + 3) / 4);
+            }
+        }
+    }
+}
+
+void DecodeTable::reclassify(ModuleTable& mod, size_t first, size_t last) {
+    // The map needs the new validity of these words, so their pages are
+    // decoded now rather than on first access
+    const Segment& text = mod.nso->getTextSegment();
+    last = std::min<size_t>(last, text.data.size() / 4);
+    if (first >= last) {
+        return;
+    }
+    std::vector<uint64_t> invalid((last - first + 63) / 64, 0);
+    for (size_t i = first; i < last; i++) {
+        if (entry(mod, i).flags & DecodeEntry::Invalid) {
+            invalid[(i - first) / 64] |= 1ULL << ((i - first) % 64);
+        }
+    }
+    mod.regions.update(text.data.data(), mod.base, first, last, invalid.data());
+}
+
+void DecodeTable::scanClasses() {
+    if (scanned_.load(std::memory_order_acquire)) {
+        return;
+    }
+    
+    std::lock_guard<std::mutex> lock(scan_mutex_);
+    if (scanned_.load(std::memory_order_relaxed)) {
+        return;
+    }
+    for (auto& mod : modules_) {
+        // A text segment that failed to decode is shorter than its header says
+        const Segment& text = mod.nso->getTextSegment();
+        mod.scan.build(text.data.data(), std::min<size_t>(text.data.size(), mod.words * 4));
+    }
+    scanned_.store(true, std::memory_order_release);
+}
+
+void DecodeTable::classifyWords() {
+    if (classified_.load(std::memory_order_acquire)) {
+        return;
+    }
+    
+    std::lock_guard<std::mutex> lock(classify_mutex_);
+    if (classified_.load(std::memory_order_relaxed)) {
+        return;
+    }
+    decodeAll();
+    for (auto& mod : modules_) {
+        // A text segment that failed to decode is shorter than its header says
+        const Segment& text = mod.nso->getTextSegment();
+        size_t words = std::min<size_t>(text.data.size() / 4, mod.words);
+        
+        // Decode-validity bitmap from the entries
+        std::vector<uint64_t> invalid((words + 63) / 64, 0);
+        for (size_t i = 0; i < words; i++) {
+            if (mod.entries[i].flags & DecodeEntry::Invalid) {
+                invalid[i / 64] |= 1ULL << (i % 64);
+            }
+        }
+        mod.regions.build(text.data.data(), words, mod.base, invalid.data());
+    }
+    classified_.store(true, std::memory_order_release);
+}
+
+bool DecodeTable::isData(uint64_t address) {
+    classifyWords();
+    const ModuleTable* mod = find(address);
+    return mod && !mod->regions.isCode((address - mod->base) / 4);
+}
+
+size_t DecodeTable::countWords(WordKind kind) {
+    classifyWords();
+    size_t total = 0;
+    for (const auto& mod : modules_) {
+        total += mod.regions.count(kind);
+    }
+    return total;
+}
+
+} // namespace kiloader
@@ -1,18 +1,71 @@
 #include "disassembler.h"
+#include "a64_decoder.h"
+#include "ir.h"
+#include "insn_formatter.h"
 #include <cstring>
-#include <sstream>
+#include <cstdio>
+#include <algorithm>
+#include <deque>
+#include <unordered_map>
 
 namespace kiloader {
 
-Disassembler::Disassembler() = default;
+static void parseInstruction(cs_insn* insn, Instruction& out);
+
+// Mnemonic intern table. IDs index a fixed array, so readers never see it
+// move; an ID only reaches a reader through an Instruction written after
+// the slot was filled. Each thread caches the IDs it has seen so the hot
+// path doesn't take the lock.
+namespace {
+
+constexpr size_t MAX_MNEMONICS = 4096;
+
+std::mutex g_mnemonic_mutex;
+std::deque<std::string> g_mnemonic_storage;
+std::unordered_map<std::string, uint16_t> g_mnemonic_ids;
+const char* g_mnemonics[MAX_MNEMONICS] = {""};
+
+uint16_t internMnemonic(const char* mnemonic) {
+    thread_local std::unordered_map<std::string, uint16_t> cache;
+    std::string key(mnemonic);
+    auto cached = cache.find(key);
+    if (cached != cache.end()) {
+        return cached->second;
+    }
+    
+    uint16_t id = 0;
+    {
+        std::lock_guard<std::mutex> lock(g_mnemonic_mutex);
+        auto it = g_mnemonic_ids.find(key);
+        if (it != g_mnemonic_ids.end()) {
+            id = it->second;
+        } else if (g_mnemonic_storage.size() + 1 < MAX_MNEMONICS) {
+            g_mnemonic_storage.push_back(key);
+            id = static_cast<uint16_t>(g_mnemonic_storage.size());
+            g_mnemonics[id] = g_mnemonic_storage.back().c_str();
+            g_mnemonic_ids.emplace(key, id);
+        }
+    }
+    
+    // Full table: leave it at 0 and render on demand
+    if (id != 0) {
+        cache.emplace(std::move(key), id);
+    }
+    return id;
+}
 
-Disassembler::~Disassembler() {
+} // namespace
+
+DisasmWorker::~DisasmWorker() {
+    if (insn_) {
+        cs_free(insn_, 1);
+    }
     if (initialized_) {
         cs_close(&handle_);
     }
 }
 
-bool Disassembler::initialize() {
+bool DisasmWorker::initialize() {
     if (initialized_) {
         return true;
     }
@@ -23,181 +76,318 @@ bool Disassembler::initialize() {
         return false;
     }
     
-    // Enable detailed mode for operand info
-    cs_option(handle_, CS_OPT_DETAIL, CS_OPT_ON);
+    // Capstone only renders text; control flow is decoded natively
+    // (a64_decoder.h), so detail mode stays off unless asked for
+    cs_option(handle_, CS_OPT_DETAIL, detail_ ? CS_OPT_ON : CS_OPT_OFF);
+    
+    // cs_malloc sizes the record (and its detail) for the current options
+    insn_ = cs_malloc(handle_);
+    if (!insn_) {
+        cs_close(&handle_);
+        error_ = "Failed to allocate instruction record";
+        return false;
+    }
     
     initialized_ = true;
     return true;
 }
 
-bool Disassembler::disassembleOne(const uint8_t* code, size_t size, uint64_t address, Instruction& out) {
+bool DisasmWorker::setDetail(bool enabled) {
+    if (!initialized_) {
+        detail_ = enabled;
+        return true;
+    }
+    if (enabled == detail_) {
+        return true;
+    }
+    
+    cs_option(handle_, CS_OPT_DETAIL, enabled ? CS_OPT_ON : CS_OPT_OFF);
+    cs_insn* insn = cs_malloc(handle_);
+    if (!insn) {
+        cs_option(handle_, CS_OPT_DETAIL, detail_ ? CS_OPT_ON : CS_OPT_OFF);
+        error_ = "Failed to allocate instruction record";
+        return false;
+    }
+    cs_free(insn_, 1);
+    insn_ = insn;
+    detail_ = enabled;
+    return true;
+}
+
+bool DisasmWorker::decodeNext(const uint8_t*& code, size_t& size, uint64_t& address) {
+    return cs_disasm_iter(handle_, &code, &size, &address, insn_);
+}
+
+bool DisasmWorker::disassembleOne(const uint8_t* code, size_t size, uint64_t address, Instruction& out) {
     if (!initialized_) {
         error_ = "Disassembler not initialized";
         return false;
     }
     
-    cs_insn* insn = nullptr;
-    size_t count = cs_disasm(handle_, code, size, address, 1, &insn);
-    
-    if (count == 0) {
+    if (!decodeNext(code, size, address)) {
         error_ = "Failed to disassemble instruction";
         return false;
     }
     
-    parseInstruction(insn, out);
-    cs_free(insn, count);
+    parseInstruction(insn_, out);
+    return true;
+}
+
+bool DisasmWorker::decodeStep(const uint8_t*& code, size_t& size, uint64_t& address, Instruction& out) {
+    if (!initialized_ || !decodeNext(code, size, address)) {
+        return false;
+    }
     
+    parseInstruction(insn_, out);
     return true;
 }
 
-std::vector<Instruction> Disassembler::disassemble(const uint8_t* code, size_t size, 
+std::vector<Instruction> DisasmWorker::disassemble(const uint8_t* code, size_t size, 
                                                     uint64_t address, size_t count) {
     std::vector<Instruction> result;
-    
+    disassemble(code, size, address, count, result);
+    return result;
+}
+
+size_t DisasmWorker::disassemble(const uint8_t* code, size_t size, uint64_t address, size_t count,
+                                 std::vector<Instruction>& out) {
     if (!initialized_) {
-        return result;
+        return 0;
     }
     
-    cs_insn* insn = nullptr;
-    size_t actual_count = cs_disasm(handle_, code, size, address, count, &insn);
-    
-    result.reserve(actual_count);
-    for (size_t i = 0; i < actual_count; i++) {
-        Instruction inst;
-        parseInstruction(&insn[i], inst);
-        result.push_back(std::move(inst));
+    // Like cs_disasm: stop at the first undecodable word
+    size_t limit = size / Instruction::size();
+    if (count != 0) {
+        limit = std::min(limit, count);
     }
+    out.reserve(out.size() + limit);
     
-    cs_free(insn, actual_count);
-    return result;
+    size_t added = 0;
+    while (added < limit && decodeNext(code, size, address)) {
+        out.emplace_back();
+        parseInstruction(insn_, out.back());
+        added++;
+    }
+    return added;
 }
 
-std::vector<Instruction> Disassembler::disassembleFunction(const uint8_t* code, size_t max_size, 
+std::vector<Instruction> DisasmWorker::disassembleFunction(const uint8_t* code, size_t max_size, 
                                                             uint64_t address) {
     std::vector<Instruction> result;
-    
+    disassembleFunction(code, max_size, address, result);
+    return result;
+}
+
+size_t DisasmWorker::disassembleFunction(const uint8_t* code, size_t max_size, uint64_t address,
+                                         std::vector<Instruction>& out) {
     if (!initialized_) {
-        return result;
+        return 0;
     }
     
-    size_t offset = 0;
-    while (offset < max_size) {
-        Instruction inst;
-        if (!disassembleOne(code + offset, max_size - offset, address + offset, inst)) {
-            break;
-        }
-        
-        result.push_back(inst);
-        offset += inst.bytes.size();
+    size_t added = 0;
+    while (decodeNext(code, max_size, address)) {
+        out.emplace_back();
+        Instruction& inst = out.back();
+        parseInstruction(insn_, inst);
+        added++;
         
         // Stop at return instruction
-        if (inst.is_return) {
+        if (inst.isReturn()) {
             break;
         }
         
         // Limit to prevent infinite loops
-        if (result.size() > 10000) {
+        if (added > 10000) {
             break;
         }
     }
     
-    return result;
+    return added;
 }
 
-bool Disassembler::isValidInstruction(const uint8_t* code, size_t size, uint64_t address) {
+bool DisasmWorker::isValidInstruction(const uint8_t* code, size_t size, uint64_t address) {
     if (!initialized_ || size < 4) {
         return false;
     }
     
-    cs_insn* insn = nullptr;
-    size_t count = cs_disasm(handle_, code, 4, address, 1, &insn);
-    
-    if (count > 0) {
-        cs_free(insn, count);
-        return true;
+    size = 4;
+    return decodeNext(code, size, address);
+}
+
+bool DisasmWorker::renderText(uint32_t word, uint64_t address, std::string* mnemonic, std::string* operands) {
+    const char* m = nullptr;
+    const char* ops = nullptr;
+    if (!textOf(word, address, m, ops)) {
+        return false;
     }
     
-    return false;
+    if (mnemonic) *mnemonic = m;
+    if (operands) *operands = ops;
+    return true;
 }
 
-void Disassembler::parseInstruction(cs_insn* insn, Instruction& out) {
-    out.address = insn->address;
-    out.bytes.assign(insn->bytes, insn->bytes + insn->size);
-    out.mnemonic = insn->mnemonic;
-    out.operands = insn->op_str;
-    
-    // Default values
-    out.is_branch = false;
-    out.is_call = false;
-    out.is_return = false;
-    out.is_load = false;
-    out.is_store = false;
-    out.branch_target = 0;
-    
-    // Analyze instruction type
-    cs_detail* detail = insn->detail;
-    if (detail) {
-        // Check instruction groups
-        for (int i = 0; i < detail->groups_count; i++) {
-            switch (detail->groups[i]) {
-                case CS_GRP_JUMP:
-                    out.is_branch = true;
-                    break;
-                case CS_GRP_CALL:
-                    out.is_call = true;
-                    break;
-                case CS_GRP_RET:
-                    out.is_return = true;
-                    break;
-            }
-        }
-        
-        // Check for branch target
-        cs_arm64* arm64 = &detail->arm64;
-        for (int i = 0; i < arm64->op_count; i++) {
-            cs_arm64_op* op = &arm64->operands[i];
-            if (op->type == ARM64_OP_IMM && (out.is_branch || out.is_call)) {
-                out.branch_target = op->imm;
-            }
-        }
+bool DisasmWorker::textOf(uint32_t word, uint64_t address, const char*& mnemonic, const char*& operands) {
+    if (!initialized_) {
+        return false;
     }
     
-    // Check mnemonic for load/store
-    if (out.mnemonic[0] == 'l' && out.mnemonic[1] == 'd') {
-        out.is_load = true;
-    } else if (out.mnemonic[0] == 's' && out.mnemonic[1] == 't') {
-        out.is_store = true;
+    uint8_t code[4];
+    std::memcpy(code, &word, sizeof(code));
+    const uint8_t* ptr = code;
+    size_t size = sizeof(code);
+    if (!decodeNext(ptr, size, address)) {
+        return false;
     }
     
-    // Special cases
-    if (out.mnemonic == "bl") {
-        out.is_call = true;
-    } else if (out.mnemonic == "b" || out.mnemonic == "br") {
-        out.is_branch = true;
-    } else if (out.mnemonic == "ret") {
-        out.is_return = true;
+    mnemonic = insn_->mnemonic;
+    operands = insn_->op_str;
+    return true;
+}
+
+DisasmWorker* DisasmWorker::forThread() {
+    thread_local DisasmWorker worker;
+    thread_local bool ok = worker.initialize();
+    return ok ? &worker : nullptr;
+}
+
+Disassembler::Lease::~Lease() {
+    if (worker_) {
+        owner_->release(std::move(worker_));
     }
 }
 
-std::string Instruction::toString() const {
-    std::ostringstream ss;
-    ss << std::hex << "0x" << address << ": ";
-    
-    // Bytes
-    for (const auto& b : bytes) {
-        char buf[4];
-        snprintf(buf, sizeof(buf), "%02X ", b);
-        ss << buf;
+Disassembler::Disassembler() = default;
+
+Disassembler::~Disassembler() = default;
+
+bool Disassembler::initialize() {
+    return main_.initialize();
+}
+
+Disassembler::Lease Disassembler::acquire() {
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex_);
+        if (!idle_.empty()) {
+            std::unique_ptr<DisasmWorker> worker = std::move(idle_.back());
+            idle_.pop_back();
+            worker->setDetail(detail_);
+            return Lease(*this, std::move(worker));
+        }
     }
     
-    // Pad to align
-    for (size_t i = bytes.size(); i < 4; i++) {
-        ss << "   ";
+    // cs_open outside the lock; it is the slow part
+    auto worker = std::make_unique<DisasmWorker>();
+    bool detail;
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex_);
+        detail = detail_;
+    }
+    worker->setDetail(detail);
+    if (!worker->initialize()) {
+        std::lock_guard<std::mutex> lock(pool_mutex_);
+        error_ = worker->getError();
+        return Lease(*this, nullptr);
+    }
+    return Lease(*this, std::move(worker));
+}
+
+void Disassembler::release(std::unique_ptr<DisasmWorker> worker) {
+    std::lock_guard<std::mutex> lock(pool_mutex_);
+    idle_.push_back(std::move(worker));
+}
+
+bool Disassembler::disassembleOne(const uint8_t* code, size_t size, uint64_t address, Instruction& out) {
+    return main_.disassembleOne(code, size, address, out);
+}
+
+std::vector<Instruction> Disassembler::disassemble(const uint8_t* code, size_t size,
+                                                    uint64_t address, size_t count) {
+    return main_.disassemble(code, size, address, count);
+}
+
+std::vector<Instruction> Disassembler::disassembleFunction(const uint8_t* code, size_t max_size,
+                                                            uint64_t address) {
+    return main_.disassembleFunction(code, max_size, address);
+}
+
+bool Disassembler::isValidInstruction(const uint8_t* code, size_t size, uint64_t address) {
+    return main_.isValidInstruction(code, size, address);
+}
+
+bool Disassembler::setDetail(bool enabled) {
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex_);
+        detail_ = enabled;
+    }
+    return main_.setDetail(enabled);
+}
+
+std::string Disassembler::getError() const {
+    std::string error = main_.getError();
+    if (error.empty()) {
+        std::lock_guard<std::mutex> lock(pool_mutex_);
+        error = error_;
     }
+    return error;
+}
+
+static void parseInstruction(cs_insn* insn, Instruction& out) {
+    out.address = insn->address;
+    out.word = 0;
+    std::memcpy(&out.word, insn->bytes, std::min<size_t>(insn->size, sizeof(out.word)));
+    out.flags = 0;
+    out.mnemonic_id = internMnemonic(insn->mnemonic);
     
-    ss << mnemonic << " " << operands;
+    // Control flow comes from the native decoder, not Capstone's detail
+    a64::Decoded d = a64::decode(out.word, out.address);
+    if (d.isBranch()) out.flags |= Instruction::Branch;
+    if (d.isCall()) out.flags |= Instruction::Call;
+    if (d.isReturn()) out.flags |= Instruction::Return;
     
-    return ss.str();
+    // Memory access from the lifted statements
+    ir::Stmt stmts[ir::MAX_STMTS];
+    size_t count = ir::lift(out.word, out.address, stmts);
+    for (size_t i = 0; i < count; i++) {
+        if (stmts[i].op == ir::Op::Load) out.flags |= Instruction::Load;
+        if (stmts[i].op == ir::Op::Store) out.flags |= Instruction::Store;
+    }
+}
+
+bool Instruction::branchTarget(uint64_t& target) const {
+    a64::Decoded d = a64::decode(word, address);
+    target = d.target;
+    return d.hasTarget();
+}
+
+const char* Instruction::mnemonic() const {
+    if (mnemonic_id != 0) {
+        return g_mnemonics[mnemonic_id];
+    }
+    
+    // Not interned (table full): copy it into a per-thread buffer
+    thread_local char rendered[32];
+    rendered[0] = '\0';
+    const char* m = nullptr;
+    const char* ops = nullptr;
+    DisasmWorker* worker = DisasmWorker::forThread();
+    if (worker && worker->textOf(word, address, m, ops)) {
+        std::snprintf(rendered, sizeof(rendered), "%s", m);
+    }
+    return rendered;
+}
+
+std::string Instruction::operands() const {
+    std::string result;
+    if (DisasmWorker* worker = DisasmWorker::forThread()) {
+        worker->renderText(word, address, nullptr, &result);
+    }
+    return result;
+}
+
+std::string Instruction::toString() const {
+    char line[InsnFormatter::LINE_SIZE];
+    size_t length = InsnFormatter().formatLine(*this, line, sizeof(line));
+    return std::string(line, length);
 }
 
 } // namespace kiloader
@@ -1,5 +1,7 @@
 #include "function_finder.h"
+#include "a64_decoder.h"
 #include <algorithm>
+#include <cstring>
 #include <sstream>
 #include <thread>
 #include <mutex>
@@ -7,211 +9,382 @@
 
 namespace kiloader {
 
+// Name of a function nothing has named
+static std::string defaultName(uint64_t address) {
+    std::ostringstream ss;
+    ss << "FUN_" << std::hex << address;
+    return ss.str();
+}
+
 constexpr int NUM_THREADS = 32;
 
-FunctionFinder::FunctionFinder(NsoFile& nso, Disassembler& disasm)
-    : nso_(nso), disasm_(disasm) {}
+// Limit to prevent runaway decodes
+constexpr size_t MAX_FUNCTION_INSTRUCTIONS = 10001;
+
+// Candidates a thread takes from its own range at a time
+constexpr size_t CLAIM_BATCH = 16;
+
+FunctionFinder::FunctionFinder(AddressSpace& space, DecodeTable& table)
+    : space_(space), table_(table) {
+    // Visited bits over the text ranges (the ones AddressSpace::isCode uses)
+    for (size_t m = 0; m < space_.getModuleCount(); m++) {
+        const Module& module = space_.getModule(m);
+        const NsoHeader& header = module.nso->getHeader();
+        
+        VisitedBits visited;
+        visited.base = module.base + header.text.mem_offset;
+        visited.words = header.text.size / 4;
+        size_t blocks = (visited.words + 63) / 64;
+        visited.bits.reset(new std::atomic<uint64_t>[blocks]);
+        for (size_t b = 0; b < blocks; b++) {
+            visited.bits[b].store(0, std::memory_order_relaxed);
+        }
+        visited_.push_back(std::move(visited));
+    }
+    std::sort(visited_.begin(), visited_.end(),
+              [](const VisitedBits& a, const VisitedBits& b) { return a.base < b.base; });
+}
+
+bool FunctionFinder::claim(uint64_t address) {
+    auto it = std::upper_bound(visited_.begin(), visited_.end(), address,
+                               [](uint64_t addr, const VisitedBits& v) { return addr < v.base; });
+    if (it == visited_.begin() || (address & 3) != 0) {
+        return false;
+    }
+    --it;
+    size_t index = (address - it->base) / 4;
+    if (index >= it->words) {
+        return false;
+    }
+    uint64_t bit = 1ULL << (index % 64);
+    return (it->bits[index / 64].fetch_or(bit, std::memory_order_relaxed) & bit) == 0;
+}
+
+void FunctionFinder::unclaim(uint64_t address) {
+    auto it = std::upper_bound(visited_.begin(), visited_.end(), address,
+                               [](uint64_t addr, const VisitedBits& v) { return addr < v.base; });
+    if (it == visited_.begin() || (address & 3) != 0) {
+        return;
+    }
+    --it;
+    size_t index = (address - it->base) / 4;
+    if (index < it->words) {
+        it->bits[index / 64].fetch_and(~(1ULL << (index % 64)), std::memory_order_relaxed);
+    }
+}
 
 void FunctionFinder::findFunctions() {
+    findFunctionsBySymbols();
     findFunctionsByPrologue();
     findFunctionsByCallTargets();
     autoNameFunctions();
 }
 
-void FunctionFinder::findFunctionsByPrologue() {
-    const Segment& text = nso_.getTextSegment();
-    const uint8_t* code = text.data.data();
-    size_t size = text.size;
-    uint64_t base = nso_.getBaseAddress() + text.mem_offset;
+void FunctionFinder::findFunctionsBySymbols() {
+    // Exported entry points are known functions with real names; analyzing
+    // them first means the scans below skip them
+    std::vector<const Symbol*> entries;
+    std::vector<uint64_t> addresses;
+    for (const Symbol& sym : space_.getSymbols().getSymbols()) {
+        if (sym.is_import || !sym.is_function || !space_.isCode(sym.address)) {
+            continue;
+        }
+        entries.push_back(&sym);
+        addresses.push_back(sym.address);
+    }
     
+    analyzeFunctions(addresses);
+    for (const Symbol* sym : entries) {
+        if (getFunction(sym->address)) {
+            nameFunction(sym->address, sym->name);
+        }
+    }
+}
+
+void FunctionFinder::findFunctionsByPrologue() {
     // Common ARM64 function prologues:
     // STP X29, X30, [SP, #-0x??]!  (save frame pointer and link register)
     // SUB SP, SP, #0x??           (allocate stack frame)
-    // STP X??, X??, [SP, #0x??]   (save callee-saved registers)
-    
-    // Phase 1: Find all prologue addresses in parallel
-    std::vector<std::vector<uint64_t>> thread_results(NUM_THREADS);
-    std::vector<std::thread> threads;
-    
-    size_t chunk_size = (size / 4 / NUM_THREADS + 1) * 4;  // Align to 4 bytes
-    
-    for (int t = 0; t < NUM_THREADS; t++) {
-        threads.emplace_back([&, t]() {
-            size_t start = t * chunk_size;
-            size_t end = std::min(start + chunk_size, size - 4);
-            
-            for (size_t offset = start; offset <= end; offset += 4) {
-                if (isPrologue(code + offset, size - offset)) {
-                    thread_results[t].push_back(base + offset);
-                }
-            }
-        });
-    }
+    // PACIASP                     (sign the return address)
     
-    for (auto& thread : threads) {
-        thread.join();
-    }
-    
-    // Phase 2: Merge results and analyze (single-threaded to avoid races)
+    // Phase 1: Collect prologue words from the opcode-class bitmaps
     std::vector<uint64_t> all_prologues;
-    for (auto& results : thread_results) {
-        all_prologues.insert(all_prologues.end(), results.begin(), results.end());
-    }
-    
-    for (uint64_t addr : all_prologues) {
-        if (functions_.find(addr) == functions_.end()) {
-            analyzeFunction(addr);
+    table_.forEachClass(PROLOGUE_CLASSES, [&](uint64_t address, uint32_t) {
+        // Literal pools can hold prologue-looking words
+        if (!table_.isData(address)) {
+            all_prologues.push_back(address);
         }
-    }
+    });
+    
+    // Phase 2: Analyze them in parallel
+    analyzeFunctions(all_prologues);
 }
 
 void FunctionFinder::findFunctionsByCallTargets() {
     // Look for BL (branch and link) instructions and mark their targets as functions
-    const Segment& text = nso_.getTextSegment();
-    const uint8_t* code = text.data.data();
-    size_t size = text.size;
-    uint64_t base = nso_.getBaseAddress() + text.mem_offset;
-    
-    // Phase 1: Find all call targets in parallel
-    std::vector<std::vector<uint64_t>> thread_results(NUM_THREADS);
-    std::vector<std::thread> threads;
     
-    size_t chunk_size = (size / 4 / NUM_THREADS + 1) * 4;
-    
-    for (int t = 0; t < NUM_THREADS; t++) {
-        threads.emplace_back([&, t]() {
-            size_t start = t * chunk_size;
-            size_t end = std::min(start + chunk_size, size - 4);
-            
-            for (size_t offset = start; offset <= end; offset += 4) {
-                uint32_t insn = *reinterpret_cast<const uint32_t*>(code + offset);
-                
-                // BL instruction: 0x94000000 | imm26
-                if ((insn & 0xFC000000) == 0x94000000) {
-                    int32_t imm26 = insn & 0x03FFFFFF;
-                    // Sign extend
-                    if (imm26 & 0x02000000) {
-                        imm26 |= 0xFC000000;
-                    }
-                    int64_t target = (base + offset) + (imm26 << 2);
-                    
-                    if (target >= static_cast<int64_t>(base) && 
-                        target < static_cast<int64_t>(base + size)) {
-                        thread_results[t].push_back(target);
-                    }
-                }
-            }
-        });
-    }
+    // Phase 1: Collect call targets from the BL bitmap
+    std::vector<uint64_t> targets;
+    table_.forEachClass(opClassBit(OpClass::Bl), [&](uint64_t address, uint32_t word) {
+        if (table_.isData(address)) {
+            return;
+        }
+        uint64_t target = a64::decode(word, address).target;
+        
+        // Targets may land in another module's text
+        if (space_.isCode(target) && !table_.isData(target)) {
+            targets.push_back(target);
+        }
+    });
     
-    for (auto& thread : threads) {
-        thread.join();
-    }
-    
-    // Phase 2: Merge and deduplicate
-    std::set<uint64_t> unique_targets;
-    for (auto& results : thread_results) {
-        unique_targets.insert(results.begin(), results.end());
-    }
+    // Phase 2: Deduplicate
+    std::sort(targets.begin(), targets.end());
+    targets.erase(std::unique(targets.begin(), targets.end()), targets.end());
     
     // Phase 3: Analyze each call target as a function
-    for (uint64_t target : unique_targets) {
-        if (functions_.find(target) == functions_.end()) {
-            analyzeFunction(target);
-        }
-    }
+    analyzeFunctions(targets);
 }
 
 bool FunctionFinder::isPrologue(const uint8_t* code, size_t size) {
     if (size < 4) return false;
     
-    uint32_t insn = *reinterpret_cast<const uint32_t*>(code);
-    
-    // STP X29, X30, [SP, #-??]! (pre-indexed)
-    // Encoding: 0xA9B00000 | (imm7 << 15) | (Rt2 << 10) | (Rn << 5) | Rt
-    // For STP X29, X30, [SP, #-16]!: 0xA9BF7BFD
-    if ((insn & 0xFFC003E0) == 0xA9800000) {  // STP Xt, Xt, [SP, #imm]!
-        uint32_t rt = insn & 0x1F;
-        uint32_t rt2 = (insn >> 10) & 0x1F;
-        if (rt == 29 && rt2 == 30) {  // X29 (FP) and X30 (LR)
-            return true;
-        }
-    }
-    
-    // SUB SP, SP, #imm
-    // Encoding: 0xD1000000 | (shift << 22) | (imm12 << 10) | (Rn << 5) | Rd
-    if ((insn & 0xFF0003FF) == 0xD10003FF) {  // SUB SP, SP, #imm
-        return true;
-    }
+    uint32_t insn;
+    std::memcpy(&insn, code, sizeof(insn));
     
-    // PACIASP (pointer auth)
-    if (insn == 0xD503233F) {
-        return true;
-    }
-    
-    return false;
+    // Same classes as the bitmap scan in findFunctionsByPrologue
+    return (OpcodeScan::classify(insn) & PROLOGUE_CLASSES) != 0;
 }
 
 bool FunctionFinder::isEpilogue(const Instruction& insn) {
-    return insn.is_return;
+    return insn.isReturn();
 }
 
 Function* FunctionFinder::analyzeFunction(uint64_t address) {
-    if (analyzed_addresses_.count(address)) {
+    Function* func = addFunction(address);
+    updateIndex();
+    return func;
+}
+
+Function* FunctionFinder::addFunction(uint64_t address) {
+    if (!claim(address)) {
         auto it = functions_.find(address);
         return it != functions_.end() ? &it->second : nullptr;
     }
     
-    analyzed_addresses_.insert(address);
+    Function func;
+    if (!decodeFunction(address, func)) {
+        return nullptr;
+    }
+    
+    // Insert and return
+    auto [it, inserted] = functions_.emplace(address, std::move(func));
+    markIndexDirty(address);
+    return &it->second;
+}
+
+// A thread's share of the candidates: the owner takes batches from the
+// front, idle threads steal the back half
+struct WorkRange {
+    std::mutex mutex;
+    size_t next = 0;
+    size_t end = 0;
+};
+
+void FunctionFinder::analyzeFunctions(const std::vector<uint64_t>& addresses) {
+    if (addresses.empty()) {
+        return;
+    }
+    
+    // Decode in parallel into per-candidate slots. The visited bits decide
+    // which occurrence of an address is decoded; all of them give the same
+    // function, so the schedule doesn't matter.
+    std::vector<Function> results(addresses.size());
+    std::vector<uint8_t> valid(addresses.size(), 0);
+    std::vector<std::thread> threads;
     
-    const Segment& text = nso_.getTextSegment();
-    uint64_t text_base = nso_.getBaseAddress() + text.mem_offset;
+    int thread_count = static_cast<int>(std::min<size_t>(NUM_THREADS, addresses.size()));
+    size_t chunk_size = addresses.size() / thread_count + 1;
+    std::vector<WorkRange> ranges(thread_count);
+    for (int t = 0; t < thread_count; t++) {
+        ranges[t].next = std::min(t * chunk_size, addresses.size());
+        ranges[t].end = std::min(ranges[t].next + chunk_size, addresses.size());
+    }
     
-    if (address < text_base || address >= text_base + text.size) {
-        return nullptr;
+    // Take a batch [first, last) from a thread's own range, or steal the
+    // back half of the next non-empty range into it
+    auto take = [&](int t, size_t& first, size_t& last) {
+        {
+            std::lock_guard<std::mutex> lock(ranges[t].mutex);
+            if (ranges[t].next < ranges[t].end) {
+                first = ranges[t].next;
+                last = std::min(first + CLAIM_BATCH, ranges[t].end);
+                ranges[t].next = last;
+                return true;
+            }
+        }
+        for (int k = 1; k < thread_count; k++) {
+            WorkRange& victim = ranges[(t + k) % thread_count];
+            size_t steal_first;
+            size_t steal_last;
+            {
+                std::lock_guard<std::mutex> lock(victim.mutex);
+                if (victim.next >= victim.end) {
+                    continue;
+                }
+                steal_last = victim.end;
+                steal_first = victim.end - (victim.end - victim.next + 1) / 2;
+                victim.end = steal_first;
+            }
+            
+            // Keep one batch, publish the rest for others to steal back
+            first = steal_first;
+            last = std::min(first + CLAIM_BATCH, steal_last);
+            std::lock_guard<std::mutex> lock(ranges[t].mutex);
+            ranges[t].next = last;
+            ranges[t].end = steal_last;
+            return true;
+        }
+        return false;
+    };
+    
+    for (int t = 0; t < thread_count; t++) {
+        threads.emplace_back([&, t]() {
+            size_t first;
+            size_t last;
+            while (take(t, first, last)) {
+                for (size_t i = first; i < last; i++) {
+                    if (claim(addresses[i])) {
+                        valid[i] = decodeFunction(addresses[i], results[i]);
+                    }
+                }
+            }
+        });
     }
     
-    size_t offset = address - text_base;
-    const uint8_t* code = text.data.data() + offset;
-    size_t max_size = text.size - offset;
+    for (auto& thread : threads) {
+        thread.join();
+    }
     
-    // Disassemble function
-    auto instructions = disasm_.disassembleFunction(code, max_size, address);
-    if (instructions.empty()) {
-        return nullptr;
+    // Insert in input order; std::map takes no concurrent inserts, so the
+    // slots are the only state the threads shared
+    for (size_t i = 0; i < addresses.size(); i++) {
+        if (valid[i]) {
+            functions_.emplace(addresses[i], std::move(results[i]));
+            markIndexDirty(addresses[i]);
+        }
+    }
+    updateIndex();
+}
+
+bool FunctionFinder::decodeFunction(uint64_t address, Function& func) const {
+    if (!space_.isCode(address)) {
+        return false;
     }
     
-    // Create function entry
-    Function func;
+    // Instructions come from the shared decode table. Kept for the whole
+    // session, so without the growth slack.
+    func.instructions.clear();
+    if (table_.decodeFunction(address, MAX_FUNCTION_INSTRUCTIONS, func.instructions) == 0) {
+        return false;
+    }
+    func.instructions.shrink_to_fit();
+    
+    // Fill in the function entry
     func.address = address;
-    func.instructions = std::move(instructions);
-    func.end_address = func.instructions.back().address + func.instructions.back().bytes.size();
+    func.end_address = func.instructions.back().address + Instruction::size();
     func.size = func.end_address - func.address;
     func.is_leaf = true;
     func.is_thunk = false;
     func.is_noreturn = false;
     
-    // Generate default name
-    std::ostringstream ss;
-    ss << "FUN_" << std::hex << address;
-    func.name = ss.str();
+    func.name = defaultName(address);
     
     // Analyze calls
     for (const auto& insn : func.instructions) {
-        if (insn.is_call && insn.branch_target != 0) {
-            func.calls_to.insert(insn.branch_target);
+        uint64_t target;
+        if (insn.isCall() && insn.branchTarget(target)) {
+            func.calls_to.insert(target);
             func.is_leaf = false;
         }
     }
     
     // Check if thunk (single branch)
-    if (func.instructions.size() == 1 && func.instructions[0].is_branch) {
+    if (func.instructions.size() == 1 && func.instructions[0].isBranch()) {
         func.is_thunk = true;
     }
     
-    // Insert and return
-    auto [it, inserted] = functions_.emplace(address, std::move(func));
-    return &it->second;
+    return true;
+}
+
+std::vector<uint64_t> FunctionFinder::reanalyzePages(const std::vector<uint64_t>& pages, uint64_t page_size) {
+    std::vector<uint64_t> changed;
+    if (pages.empty()) {
+        return changed;
+    }
+    
+    auto touchesPage = [&](uint64_t start, uint64_t end) {
+        auto it = std::upper_bound(pages.begin(), pages.end(), start & ~(page_size - 1));
+        if (it != pages.begin() && *(it - 1) + page_size > start) {
+            return true;
+        }
+        return it != pages.end() && *it < end;
+    };
+    
+    // Existing functions with bytes in a dirty page
+    for (const auto& [addr, func] : functions_) {
+        if (touchesPage(func.address, func.end_address)) {
+            changed.push_back(addr);
+        }
+    }
+    
+    for (uint64_t addr : changed) {
+        std::string name = functions_[addr].name;
+        functions_.erase(addr);
+        unclaim(addr);
+        markIndexDirty(addr);
+        
+        Function* func = addFunction(addr);
+        if (func) {
+            func->name = name;
+        } else {
+            auto it = name_index_.find(name);
+            if (it != name_index_.end() && it->second == addr) {
+                name_index_.erase(it);
+            }
+        }
+    }
+    
+    // New entry points in the patched code
+    std::set<uint64_t> candidates;
+    for (uint64_t page : pages) {
+        for (uint64_t addr = page; addr < page + page_size; addr += 4) {
+            uint32_t insn;
+            if (!space_.isCode(addr) || !space_.read(addr, insn)) {
+                continue;
+            }
+            if (isPrologue(reinterpret_cast<const uint8_t*>(&insn), sizeof(insn))) {
+                candidates.insert(addr);
+            }
+            a64::Decoded d = a64::decode(insn, addr);
+            if (d.op == a64::Op::Bl && space_.isCode(d.target)) {
+                candidates.insert(d.target);
+            }
+        }
+    }
+    
+    for (uint64_t addr : candidates) {
+        if (functions_.count(addr)) {
+            continue;
+        }
+        // Bytes that failed to decode before may decode now
+        unclaim(addr);
+        if (addFunction(addr)) {
+            changed.push_back(addr);
+        }
+    }
+    
+    updateIndex();
+    return changed;
 }
 
 Function* FunctionFinder::getFunction(uint64_t address) {
@@ -220,18 +393,75 @@ Function* FunctionFinder::getFunction(uint64_t address) {
 }
 
 Function* FunctionFinder::getFunctionContaining(uint64_t address) {
-    for (auto& [addr, func] : functions_) {
-        if (address >= func.address && address < func.end_address) {
-            return &func;
-        }
+    size_t count = index_max_ends_.size();
+    if (count == 0) {
+        return nullptr;
+    }
+    
+    // Branchless upper bound: first entry whose running max end > address.
+    // Its own end is that maximum, so it contains address if it starts at
+    // or below it; no earlier function reaches that far.
+    const uint64_t* base = index_max_ends_.data();
+    size_t len = count;
+    while (len > 1) {
+        size_t half = len / 2;
+        base += (base[half - 1] <= address) ? half : 0;
+        len -= half;
+    }
+    size_t i = static_cast<size_t>(base - index_max_ends_.data()) + (*base <= address);
+    
+    if (i < count && index_starts_[i] <= address) {
+        return index_funcs_[i];
     }
     return nullptr;
 }
 
+void FunctionFinder::updateIndex() {
+    if (index_dirty_from_ == UINT64_MAX) {
+        return;
+    }
+    
+    // Entries below the first change stay; the rest are rebuilt from the map
+    size_t keep = std::lower_bound(index_starts_.begin(), index_starts_.end(), index_dirty_from_) -
+                  index_starts_.begin();
+    index_starts_.resize(keep);
+    index_max_ends_.resize(keep);
+    index_funcs_.resize(keep);
+    
+    uint64_t max_end = keep > 0 ? index_max_ends_[keep - 1] : 0;
+    for (auto it = functions_.lower_bound(index_dirty_from_); it != functions_.end(); ++it) {
+        max_end = std::max(max_end, it->second.end_address);
+        index_starts_.push_back(it->first);
+        index_max_ends_.push_back(max_end);
+        index_funcs_.push_back(&it->second);
+    }
+    index_dirty_from_ = UINT64_MAX;
+}
+
+Function* FunctionFinder::findFunctionByName(const std::string& name) {
+    auto it = name_index_.find(name);
+    return it != name_index_.end() ? getFunction(it->second) : nullptr;
+}
+
 void FunctionFinder::nameFunction(uint64_t address, const std::string& name) {
     auto it = functions_.find(address);
     if (it != functions_.end()) {
+        auto old = name_index_.find(it->second.name);
+        if (old != name_index_.end() && old->second == address) {
+            name_index_.erase(old);
+        }
         it->second.name = name;
+        
+        // A name belongs to one function: the last one given it. The one
+        // that had it goes back to its default name.
+        auto& holder = name_index_[name];
+        if (holder != address) {
+            auto prev = functions_.find(holder);
+            if (prev != functions_.end() && prev->second.name == name) {
+                prev->second.name = defaultName(holder);
+            }
+        }
+        holder = address;
     }
 }
 
@@ -246,15 +476,16 @@ void FunctionFinder::analyzeBasicBlocks(Function& func) {
     leaders.insert(func.address);
     
     for (const auto& insn : func.instructions) {
-        if (insn.is_branch || insn.is_call) {
+        if (insn.isBranch() || insn.isCall()) {
             // Next instruction is a leader
-            uint64_t next = insn.address + insn.bytes.size();
+            uint64_t next = insn.address + insn.size();
             if (next < func.end_address) {
                 leaders.insert(next);
             }
             // Branch target is a leader
-            if (insn.branch_target >= func.address && insn.branch_target < func.end_address) {
-                leaders.insert(insn.branch_target);
+            uint64_t target;
+            if (insn.branchTarget(target) && target >= func.address && target < func.end_address) {
+                leaders.insert(target);
             }
         }
     }
@@ -451,7 +451,7 @@ void App::executeCommand(const std::string& cmd) {
         appendOutput("Commands:");
         appendOutput("  load <path>        Load NSO file");
         appendOutput("  save               Save progress");
-        appendOutput("  goto <addr>        Go to address");
+        appendOutput("  goto <addr|name>   Go to address or symbol");
         appendOutput("  info               Show file info");
         appendOutput("  clear              Clear output");
         appendOutput("  quit               Exit");
@@ -499,17 +499,20 @@ void App::executeCommand(const std::string& cmd) {
         std::string addr_str;
         iss >> addr_str;
         if (addr_str.empty()) {
-            appendOutput("Usage: goto <address>");
+            appendOutput("Usage: goto <address|name>");
             return;
         }
         
-        uint64_t addr = 0;
-        if (addr_str.substr(0, 2) == "0x") {
-            std::stringstream ss;
-            ss << std::hex << addr_str.substr(2);
-            ss >> addr;
-        } else {
-            addr = std::stoull(addr_str);
+        // Symbol or function name first, then a numeric address
+        uint64_t addr = analyzer_.findFunctionByName(addr_str);
+        if (addr == 0) {
+            if (addr_str.substr(0, 2) == "0x") {
+                std::stringstream ss;
+                ss << std::hex << addr_str.substr(2);
+                ss >> addr;
+            } else {
+                addr = std::stoull(addr_str);
+            }
         }
         
         setSelectedFunction(addr);
@@ -1,8 +1,11 @@
 #include "gui/disasm_view.h"
 #include "gui/app.h"
 
-#include <sstream>
-#include <iomanip>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <climits>
+#include <algorithm>
 
 namespace kiloader {
 namespace gui {
@@ -19,7 +22,7 @@ void DisasmView::setFunction(uint64_t addr) {
 }
 
 void DisasmView::disassemble() {
-    lines_.clear();
+    line_count_ = 0;
     
     if (current_addr_ == 0) return;
     
@@ -30,24 +33,11 @@ void DisasmView::disassemble() {
         count = func->size / 4 + 1;
     }
     
-    auto insns = app_.getAnalyzer().disassembleAt(current_addr_, count);
-    
-    for (const auto& insn : insns) {
-        DisasmLine line;
-        line.address = insn.address;
-        line.mnemonic = insn.mnemonic;
-        line.operands = insn.operands;
-        
-        // Format bytes
-        std::stringstream ss;
-        for (size_t i = 0; i < insn.bytes.size() && i < 8; i++) {
-            ss << std::hex << std::setfill('0') << std::setw(2) 
-               << static_cast<int>(insn.bytes[i]);
-        }
-        line.bytes = ss.str();
-        
-        lines_.push_back(line);
-    }
+    // Only count the lines here; draw() decodes the ones on screen
+    size_t lines = app_.getAnalyzer().disassembleCount(current_addr_, count, [](const Instruction&) {
+        return true;
+    });
+    line_count_ = static_cast<int>(std::min<size_t>(lines, INT_MAX));
 }
 
 void DisasmView::draw(WINDOW* win) {
@@ -63,13 +53,23 @@ void DisasmView::draw(WINDOW* win) {
         scroll_offset_ = selected_ - visible_height + 1;
     }
     
-    for (int i = 0; i < visible_height && scroll_offset_ + i < static_cast<int>(lines_.size()); i++) {
+    // Decode just the visible lines
+    visible_.clear();
+    int rows = std::max(0, std::min(visible_height, line_count_ - scroll_offset_));
+    if (rows > 0) {
+        app_.getAnalyzer().disassembleCount(lineAddress(scroll_offset_), rows, [&](const Instruction& insn) {
+            visible_.push_back(insn);
+            return true;
+        });
+    }
+    
+    for (int i = 0; i < static_cast<int>(visible_.size()); i++) {
         int idx = scroll_offset_ + i;
-        auto& line = lines_[idx];
+        const Instruction& insn = visible_[i];
         
         // Address
-        std::stringstream ss;
-        ss << std::hex << std::setw(10) << std::setfill('0') << line.address;
+        char addr[24];
+        InsnFormatter::formatHex(insn.address, addr, sizeof(addr), 10);
         
         if (idx == selected_) {
             wattron(win, A_REVERSE);
@@ -77,21 +77,22 @@ void DisasmView::draw(WINDOW* win) {
         
         // Address in cyan
         wattron(win, COLOR_PAIR(1));
-        mvwprintw(win, 1 + i, 1, "%s", ss.str().c_str());
+        mvwprintw(win, 1 + i, 1, "%s", addr);
         wattroff(win, COLOR_PAIR(1));
         
         // Mnemonic
         wattron(win, A_BOLD);
-        mvwprintw(win, 1 + i, 13, "%-8s", line.mnemonic.c_str());
+        mvwprintw(win, 1 + i, 13, "%-8s", insn.mnemonic());
         wattroff(win, A_BOLD);
         
         // Operands
-        std::string ops = line.operands;
+        char ops[InsnFormatter::LINE_SIZE];
+        size_t len = formatter_.formatOperands(insn, ops, sizeof(ops));
         int max_ops = width - 25;
-        if (ops.length() > static_cast<size_t>(max_ops)) {
-            ops = ops.substr(0, max_ops - 3) + "...";
+        if (max_ops > 3 && len > static_cast<size_t>(max_ops)) {
+            std::memcpy(ops + max_ops - 3, "...", 4);
         }
-        mvwprintw(win, 1 + i, 22, "%s", ops.c_str());
+        mvwprintw(win, 1 + i, 22, "%s", ops);
         
         if (idx == selected_) {
             wattroff(win, A_REVERSE);
@@ -99,10 +100,10 @@ void DisasmView::draw(WINDOW* win) {
     }
     
     // Scroll indicator
-    if (!lines_.empty() && lines_.size() > static_cast<size_t>(visible_height)) {
-        int scroll_height = std::max(1, visible_height * visible_height / static_cast<int>(lines_.size()));
+    if (line_count_ > visible_height) {
+        int scroll_height = std::max(1, visible_height * visible_height / line_count_);
         int scroll_pos = scroll_offset_ * (visible_height - scroll_height) / 
-                         std::max(1, static_cast<int>(lines_.size()) - visible_height);
+                         std::max(1, line_count_ - visible_height);
         
         for (int i = 0; i < visible_height; i++) {
             if (i >= scroll_pos && i < scroll_pos + scroll_height) {
@@ -113,12 +114,12 @@ void DisasmView::draw(WINDOW* win) {
 }
 
 void DisasmView::handleKey(int ch) {
-    if (lines_.empty()) return;
+    if (line_count_ == 0) return;
     
     int height = 20;  // Approximate
     
     if (ch == KEY_DOWN || ch == 'j') {
-        if (selected_ < static_cast<int>(lines_.size()) - 1) {
+        if (selected_ < line_count_ - 1) {
             selected_++;
         }
     } else if (ch == KEY_UP || ch == 'k') {
@@ -128,31 +129,28 @@ void DisasmView::handleKey(int ch) {
     } else if (ch == KEY_PPAGE) {
         selected_ = std::max(0, selected_ - height);
     } else if (ch == KEY_NPAGE) {
-        selected_ = std::min(static_cast<int>(lines_.size()) - 1, selected_ + height);
+        selected_ = std::min(line_count_ - 1, selected_ + height);
     } else if (ch == KEY_HOME || ch == 'g') {
         selected_ = 0;
         scroll_offset_ = 0;
     } else if (ch == KEY_END || ch == 'G') {
-        selected_ = lines_.size() - 1;
+        selected_ = line_count_ - 1;
     } else if (ch == '\n' || ch == KEY_ENTER) {
         // Follow branch/call
-        if (selected_ >= 0 && selected_ < static_cast<int>(lines_.size())) {
-            auto& line = lines_[selected_];
-            // Check if operand looks like an address
-            if (line.operands.find("0x") != std::string::npos || 
-                line.operands.find("#") != std::string::npos) {
-                // Try to parse address from operands
-                std::string ops = line.operands;
-                size_t pos = ops.find("0x");
-                if (pos != std::string::npos) {
-                    std::string addr_str = ops.substr(pos + 2);
-                    size_t end = addr_str.find_first_not_of("0123456789abcdefABCDEF");
-                    if (end != std::string::npos) {
-                        addr_str = addr_str.substr(0, end);
-                    }
-                    uint64_t addr = std::stoull(addr_str, nullptr, 16);
-                    app_.setSelectedFunction(addr);
-                }
+        Instruction insn;
+        bool found = selected_ >= 0 && selected_ < line_count_ &&
+                     app_.getAnalyzer().disassembleCount(lineAddress(selected_), 1, [&](const Instruction& decoded) {
+                         insn = decoded;
+                         return false;
+                     }) == 1;
+        if (found) {
+            char ops[InsnFormatter::LINE_SIZE];
+            formatter_.formatOperands(insn, ops, sizeof(ops));
+            // Try to parse an address from the operands
+            const char* hex = std::strstr(ops, "0x");
+            if (hex && std::isxdigit(static_cast<unsigned char>(hex[2]))) {
+                uint64_t addr = std::strtoull(hex + 2, nullptr, 16);
+                app_.setSelectedFunction(addr);
             }
         }
     }
@@ -0,0 +1,129 @@
+#include "insn_formatter.h"
+
+namespace kiloader {
+
+namespace {
+
+const char LOWER_HEX[] = "0123456789abcdef";
+const char UPPER_HEX[] = "0123456789ABCDEF";
+
+// Bounded appender over a caller buffer (size > 0). Keeps one byte for
+// the NUL.
+class LineWriter {
+public:
+    LineWriter(char* buf, size_t size) : buf_(buf), pos_(buf), end_(buf + size - 1) {}
+    
+    void put(char c) {
+        if (pos_ < end_) *pos_++ = c;
+    }
+    
+    void put(const char* s) {
+        while (*s && pos_ < end_) *pos_++ = *s++;
+    }
+    
+    void hex(uint64_t value, int min_digits, const char* digits) {
+        char tmp[16];
+        int n = 0;
+        do {
+            tmp[n++] = digits[value & 0xF];
+            value >>= 4;
+        } while (value != 0);
+        while (n < min_digits && n < 16) {
+            tmp[n++] = '0';
+        }
+        while (n > 0) {
+            put(tmp[--n]);
+        }
+    }
+    
+    // Instruction bytes in memory order, uppercase
+    void bytes(const Instruction& insn, char sep) {
+        for (size_t i = 0; i < Instruction::size(); i++) {
+            uint8_t b = insn.byte(i);
+            put(UPPER_HEX[b >> 4]);
+            put(UPPER_HEX[b & 0xF]);
+            if (sep != '\0') {
+                put(sep);
+            }
+        }
+    }
+    
+    // Terminate and return the length
+    size_t finish() {
+        *pos_ = '\0';
+        return static_cast<size_t>(pos_ - buf_);
+    }
+    
+private:
+    char* buf_;
+    char* pos_;
+    char* end_;
+};
+
+} // namespace
+
+InsnFormatter::InsnFormatter() : worker_(DisasmWorker::forThread()) {}
+
+InsnFormatter::InsnFormatter(DisasmWorker& worker) : worker_(&worker) {}
+
+size_t InsnFormatter::formatLine(const Instruction& insn, char* buf, size_t size) {
+    if (size == 0) {
+        return 0;
+    }
+    
+    LineWriter out(buf, size);
+    out.put("0x");
+    out.hex(insn.address, 1, LOWER_HEX);
+    out.put(": ");
+    
+    out.bytes(insn, ' ');
+    
+    // One decode gives both; the mnemonic is only needed when not interned
+    const char* mnemonic = nullptr;
+    const char* operands = "";
+    if (!worker_ || !worker_->textOf(insn.word, insn.address, mnemonic, operands)) {
+        mnemonic = nullptr;
+        operands = "";
+    }
+    out.put(insn.mnemonic_id != 0 || !mnemonic ? insn.mnemonic() : mnemonic);
+    out.put(' ');
+    out.put(operands);
+    
+    return out.finish();
+}
+
+size_t InsnFormatter::formatOperands(const Instruction& insn, char* buf, size_t size) {
+    if (size == 0) {
+        return 0;
+    }
+    
+    LineWriter out(buf, size);
+    const char* mnemonic = nullptr;
+    const char* operands = nullptr;
+    if (worker_ && worker_->textOf(insn.word, insn.address, mnemonic, operands)) {
+        out.put(operands);
+    }
+    return out.finish();
+}
+
+size_t InsnFormatter::formatHex(uint64_t value, char* buf, size_t size, int min_digits) {
+    if (size == 0) {
+        return 0;
+    }
+    
+    LineWriter out(buf, size);
+    out.hex(value, min_digits, LOWER_HEX);
+    return out.finish();
+}
+
+size_t InsnFormatter::formatBytes(const Instruction& insn, char* buf, size_t size, char sep) {
+    if (size == 0) {
+        return 0;
+    }
+    
+    LineWriter out(buf, size);
+    out.bytes(insn, sep);
+    return out.finish();
+}
+
+} // namespace kiloader
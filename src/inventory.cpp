@@ -0,0 +1,217 @@
+#include "inventory.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <ostream>
+#include <thread>
+
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace kiloader {
+
+namespace fs = std::filesystem;
+
+constexpr int NUM_THREADS = 32;
+
+// Longest module name we bother reading
+constexpr size_t MAX_MODULE_NAME = 0x200;
+
+namespace {
+
+// Read-only file handle for positioned reads
+class HeaderReader {
+public:
+    explicit HeaderReader(const std::string& path) {
+#ifdef _WIN32
+        file_.open(path, std::ios::binary);
+#else
+        fd_ = ::open(path.c_str(), O_RDONLY);
+#endif
+    }
+    
+    ~HeaderReader() {
+#ifndef _WIN32
+        if (fd_ >= 0) {
+            ::close(fd_);
+        }
+#endif
+    }
+    
+    bool isOpen() const {
+#ifdef _WIN32
+        return file_.is_open();
+#else
+        return fd_ >= 0;
+#endif
+    }
+    
+    // Read exactly size bytes at offset
+    bool readAt(uint64_t offset, void* buf, size_t size) {
+#ifdef _WIN32
+        file_.clear();
+        file_.seekg(offset);
+        file_.read(static_cast<char*>(buf), size);
+        return static_cast<size_t>(file_.gcount()) == size;
+#else
+        size_t done = 0;
+        while (done < size) {
+            ssize_t n = ::pread(fd_, static_cast<uint8_t*>(buf) + done, size - done, offset + done);
+            if (n <= 0) {
+                return false;
+            }
+            done += n;
+        }
+        return true;
+#endif
+    }
+    
+private:
+#ifdef _WIN32
+    std::ifstream file_;
+#else
+    int fd_ = -1;
+#endif
+};
+
+} // namespace
+
+bool Inventory::readEntry(const std::string& path, InventoryEntry& entry) {
+    HeaderReader reader(path);
+    if (!reader.isOpen()) {
+        return false;
+    }
+    
+    NsoHeader header;
+    if (!reader.readAt(0, &header, sizeof(header)) || header.magic != 0x304F534E) {  // "NSO0"
+        return false;
+    }
+    
+    entry.path = path;
+    entry.flags = header.flags;
+    entry.sizes[0] = header.text.size;
+    entry.sizes[1] = header.rodata.size;
+    entry.sizes[2] = header.data.size;
+    entry.stored_sizes[0] = (header.flags & 1) ? header.text_compressed_size : header.text.size;
+    entry.stored_sizes[1] = (header.flags & 2) ? header.rodata_compressed_size : header.rodata.size;
+    entry.stored_sizes[2] = (header.flags & 4) ? header.data_compressed_size : header.data.size;
+    entry.bss_size = header.bss_size;
+    
+    static const char hex[] = "0123456789ABCDEF";
+    entry.build_id.resize(64);
+    for (int i = 0; i < 32; i++) {
+        entry.build_id[i * 2] = hex[header.build_id[i] >> 4];
+        entry.build_id[i * 2 + 1] = hex[header.build_id[i] & 0xF];
+    }
+    
+    // Module name: NUL-terminated, and kept on one line for the index
+    size_t name_size = std::min<size_t>(header.module_name_size, MAX_MODULE_NAME);
+    if (name_size > 0) {
+        char name[MAX_MODULE_NAME];
+        if (reader.readAt(header.module_name_offset, name, name_size)) {
+            entry.module_name.assign(name, strnlen(name, name_size));
+            for (char& c : entry.module_name) {
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    c = ' ';
+                }
+            }
+        }
+    }
+    
+    std::error_code ec;
+    entry.file_size = fs::file_size(path, ec);
+    return true;
+}
+
+bool Inventory::scan(const std::string& dir) {
+    auto start_time = std::chrono::steady_clock::now();
+    entries_.clear();
+    error_.clear();
+    
+    // Walking the tree is cheap next to opening every file
+    std::vector<std::string> paths;
+    std::error_code ec;
+    fs::recursive_directory_iterator it(dir, fs::directory_options::skip_permission_denied, ec);
+    if (ec) {
+        error_ = "Failed to open directory: " + dir;
+        return false;
+    }
+    for (; it != fs::recursive_directory_iterator(); it.increment(ec)) {
+        if (ec) {
+            break;
+        }
+        if (it->is_regular_file(ec)) {
+            paths.push_back(it->path().string());
+        }
+    }
+    file_count_ = paths.size();
+    
+    // Files take very different times to open (cold cache, network mounts),
+    // so threads pull the next index instead of getting fixed chunks
+    std::vector<InventoryEntry> slots(paths.size());
+    std::vector<uint8_t> valid(paths.size(), 0);
+    std::atomic<size_t> next{0};
+    std::vector<std::thread> threads;
+    
+    int thread_count = static_cast<int>(std::min<size_t>(NUM_THREADS, paths.size()));
+    for (int t = 0; t < thread_count; t++) {
+        threads.emplace_back([&]() {
+            for (size_t i = next++; i < paths.size(); i = next++) {
+                valid[i] = readEntry(paths[i], slots[i]);
+            }
+        });
+    }
+    
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    
+    for (size_t i = 0; i < slots.size(); i++) {
+        if (valid[i]) {
+            entries_.push_back(std::move(slots[i]));
+        }
+    }
+    std::sort(entries_.begin(), entries_.end(), [](const InventoryEntry& a, const InventoryEntry& b) {
+        return a.build_id != b.build_id ? a.build_id < b.build_id : a.path < b.path;
+    });
+    
+    scan_ms_ = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+    return true;
+}
+
+std::vector<const InventoryEntry*> Inventory::findByBuildId(const std::string& prefix) const {
+    std::string key = prefix;
+    std::transform(key.begin(), key.end(), key.begin(), ::toupper);
+    
+    // Sorted by build ID: the matches are one contiguous run
+    std::vector<const InventoryEntry*> result;
+    auto it = std::lower_bound(entries_.begin(), entries_.end(), key,
+        [](const InventoryEntry& entry, const std::string& k) { return entry.build_id < k; });
+    for (; it != entries_.end() && it->build_id.compare(0, key.size(), key) == 0; ++it) {
+        result.push_back(&*it);
+    }
+    return result;
+}
+
+bool Inventory::writeIndex(std::ostream& out) const {
+    out << "build_id\tflags\ttext\trodata\tdata\tbss\ttext_stored\trodata_stored\tdata_stored\tfile_size\tmodule\tpath\n";
+    
+    char flags[8];
+    for (const auto& e : entries_) {
+        snprintf(flags, sizeof(flags), "%02X", e.flags & 0xFF);
+        out << e.build_id << '\t' << flags << '\t'
+            << e.sizes[0] << '\t' << e.sizes[1] << '\t' << e.sizes[2] << '\t' << e.bss_size << '\t'
+            << e.stored_sizes[0] << '\t' << e.stored_sizes[1] << '\t' << e.stored_sizes[2] << '\t'
+            << e.file_size << '\t' << e.module_name << '\t' << e.path << '\n';
+    }
+    return static_cast<bool>(out);
+}
+
+} // namespace kiloader
@@ -0,0 +1,93 @@
+#include "ips_patch.h"
+#include <fstream>
+#include <cstring>
+#include <iterator>
+
+namespace kiloader {
+
+// Big-endian field of n bytes at data[pos]
+static uint64_t readBe(const std::vector<uint8_t>& data, size_t pos, size_t n) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < n; i++) {
+        value = (value << 8) | data[pos + i];
+    }
+    return value;
+}
+
+bool IpsPatch::load(const std::string& path) {
+    records_.clear();
+    error_.clear();
+    
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        error_ = "Failed to open: " + path;
+        return false;
+    }
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    
+    // IPS uses 3-byte offsets and "EOF"; IPS32 uses 4-byte offsets and "EEOF"
+    size_t offset_size;
+    const char* footer;
+    size_t pos;
+    if (data.size() >= 5 && std::memcmp(data.data(), "IPS32", 5) == 0) {
+        offset_size = 4;
+        footer = "EEOF";
+        pos = 5;
+    } else if (data.size() >= 5 && std::memcmp(data.data(), "PATCH", 5) == 0) {
+        offset_size = 3;
+        footer = "EOF";
+        pos = 5;
+    } else {
+        error_ = "Not an IPS/IPS32 patch: " + path;
+        return false;
+    }
+    
+    while (true) {
+        if (pos + offset_size > data.size()) {
+            error_ = "Truncated patch (missing footer)";
+            return false;
+        }
+        if (std::memcmp(data.data() + pos, footer, offset_size) == 0) {
+            break;
+        }
+        
+        uint64_t offset = readBe(data, pos, offset_size);
+        pos += offset_size;
+        if (pos + 2 > data.size()) {
+            error_ = "Truncated patch record";
+            return false;
+        }
+        size_t size = readBe(data, pos, 2);
+        pos += 2;
+        
+        PatchRecord record;
+        if (size == 0) {
+            // RLE: 2-byte count, 1-byte value
+            if (pos + 3 > data.size()) {
+                error_ = "Truncated RLE record";
+                return false;
+            }
+            size_t count = readBe(data, pos, 2);
+            record.bytes.assign(count, data[pos + 2]);
+            pos += 3;
+        } else {
+            if (pos + size > data.size()) {
+                error_ = "Truncated patch record";
+                return false;
+            }
+            record.bytes.assign(data.begin() + pos, data.begin() + pos + size);
+            pos += size;
+        }
+        
+        // Records inside the NSO header have nothing to patch in memory
+        if (offset < NSO_HEADER_SIZE) {
+            continue;
+        }
+        record.offset = offset - NSO_HEADER_SIZE;
+        records_.push_back(std::move(record));
+    }
+    
+    return true;
+}
+
+} // namespace kiloader
@@ -0,0 +1,866 @@
+#include "ir.h"
+#include "a64_decoder.h"
+#include "disassembler.h"
+#include <cstdio>
+
+namespace kiloader {
+namespace ir {
+
+namespace {
+
+uint32_t field(uint32_t word, unsigned lo, unsigned bits) {
+    return (word >> lo) & ((1u << bits) - 1);
+}
+
+// General register n; 31 is SP where the encoding allows it, else ZR
+uint8_t gpr(uint32_t n, bool sp) {
+    if (n != 31) {
+        return static_cast<uint8_t>(n);
+    }
+    return sp ? SP : ZR;
+}
+
+uint8_t vreg(uint32_t n) {
+    return static_cast<uint8_t>(V0 + n);
+}
+
+// Statements of one instruction
+class Emitter {
+public:
+    explicit Emitter(Stmt* out) : out_(out) {}
+    
+    Stmt& emit(Op op, uint8_t d, uint8_t a, uint8_t b, uint8_t width) {
+        Stmt& s = out_[count_++];
+        s = Stmt();
+        s.op = op;
+        s.d = d;
+        s.a = a;
+        s.b = b;
+        s.width = width;
+        return s;
+    }
+    
+    Stmt& emitImm(Op op, uint8_t d, uint8_t a, int64_t imm, uint8_t width) {
+        Stmt& s = emit(op, d, a, IMM, width);
+        s.imm = imm;
+        return s;
+    }
+    
+    void reset() { count_ = 0; }
+    size_t count() const { return count_; }
+    
+private:
+    Stmt* out_;
+    size_t count_ = 0;
+};
+
+// DecodeBitMasks for logical immediates
+bool decodeBitMask(uint32_t n, uint32_t imms, uint32_t immr, bool is64, uint64_t& out) {
+    uint32_t combined = (n << 6) | (~imms & 0x3F);
+    int len = -1;
+    for (int i = 6; i >= 0; i--) {
+        if (combined & (1u << i)) {
+            len = i;
+            break;
+        }
+    }
+    if (len < 1 || (!is64 && n != 0)) {
+        return false;
+    }
+    
+    uint32_t size = 1u << len;
+    uint32_t levels = size - 1;
+    uint32_t s = imms & levels;
+    uint32_t r = immr & levels;
+    if (s == levels) {
+        return false;
+    }
+    
+    uint64_t mask = size == 64 ? ~0ULL : (1ULL << size) - 1;
+    uint64_t elem = (1ULL << (s + 1)) - 1;
+    if (r != 0) {
+        elem = ((elem >> r) | (elem << (size - r))) & mask;
+    }
+    uint64_t result = 0;
+    for (uint32_t i = 0; i < 64; i += size) {
+        result |= elem << i;
+    }
+    out = is64 ? result : result & 0xFFFFFFFF;
+    return true;
+}
+
+uint64_t lowBits(uint32_t bits) {
+    return bits >= 64 ? ~0ULL : (1ULL << bits) - 1;
+}
+
+// Register b of a shifted-register operand, shifted with LSL folded into the
+// statement and other shifts or an inversion computed into T0 first
+void shiftedOperand(Emitter& e, uint32_t rm, uint32_t type, uint32_t amount, bool invert, uint8_t width,
+                    uint8_t& reg, uint8_t& shift) {
+    reg = gpr(rm, false);
+    shift = 0;
+    if (type == 0 || amount == 0) {
+        if (!invert) {
+            shift = static_cast<uint8_t>(amount);
+            return;
+        }
+        e.emit(Op::Not, T0, NONE, reg, width).shift = static_cast<uint8_t>(amount);
+        reg = T0;
+        return;
+    }
+    
+    static const Op shifts[] = {Op::Shl, Op::Lsr, Op::Asr, Op::Ror};
+    e.emitImm(shifts[type], T0, reg, amount, width);
+    if (invert) {
+        e.emit(Op::Not, T0, NONE, T0, width);
+    }
+    reg = T0;
+}
+
+bool liftDataImm(uint32_t word, uint64_t address, Emitter& e) {
+    bool sf = (word >> 31) != 0;
+    uint8_t width = sf ? 3 : 2;
+    uint32_t rd = field(word, 0, 5);
+    uint32_t rn = field(word, 5, 5);
+    
+    switch (field(word, 23, 3)) {
+        case 0:
+        case 1: {
+            // ADR, ADRP
+            a64::Decoded dec = a64::decode(word, address);
+            e.emitImm(Op::Mov, gpr(rd, false), NONE, static_cast<int64_t>(dec.target), 3).attrs = IsAddress;
+            return true;
+        }
+        case 2: {
+            // ADD/SUB (immediate); MOV to/from SP is ADD #0
+            bool sub = (word >> 30) & 1;
+            bool flags = (word >> 29) & 1;
+            int64_t imm = static_cast<int64_t>(field(word, 10, 12)) << ((word >> 22) & 1 ? 12 : 0);
+            uint8_t d = gpr(rd, !flags);
+            uint8_t a = gpr(rn, true);
+            if (!sub && !flags && imm == 0) {
+                e.emit(Op::Mov, d, NONE, a, width);
+                return true;
+            }
+            Stmt& s = e.emitImm(sub ? Op::Sub : Op::Add, d, a, imm, width);
+            s.attrs = flags ? SetsFlags : 0;
+            return true;
+        }
+        case 4: {
+            // AND/ORR/EOR/ANDS (immediate)
+            uint32_t opc = field(word, 29, 2);
+            uint64_t imm = 0;
+            if (!decodeBitMask((word >> 22) & 1, field(word, 10, 6), field(word, 16, 6), sf, imm)) {
+                return false;
+            }
+            uint8_t d = gpr(rd, opc != 3);
+            if (opc == 1 && rn == 31) {
+                e.emitImm(Op::Mov, d, NONE, static_cast<int64_t>(imm), width);
+                return true;
+            }
+            static const Op ops[] = {Op::And, Op::Or, Op::Xor, Op::And};
+            Stmt& s = e.emitImm(ops[opc], d, gpr(rn, false), static_cast<int64_t>(imm), width);
+            s.attrs = opc == 3 ? SetsFlags : 0;
+            return true;
+        }
+        case 5: {
+            // MOVN/MOVZ/MOVK
+            uint32_t opc = field(word, 29, 2);
+            uint32_t hw = field(word, 21, 2);
+            if (opc == 1 || (!sf && hw >= 2)) {
+                return false;
+            }
+            uint32_t shift = hw * 16;
+            uint64_t value = static_cast<uint64_t>(field(word, 5, 16)) << shift;
+            uint8_t d = gpr(rd, false);
+            if (opc == 3) {
+                e.emitImm(Op::And, d, d, static_cast<int64_t>(~(0xFFFFULL << shift) & lowBits(8u << width)), width);
+                e.emitImm(Op::Or, d, d, static_cast<int64_t>(value), width);
+                return true;
+            }
+            if (opc == 0) {
+                value = ~value & lowBits(8u << width);
+            }
+            e.emitImm(Op::Mov, d, NONE, static_cast<int64_t>(value), width);
+            return true;
+        }
+        case 6: {
+            // SBFM/BFM/UBFM and their shift and extend aliases
+            uint32_t opc = field(word, 29, 2);
+            uint32_t immr = field(word, 16, 6);
+            uint32_t imms = field(word, 10, 6);
+            uint32_t bits = sf ? 64 : 32;
+            if (opc == 3 || ((word >> 22) & 1) != static_cast<uint32_t>(sf) || immr >= bits || imms >= bits) {
+                return false;
+            }
+            uint8_t d = gpr(rd, false);
+            uint8_t a = gpr(rn, false);
+            if (opc == 0 && imms == bits - 1) {
+                e.emitImm(Op::Asr, d, a, immr, width);
+            } else if (opc == 0 && immr == 0) {
+                e.emitImm(Op::Sext, d, a, imms + 1, width).b = NONE;
+            } else if (opc == 2 && imms == bits - 1) {
+                e.emitImm(Op::Lsr, d, a, immr, width);
+            } else if (opc == 2 && imms + 1 == immr) {
+                e.emitImm(Op::Shl, d, a, bits - 1 - imms, width);
+            } else if (opc == 2 && imms >= immr) {
+                // UBFX (UXTB/UXTH when immr is 0)
+                uint8_t src = a;
+                if (immr != 0) {
+                    e.emitImm(Op::Lsr, T0, a, immr, width);
+                    src = T0;
+                }
+                e.emitImm(Op::And, d, src, static_cast<int64_t>(lowBits(imms - immr + 1)), width);
+            } else if (opc == 2) {
+                // UBFIZ
+                e.emitImm(Op::And, T0, a, static_cast<int64_t>(lowBits(imms + 1)), width);
+                e.emitImm(Op::Shl, d, T0, bits - immr, width);
+            } else {
+                e.emit(Op::Clobber, d, NONE, NONE, width);
+            }
+            return true;
+        }
+        case 7: {
+            // EXTR; ROR (immediate) when both sources match
+            uint32_t rm = field(word, 16, 5);
+            uint32_t imms = field(word, 10, 6);
+            if (((word >> 22) & 1) != static_cast<uint32_t>(sf) || (!sf && imms >= 32)) {
+                return false;
+            }
+            if (rn == rm) {
+                e.emitImm(Op::Ror, gpr(rd, false), gpr(rn, false), imms, width);
+            } else {
+                e.emit(Op::Clobber, gpr(rd, false), NONE, NONE, width);
+            }
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+bool liftBranchSys(uint32_t word, uint64_t address, Emitter& e) {
+    a64::Decoded dec = a64::decode(word, address);
+    int64_t target = static_cast<int64_t>(dec.target);
+    uint8_t width = dec.is64 ? 3 : 2;
+    
+    switch (dec.op) {
+        case a64::Op::B:
+            e.emitImm(Op::Jump, NONE, NONE, target, 3);
+            return true;
+        case a64::Op::Bl:
+            e.emitImm(Op::Call, NONE, NONE, target, 3);
+            return true;
+        case a64::Op::BCond:
+            // AL and NV always branch
+            e.emitImm(dec.cond >= 0xE ? Op::Jump : Op::JumpCond, NONE, NONE, target, 3).cond = dec.cond;
+            return true;
+        case a64::Op::Cbz:
+        case a64::Op::Cbnz:
+            e.emitImm(dec.op == a64::Op::Cbz ? Op::JumpZero : Op::JumpNonZero, NONE, gpr(dec.rd, false), target, width);
+            return true;
+        case a64::Op::Tbz:
+        case a64::Op::Tbnz:
+            e.emitImm(dec.op == a64::Op::Tbz ? Op::JumpBitClear : Op::JumpBitSet, NONE, gpr(dec.rd, false), target,
+                      width).cond = dec.cond;
+            return true;
+        case a64::Op::Br:
+            e.emit(Op::JumpReg, NONE, gpr(dec.rn, false), NONE, 3);
+            return true;
+        case a64::Op::Blr:
+            e.emit(Op::CallReg, NONE, gpr(dec.rn, false), NONE, 3);
+            return true;
+        case a64::Op::Ret:
+            // RETAA/RETAB encode Rn as 31 but return to LR
+            e.emit(Op::Ret, NONE, dec.rn == 31 ? static_cast<uint8_t>(LR) : dec.rn, NONE, 3);
+            return true;
+        default:
+            break;
+    }
+    
+    uint32_t rt = field(word, 0, 5);
+    if ((word & 0xFFE0001F) == 0xD4000001) {
+        e.emitImm(Op::Syscall, NONE, NONE, field(word, 5, 16), 3);
+    } else if ((word & 0xFFE0001F) == 0xD4200000) {
+        e.emitImm(Op::Trap, NONE, NONE, field(word, 5, 16), 3);
+    } else if ((word & 0xFFFFF01F) == 0xD503201F || (word & 0xFFFFF01F) == 0xD503301F ||
+               (word & 0xFFF8F01F) == 0xD500401F) {
+        // Hints (NOP, PACIASP, BTI, ...), barriers, MSR to PSTATE
+        e.emit(Op::Nop, NONE, NONE, NONE, 3);
+    } else if ((word & 0xFFF00000) == 0xD5300000) {
+        e.emitImm(Op::ReadSys, gpr(rt, false), NONE, field(word, 5, 15), 3).b = NONE;
+    } else if ((word & 0xFFF00000) == 0xD5100000) {
+        e.emitImm(Op::WriteSys, NONE, gpr(rt, false), field(word, 5, 15), 3).b = NONE;
+    } else if ((word & 0xFFF80000) == 0xD5280000) {
+        e.emit(Op::Clobber, gpr(rt, false), NONE, NONE, 3);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Operation, width and register of a single-register load/store from its
+// size:V:opc fields
+struct Access {
+    Op op;
+    uint8_t width;
+    uint8_t reg;
+    uint8_t attrs;
+};
+
+bool singleAccess(uint32_t size, bool vector, uint32_t opc, uint32_t rt, Access& out) {
+    out.attrs = 0;
+    if (vector) {
+        // opc<1> selects the 128-bit form
+        out.width = static_cast<uint8_t>(size | ((opc & 2) << 1));
+        out.op = (opc & 1) ? Op::Load : Op::Store;
+        out.reg = vreg(rt);
+        return out.width <= 4;
+    }
+    
+    out.width = static_cast<uint8_t>(size);
+    out.reg = gpr(rt, false);
+    switch (opc) {
+        case 0:
+            out.op = Op::Store;
+            return true;
+        case 1:
+            out.op = Op::Load;
+            return true;
+        case 2:
+            // PRFM in the 64-bit slot, otherwise LDRS* into X
+            out.op = size == 3 ? Op::Nop : Op::Load;
+            out.attrs = size == 3 ? 0 : Signed;
+            return true;
+        default:
+            out.op = Op::Load;
+            out.attrs = Signed | Dest32;
+            return size < 2;
+    }
+}
+
+Stmt& emitAccess(Emitter& e, const Access& acc, uint8_t base, int64_t offset) {
+    if (acc.op == Op::Nop) {
+        return e.emit(Op::Nop, NONE, NONE, NONE, 3);
+    }
+    Stmt& s = e.emitImm(acc.op, acc.reg, base, offset, acc.width);
+    s.attrs = acc.attrs;
+    return s;
+}
+
+// [base + offset] with pre- or post-index writeback of base
+void emitIndexed(Emitter& e, const Access& acc, uint8_t base, int64_t offset, uint32_t kind) {
+    if (kind == 1) {
+        emitAccess(e, acc, base, 0);
+        e.emitImm(Op::Add, base, base, offset, 3);
+    } else if (kind == 3) {
+        e.emitImm(Op::Add, base, base, offset, 3);
+        emitAccess(e, acc, base, 0);
+    } else {
+        emitAccess(e, acc, base, offset);
+    }
+}
+
+bool liftLoadStore(uint32_t word, uint64_t address, Emitter& e) {
+    uint32_t size = word >> 30;
+    bool vector = (word >> 26) & 1;
+    uint32_t opc = field(word, 22, 2);
+    uint32_t rt = field(word, 0, 5);
+    uint8_t base = gpr(field(word, 5, 5), true);
+    Access acc;
+    
+    // LDR/STR (unsigned offset)
+    if ((word & 0x3B000000) == 0x39000000) {
+        if (!singleAccess(size, vector, opc, rt, acc)) {
+            return false;
+        }
+        emitAccess(e, acc, base, static_cast<int64_t>(field(word, 10, 12)) << acc.width);
+        return true;
+    }
+    
+    // LDUR/STUR, LDTR/STTR, pre- and post-indexed
+    if ((word & 0x3B200000) == 0x38000000) {
+        if (!singleAccess(size, vector, opc, rt, acc)) {
+            return false;
+        }
+        uint32_t kind = field(word, 10, 2);
+        emitIndexed(e, acc, base, a64::signExtend(field(word, 12, 9), 9), kind == 2 ? 0 : kind);
+        return true;
+    }
+    
+    // LDR/STR (register offset)
+    if ((word & 0x3B200C00) == 0x38200800) {
+        if (!singleAccess(size, vector, opc, rt, acc)) {
+            return false;
+        }
+        uint32_t option = field(word, 13, 3);
+        uint8_t attrs = 0;
+        if (option == 2) {
+            attrs = ExtendUxtw;
+        } else if (option == 6) {
+            attrs = ExtendSxtw;
+        } else if (option != 3 && option != 7) {
+            return false;
+        }
+        if (acc.op == Op::Nop) {
+            emitAccess(e, acc, base, 0);
+            return true;
+        }
+        Stmt& s = e.emit(acc.op, acc.reg, base, gpr(field(word, 16, 5), false), acc.width);
+        s.shift = ((word >> 12) & 1) ? acc.width : 0;
+        s.attrs = acc.attrs | attrs;
+        return true;
+    }
+    
+    // Atomic memory operations (LDADD, SWP, ...) and LDAPR
+    if ((word & 0x3F200C00) == 0x38200000) {
+        bool o3 = (word >> 15) & 1;
+        uint32_t op = field(word, 12, 3);
+        uint8_t width = static_cast<uint8_t>(size);
+        e.emitImm(Op::Load, gpr(rt, false), base, 0, width);
+        if (!(o3 && op == 4)) {
+            // SWP stores Rs; the others store a value computed from the old one
+            uint8_t value = o3 && op == 0 ? gpr(field(word, 16, 5), false) : static_cast<uint8_t>(NONE);
+            e.emitImm(Op::Store, value, base, 0, width);
+        }
+        return true;
+    }
+    
+    // LDP/STP (all indexing modes), LDPSW
+    if ((word & 0x3A000000) == 0x28000000) {
+        bool load = (word >> 22) & 1;
+        uint32_t scale;
+        uint8_t attrs = 0;
+        if (vector) {
+            scale = 2 + size;
+        } else if (size == 0 || size == 2) {
+            scale = 2 + size / 2;
+        } else if (size == 1 && load) {
+            scale = 2;
+            attrs = Signed;
+        } else {
+            return false;
+        }
+        if (scale > 4) {
+            return false;
+        }
+        
+        uint32_t kind = field(word, 23, 2);
+        int64_t offset = a64::signExtend(field(word, 15, 7), 7) << scale;
+        int64_t first = kind == 1 || kind == 3 ? 0 : offset;
+        uint32_t rt2 = field(word, 10, 5);
+        Op op = load ? Op::Load : Op::Store;
+        uint8_t width = static_cast<uint8_t>(scale);
+        
+        if (kind == 3) {
+            e.emitImm(Op::Add, base, base, offset, 3);
+        }
+        e.emitImm(op, vector ? vreg(rt) : gpr(rt, false), base, first, width).attrs = attrs;
+        e.emitImm(op, vector ? vreg(rt2) : gpr(rt2, false), base, first + (1LL << scale), width).attrs = attrs;
+        if (kind == 1) {
+            e.emitImm(Op::Add, base, base, offset, 3);
+        }
+        return true;
+    }
+    
+    // LDR (literal), PRFM (literal)
+    if ((word & 0x3B000000) == 0x18000000) {
+        int64_t target = static_cast<int64_t>(address) + (a64::signExtend(field(word, 5, 19), 19) << 2);
+        if (vector) {
+            if (size == 3) {
+                return false;
+            }
+            e.emitImm(Op::Load, vreg(rt), NONE, target, static_cast<uint8_t>(size + 2));
+        } else if (size == 3) {
+            e.emit(Op::Nop, NONE, NONE, NONE, 3);
+        } else {
+            Stmt& s = e.emitImm(Op::Load, gpr(rt, false), NONE, target, size == 1 ? 3 : 2);
+            s.attrs = size == 2 ? Signed : 0;
+        }
+        return true;
+    }
+    
+    // Exclusive and ordered loads/stores, CAS
+    if ((word & 0x3F000000) == 0x08000000) {
+        bool o2 = (word >> 23) & 1;
+        bool load = (word >> 22) & 1;
+        bool o1 = (word >> 21) & 1;
+        uint8_t rs = gpr(field(word, 16, 5), false);
+        uint8_t width = static_cast<uint8_t>(size);
+        if (o1 && !o2 && size < 2) {
+            return false;   // CASP
+        }
+        if (o1 && o2) {
+            e.emitImm(Op::Load, rs, base, 0, width);
+            e.emitImm(Op::Store, gpr(rt, false), base, 0, width);
+            return true;
+        }
+        
+        bool pair = o1;
+        if (pair) {
+            width = static_cast<uint8_t>(size == 3 ? 3 : 2);
+        }
+        Op op = load ? Op::Load : Op::Store;
+        e.emitImm(op, gpr(rt, false), base, 0, width);
+        if (pair) {
+            e.emitImm(op, gpr(field(word, 10, 5), false), base, 1LL << width, width);
+        }
+        if (!load && !o2) {
+            e.emit(Op::Clobber, rs, NONE, NONE, 2);    // Exclusive store status
+        }
+        return true;
+    }
+    
+    // LDAPUR/STLUR
+    if ((word & 0x3F200C00) == 0x19000000) {
+        if (!singleAccess(size, false, opc, rt, acc)) {
+            return false;
+        }
+        emitAccess(e, acc, base, a64::signExtend(field(word, 12, 9), 9));
+        return true;
+    }
+    
+    // LDRAA/LDRAB
+    if ((word & 0xFF200400) == 0xF8200400) {
+        int64_t offset = a64::signExtend((((word >> 22) & 1) << 9) | field(word, 12, 9), 10) << 3;
+        acc = {Op::Load, 3, gpr(rt, false), 0};
+        emitIndexed(e, acc, base, offset, ((word >> 11) & 1) ? 3 : 0);
+        return true;
+    }
+    
+    // LD1..LD4/ST1..ST4 (multiple or single structures)
+    if ((word & 0xBE000000) == 0x0C000000) {
+        bool load = (word >> 22) & 1;
+        e.emitImm(load ? Op::Load : Op::Store, vreg(rt), base, 0, ((word >> 30) & 1) ? 4 : 3);
+        if ((word >> 23) & 1) {
+            e.emit(Op::Clobber, base, NONE, NONE, 3);
+        }
+        return true;
+    }
+    
+    return false;
+}
+
+bool liftDataReg(uint32_t word, Emitter& e) {
+    bool sf = (word >> 31) != 0;
+    uint8_t width = sf ? 3 : 2;
+    uint32_t rd = field(word, 0, 5);
+    uint32_t rn = field(word, 5, 5);
+    uint32_t rm = field(word, 16, 5);
+    bool flags = (word >> 29) & 1;
+    uint8_t b = NONE;
+    uint8_t shift = 0;
+    
+    // AND/BIC/ORR/ORN/EOR/EON/ANDS/BICS (shifted register); MOV and MVN
+    if ((word & 0x1F000000) == 0x0A000000) {
+        uint32_t opc = field(word, 29, 2);
+        uint32_t type = field(word, 22, 2);
+        uint32_t amount = field(word, 10, 6);
+        bool invert = (word >> 21) & 1;
+        if (!sf && amount >= 32) {
+            return false;
+        }
+        uint8_t d = gpr(rd, false);
+        if (opc == 1 && rn == 31) {
+            shiftedOperand(e, rm, type, amount, false, width, b, shift);
+            e.emit(invert ? Op::Not : Op::Mov, d, NONE, b, width).shift = shift;
+            return true;
+        }
+        shiftedOperand(e, rm, type, amount, invert, width, b, shift);
+        static const Op ops[] = {Op::And, Op::Or, Op::Xor, Op::And};
+        Stmt& s = e.emit(ops[opc], d, gpr(rn, false), b, width);
+        s.shift = shift;
+        s.attrs = opc == 3 ? SetsFlags : 0;
+        return true;
+    }
+    
+    // ADD/SUB/ADDS/SUBS (shifted register); CMP, CMN, NEG
+    if ((word & 0x1F200000) == 0x0B000000) {
+        uint32_t type = field(word, 22, 2);
+        uint32_t amount = field(word, 10, 6);
+        if (type == 3 || (!sf && amount >= 32)) {
+            return false;
+        }
+        shiftedOperand(e, rm, type, amount, false, width, b, shift);
+        Stmt& s = e.emit((word >> 30) & 1 ? Op::Sub : Op::Add, gpr(rd, false), gpr(rn, false), b, width);
+        s.shift = shift;
+        s.attrs = flags ? SetsFlags : 0;
+        return true;
+    }
+    
+    // ADD/SUB/ADDS/SUBS (extended register)
+    if ((word & 0x1F200000) == 0x0B200000) {
+        uint32_t option = field(word, 13, 3);
+        uint32_t amount = field(word, 10, 3);
+        if (field(word, 22, 2) != 0 || amount > 4) {
+            return false;
+        }
+        uint8_t attrs = flags ? SetsFlags : 0;
+        b = gpr(rm, false);
+        if ((option & 3) == 3 || (!sf && (option & 3) == 2)) {
+            // UXTX/SXTX, or UXTW/SXTW on a 32-bit operation: plain LSL
+        } else if (option == 2) {
+            attrs |= ExtendUxtw;
+        } else if (option == 6) {
+            attrs |= ExtendSxtw;
+        } else if (option & 4) {
+            e.emitImm(Op::Sext, T0, b, (option & 1) ? 16 : 8, width).b = NONE;
+            b = T0;
+        } else {
+            e.emitImm(Op::And, T0, b, (option & 1) ? 0xFFFF : 0xFF, width);
+            b = T0;
+        }
+        Stmt& s = e.emit((word >> 30) & 1 ? Op::Sub : Op::Add, gpr(rd, !flags), gpr(rn, true), b, width);
+        s.shift = static_cast<uint8_t>(amount);
+        s.attrs = attrs;
+        return true;
+    }
+    
+    // ADC/SBC and friends: result and flags not modelled
+    if ((word & 0x1FE00000) == 0x1A000000) {
+        e.emit(Op::Clobber, gpr(rd, false), NONE, NONE, width);
+        if (flags) {
+            e.emit(Op::Clobber, FLAGS, NONE, NONE, 3);
+        }
+        return true;
+    }
+    
+    // CCMP/CCMN
+    if ((word & 0x1FE00000) == 0x1A400000) {
+        e.emit(Op::Clobber, FLAGS, NONE, NONE, 3);
+        return true;
+    }
+    
+    // CSEL/CSINC/CSINV/CSNEG; CSET, CSETM, CINC, CNEG, ...
+    if ((word & 0x1FE00000) == 0x1A800000) {
+        uint32_t kind = (((word >> 30) & 1) << 1) | field(word, 10, 2);
+        if (flags || field(word, 10, 2) > 1) {
+            return false;
+        }
+        uint8_t cond = static_cast<uint8_t>(field(word, 12, 4));
+        uint8_t a = gpr(rn, false);
+        b = gpr(rm, false);
+        if ((kind == 1 || kind == 2) && rn == 31 && rm == 31) {
+            // CSET (1) / CSETM (-1)
+            int64_t value = kind == 1 ? 1 : static_cast<int64_t>(lowBits(8u << width));
+            Stmt& s = e.emitImm(Op::Select, gpr(rd, false), ZR, value, width);
+            s.cond = cond;
+            return true;
+        }
+        if (kind == 1) {
+            e.emitImm(Op::Add, T0, b, 1, width);
+            b = T0;
+        } else if (kind == 2) {
+            e.emit(Op::Not, T0, NONE, b, width);
+            b = T0;
+        } else if (kind == 3) {
+            e.emit(Op::Sub, T0, ZR, b, width);
+            b = T0;
+        }
+        e.emit(Op::Select, gpr(rd, false), a, b, width).cond = cond;
+        return true;
+    }
+    
+    // MADD/MSUB (MUL, MNEG); the long and high multiplies are not modelled
+    if ((word & 0x1F000000) == 0x1B000000) {
+        uint32_t op31 = field(word, 21, 3);
+        bool sub = (word >> 15) & 1;
+        uint32_t ra = field(word, 10, 5);
+        if (field(word, 29, 2) != 0) {
+            return false;
+        }
+        uint8_t d = gpr(rd, false);
+        if (op31 != 0) {
+            e.emit(Op::Clobber, d, NONE, NONE, 3);
+        } else if (ra == 31 && !sub) {
+            e.emit(Op::Mul, d, gpr(rn, false), gpr(rm, false), width);
+        } else {
+            e.emit(Op::Mul, T0, gpr(rn, false), gpr(rm, false), width);
+            e.emit(sub ? Op::Sub : Op::Add, d, gpr(ra, false), T0, width);
+        }
+        return true;
+    }
+    
+    // UDIV/SDIV/LSLV/LSRV/ASRV/RORV; CRC32 and PAC operations are not modelled
+    if ((word & 0x5FE00000) == 0x1AC00000) {
+        Op op;
+        switch (field(word, 10, 6)) {
+            case 2: op = Op::UDiv; break;
+            case 3: op = Op::SDiv; break;
+            case 8: op = Op::Shl; break;
+            case 9: op = Op::Lsr; break;
+            case 10: op = Op::Asr; break;
+            case 11: op = Op::Ror; break;
+            default: op = Op::Clobber; break;
+        }
+        if (op == Op::Clobber) {
+            e.emit(op, gpr(rd, false), NONE, NONE, width);
+        } else {
+            e.emit(op, gpr(rd, false), gpr(rn, false), gpr(rm, false), width);
+        }
+        return true;
+    }
+    
+    // RBIT/REV/CLZ/CLS, PACIA/AUTIA/...
+    if ((word & 0x5FE00000) == 0x5AC00000) {
+        e.emit(Op::Clobber, gpr(rd, false), NONE, NONE, width);
+        return true;
+    }
+    
+    return false;
+}
+
+bool liftSimd(uint32_t word, Emitter& e) {
+    uint32_t rd = field(word, 0, 5);
+    
+    // FP <-> integer conversions and FMOV between register files
+    if ((word & 0x5F20FC00) == 0x1E200000) {
+        uint32_t opcode = field(word, 16, 3);
+        bool to_gpr = opcode <= 1 || opcode == 4 || opcode == 5 || opcode == 6;
+        if (to_gpr) {
+            e.emit(Op::Clobber, gpr(rd, false), NONE, NONE, (word >> 31) ? 3 : 2);
+        } else {
+            e.emit(Op::Clobber, vreg(rd), NONE, NONE, 3);
+        }
+        return true;
+    }
+    
+    // FP <-> fixed-point: FCVTZS/FCVTZU write a general register,
+    // SCVTF/UCVTF a vector register
+    if ((word & 0x5F200000) == 0x1E000000) {
+        if (field(word, 16, 3) <= 1) {
+            e.emit(Op::Clobber, gpr(rd, false), NONE, NONE, (word >> 31) ? 3 : 2);
+        } else {
+            e.emit(Op::Clobber, vreg(rd), NONE, NONE, 3);
+        }
+        return true;
+    }
+    
+    // FCMP/FCMPE, FCCMP/FCCMPE
+    if ((word & 0xFF20FC07) == 0x1E202000 || (word & 0xFF200C00) == 0x1E200400) {
+        e.emit(Op::Clobber, FLAGS, NONE, NONE, 3);
+        return true;
+    }
+    
+    // UMOV/SMOV
+    if ((word & 0xBFE0FC00) == 0x0E003C00 || (word & 0xBFE0FC00) == 0x0E002C00) {
+        e.emit(Op::Clobber, gpr(rd, false), NONE, NONE, (word >> 30) & 1 ? 3 : 2);
+        return true;
+    }
+    
+    // The rest of Advanced SIMD (vector, scalar, crypto) and of scalar FP
+    // data processing (1-3 source, FCSEL, FMOV immediate) writes only its
+    // vector destination
+    bool simd = (word & 0x9E000000) == 0x0E000000 || (word & 0xDE000000) == 0x5E000000;
+    bool fp = (word & 0x7F200000) == 0x1E200000 || (word & 0x7F000000) == 0x1F000000;
+    if (simd || fp) {
+        e.emit(Op::Clobber, vreg(rd), NONE, NONE, 4);
+        return true;
+    }
+    return false;
+}
+
+} // namespace
+
+size_t lift(uint32_t word, uint64_t address, Stmt* out) {
+    Emitter e(out);
+    uint32_t op0 = field(word, 25, 4);
+    
+    bool lifted;
+    if ((op0 & 0xE) == 0x8) {
+        lifted = liftDataImm(word, address, e);
+    } else if ((op0 & 0xE) == 0xA) {
+        lifted = liftBranchSys(word, address, e);
+    } else if ((op0 & 0x5) == 0x4) {
+        lifted = liftLoadStore(word, address, e);
+    } else if ((op0 & 0x7) == 0x5) {
+        lifted = liftDataReg(word, e);
+    } else if ((op0 & 0x7) == 0x7) {
+        lifted = liftSimd(word, e);
+    } else if ((word >> 16) == 0) {
+        // UDF
+        e.emitImm(Op::Trap, NONE, NONE, word & 0xFFFF, 3);
+        lifted = true;
+    } else {
+        lifted = false;
+    }
+    
+    if (!lifted) {
+        e.reset();
+        e.emit(Op::Unknown, NONE, NONE, NONE, 3);
+    }
+    return e.count();
+}
+
+void liftInstructions(const std::vector<Instruction>& insns, uint64_t base, std::vector<Stmt>& out) {
+    out.reserve(out.size() + insns.size() + insns.size() / 4);
+    Stmt stmts[MAX_STMTS];
+    for (const auto& insn : insns) {
+        size_t n = lift(insn.word, insn.address, stmts);
+        uint32_t offset = static_cast<uint32_t>(insn.address - base);
+        for (size_t i = 0; i < n; i++) {
+            stmts[i].offset = offset;
+            out.push_back(stmts[i]);
+        }
+    }
+}
+
+const char* opName(Op op) {
+    static const char* const names[] = {
+        "nop", "unknown", "clobber", "mov", "add", "sub", "mul", "udiv", "sdiv",
+        "and", "or", "xor", "not", "shl", "lsr", "asr", "ror", "sext", "select",
+        "load", "store", "readsys", "writesys", "jump", "jumpcond", "jumpzero",
+        "jumpnonzero", "jumpbitclear", "jumpbitset", "jumpreg", "call", "callreg",
+        "ret", "syscall", "trap"
+    };
+    static_assert(sizeof(names) / sizeof(names[0]) == static_cast<size_t>(Op::Count), "opName table out of date");
+    return names[static_cast<size_t>(op)];
+}
+
+const char* condName(uint8_t cond) {
+    static const char* const names[] = {
+        "eq", "ne", "hs", "lo", "mi", "pl", "vs", "vc",
+        "hi", "ls", "ge", "lt", "gt", "le", "al", "nv"
+    };
+    return names[cond & 0xF];
+}
+
+const char* regName(uint8_t reg, uint8_t width) {
+    // Built once: [width 0..4][register]
+    struct Names {
+        char text[5][96][8];
+        
+        Names() {
+            static const char prefixes[] = "bhsdq";
+            for (int w = 0; w < 5; w++) {
+                for (int r = 0; r < 96; r++) {
+                    char* out = text[w][r];
+                    const char* gp = w == 3 ? "x" : "w";
+                    if (r < 31) {
+                        std::snprintf(out, 8, "%s%d", gp, r);
+                    } else if (r == SP) {
+                        std::snprintf(out, 8, "%s", w == 3 ? "sp" : "wsp");
+                    } else if (r == ZR) {
+                        std::snprintf(out, 8, "%szr", gp);
+                    } else if (r == FLAGS) {
+                        std::snprintf(out, 8, "nzcv");
+                    } else if (r == T0) {
+                        std::snprintf(out, 8, "t0");
+                    } else if (r >= V0) {
+                        std::snprintf(out, 8, "%c%d", prefixes[w], r - V0);
+                    } else {
+                        std::snprintf(out, 8, "?");
+                    }
+                }
+            }
+        }
+    };
+    static const Names names;
+    
+    if (reg == IMM) return "#imm";
+    if (reg >= 96) return "-";
+    return names.text[width > 4 ? 4 : width][reg];
+}
+
+} // namespace ir
+} // namespace kiloader
@@ -1,7 +1,11 @@
 #include "analyzer.h"
 #include "gui/app.h"
 #include "progress_manager.h"
+#include "bench.h"
+#include "nso_writer.h"
+#include "inventory.h"
 #include <iostream>
+#include <fstream>
 #include <sstream>
 #include <iomanip>
 #include <algorithm>
@@ -14,11 +18,18 @@ void printUsage() {
 KILOADER - Nintendo Switch NSO Analyzer
 ========================================
 
-Usage: kiloader [options] [file.nso]
+Usage: kiloader [options] [file.nso | exefs_dir]
+       kiloader bench <load|scan|disasm|decode|format|analyze|lookup|classify> <file.nso> [iterations]
+       kiloader repack <in.nso> <out.nso> [--hc] [--uncompressed] [--patch file.ips]...
+       kiloader inventory <dir> [index.tsv] [--find <build id prefix>]
 
 Options:
   --cli           Use command-line interface instead of GUI
   -a              Auto-analyze after loading
+  --no-mmap       Read the file into memory instead of mapping it
+  --verify        Check segment SHA-256 hashes while loading
+  --eager         Decompress all segments at load instead of on first use
+  --cache         Cache decompressed segments in the progress directory
   -h, --help      Show this help
 
 Examples:
@@ -27,6 +38,7 @@ Examples:
   kiloader --cli               # Interactive CLI mode
   kiloader --cli main.nso      # Load NSO and enter CLI mode
   kiloader --cli main.nso -a   # Load, analyze, and enter CLI mode
+  kiloader --cli exefs/ -a     # Load rtld/main/subsdk*/sdk together and analyze
 
 )";
 }
@@ -37,9 +49,13 @@ KILOADER - Nintendo Switch NSO Analyzer
 ========================================
 
 Commands:
-  load <path>           Load an NSO file
+  load <path>           Load an NSO file or ExeFS directory
   analyze               Run full analysis (functions, strings, xrefs)
   save                  Save analysis progress
+  patch <file.ips>      Apply an IPS/IPS32 patch (reanalyzes touched code)
+  patch <addr> <hex>    Overwrite bytes at address, e.g. patch 0x7100001000 1F2003D5
+  unpatch               Revert all patches
+  repack <path> [--hc]  Write the (patched) main module as a new NSO
   
   disasm <addr> [n]     Disassemble n instructions at address
   func <addr|name>      Show function at address or by name (e.g. FUN_7104e53010)
@@ -66,7 +82,8 @@ Commands:
   quit                  Exit
 
 Addresses can be in hex (0x...) or decimal.
-Function names can be like: FUN_7104e53010 or sub_7104e53010
+Function names can be like: FUN_7104e53010 or sub_7104e53010,
+or any exported symbol name (e.g. nnMain)
 )";
 }
 
@@ -122,9 +139,15 @@ uint64_t parseFunctionName(const std::string& s) {
 }
 
 // Parse input that could be either an address or function name
-uint64_t parseAddressOrName(const std::string& s) {
-    // First try as function name
-    uint64_t addr = parseFunctionName(s);
+uint64_t parseAddressOrName(const std::string& s, Analyzer& analyzer) {
+    // Symbol or assigned name (hashed lookup)
+    uint64_t addr = analyzer.findFunctionByName(s);
+    if (addr != 0) {
+        return addr;
+    }
+    
+    // Then a generated FUN_/sub_ name
+    addr = parseFunctionName(s);
     if (addr != 0) {
         return addr;
     }
@@ -133,11 +156,142 @@ uint64_t parseAddressOrName(const std::string& s) {
     return parseAddress(s);
 }
 
+void printWriteReport(const NsoWriter& writer, const std::string& path) {
+    const NsoWriteStats& stats = writer.getStats();
+    static const char* names[3] = {"text", "rodata", "data"};
+    
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "Wrote " << path << " (" << stats.file_size / 1024.0 << " KB)\n";
+    for (int i = 0; i < 3; i++) {
+        const NsoWriteSegmentStats& seg = stats.segments[i];
+        std::cout << "  " << std::left << std::setw(7) << names[i] << std::right
+                  << std::setw(10) << seg.size << " -> " << std::setw(10) << seg.stored_size;
+        if (seg.compressed) {
+            std::cout << "  lz4 " << seg.compress_ms << " ms";
+        }
+        std::cout << "  sha256 " << seg.hash_ms << " ms\n";
+    }
+    std::cout << "  Encode " << stats.encode_ms << " ms, write " << stats.write_ms << " ms, total "
+              << stats.total_ms << " ms (" << stats.getThroughputMBps() << " MB/s)\n";
+    std::cout << std::defaultfloat;
+}
+
+// Parse repack flags (--hc, --uncompressed); returns false on an unknown one
+bool parseWriteOption(const std::string& arg, NsoWriteOptions& options) {
+    if (arg == "--hc") {
+        options.high_compression = true;
+    } else if (arg == "--uncompressed") {
+        options.compress = false;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// kiloader repack <in> <out> [options]: load, apply patches, write back
+int runRepack(const std::vector<std::string>& args) {
+    if (args.size() < 2) {
+        std::cout << "Usage: kiloader repack <in.nso> <out.nso> [--hc] [--uncompressed] [--patch file.ips]...\n";
+        return 1;
+    }
+    
+    NsoWriteOptions options;
+    std::vector<std::string> patches;
+    for (size_t i = 2; i < args.size(); i++) {
+        if (args[i] == "--patch" && i + 1 < args.size()) {
+            patches.push_back(args[++i]);
+        } else if (!parseWriteOption(args[i], options)) {
+            std::cerr << "Unknown option: " << args[i] << "\n";
+            return 1;
+        }
+    }
+    
+    AddressSpace space;
+    if (!space.loadNso(args[0])) {
+        std::cerr << "Failed to load: " << space.getError() << "\n";
+        return 1;
+    }
+    for (const auto& patch : patches) {
+        if (!space.applyPatchFile(patch)) {
+            std::cerr << "Failed to apply " << patch << ": " << space.getError() << "\n";
+            return 1;
+        }
+    }
+    
+    NsoWriter writer;
+    if (!writer.write(space.getMainModule(), args[1], options)) {
+        std::cerr << "Failed to write: " << writer.getError() << "\n";
+        return 1;
+    }
+    printWriteReport(writer, args[1]);
+    return 0;
+}
+
+// kiloader inventory <dir> [index.tsv] [--find prefix]: header-only index
+int runInventory(const std::vector<std::string>& args) {
+    if (args.empty()) {
+        std::cout << "Usage: kiloader inventory <dir> [index.tsv] [--find <build id prefix>]\n";
+        return 1;
+    }
+    
+    std::string out_path, find;
+    for (size_t i = 1; i < args.size(); i++) {
+        if (args[i] == "--find" && i + 1 < args.size()) {
+            find = args[++i];
+        } else {
+            out_path = args[i];
+        }
+    }
+    
+    Inventory inventory;
+    if (!inventory.scan(args[0])) {
+        std::cerr << inventory.getError() << "\n";
+        return 1;
+    }
+    
+    if (!find.empty()) {
+        for (const InventoryEntry* entry : inventory.findByBuildId(find)) {
+            std::cout << entry->build_id << "  " << entry->path << "\n";
+        }
+    } else if (out_path.empty()) {
+        inventory.writeIndex(std::cout);
+    } else {
+        std::ofstream out(out_path);
+        if (!out || !inventory.writeIndex(out)) {
+            std::cerr << "Failed to write: " << out_path << "\n";
+            return 1;
+        }
+    }
+    
+    // Summary on stderr so the index can be piped
+    double secs = inventory.getScanMs() / 1000.0;
+    std::cerr << std::fixed << std::setprecision(1) << "Indexed " << inventory.getEntries().size()
+              << " NSOs (" << inventory.getFileCount() << " files) in " << inventory.getScanMs() << " ms";
+    if (secs > 0) {
+        std::cerr << ", " << std::setprecision(0) << inventory.getFileCount() / secs << " files/s";
+    }
+    std::cerr << "\n" << std::defaultfloat;
+    return 0;
+}
+
 int main(int argc, char* argv[]) {
+    // Benchmarks, repacking and inventory take over the whole command line
+    if (argc > 1 && std::string(argv[1]) == "bench") {
+        return runBench(std::vector<std::string>(argv + 2, argv + argc));
+    }
+    if (argc > 1 && std::string(argv[1]) == "repack") {
+        return runRepack(std::vector<std::string>(argv + 2, argv + argc));
+    }
+    if (argc > 1 && std::string(argv[1]) == "inventory") {
+        return runInventory(std::vector<std::string>(argv + 2, argv + argc));
+    }
+    
     // Parse command line arguments
     bool cli_mode = false;
     bool auto_analyze = false;
+    NsoLoadOptions load_options;
     std::string nso_path;
+    bool use_cache = false;
     
     for (int i = 1; i < argc; i++) {
         std::string arg = argv[i];
@@ -148,6 +302,14 @@ int main(int argc, char* argv[]) {
             cli_mode = false;  // Explicit GUI (though it's default)
         } else if (arg == "-a") {
             auto_analyze = true;
+        } else if (arg == "--no-mmap") {
+            load_options.use_mmap = false;
+        } else if (arg == "--verify") {
+            load_options.verify_hashes = true;
+        } else if (arg == "--eager") {
+            load_options.lazy = false;
+        } else if (arg == "--cache") {
+            use_cache = true;
         } else if (arg == "-h" || arg == "--help") {
             printUsage();
             return 0;
@@ -156,9 +318,18 @@ int main(int argc, char* argv[]) {
         }
     }
     
+    // Decompressed segments go next to the saved progress of the same build
+    if (use_cache) {
+        ProgressManager pm;
+        load_options.cache_dir = [pm](const std::string& build_id) {
+            return pm.getProgressDir(build_id);
+        };
+    }
+    
     // GUI Mode (default)
     if (!cli_mode) {
         gui::App app;
+        app.getAnalyzer().setLoadOptions(load_options);
         
         if (!nso_path.empty()) {
             app.loadNsoFile(nso_path);
@@ -173,6 +344,7 @@ int main(int argc, char* argv[]) {
     std::cout << "========================================\n\n";
     
     Analyzer analyzer;
+    analyzer.setLoadOptions(load_options);
     
     // If path provided, load it
     if (!nso_path.empty()) {
@@ -232,13 +404,88 @@ int main(int argc, char* argv[]) {
             continue;
         }
         
+        if (cmd == "patch") {
+            std::string target;
+            iss >> target;
+            if (target.empty()) {
+                std::cout << "Usage: patch <file.ips> | patch <addr> <hex bytes>\n";
+                continue;
+            }
+            
+            std::string hex, part;
+            while (iss >> part) {
+                hex += part;
+            }
+            if (hex.empty()) {
+                analyzer.applyPatchFile(target);
+                continue;
+            }
+            
+            std::vector<uint8_t> bytes;
+            bool valid = hex.size() % 2 == 0;
+            for (size_t i = 0; valid && i < hex.size(); i += 2) {
+                valid = std::isxdigit(static_cast<unsigned char>(hex[i])) &&
+                        std::isxdigit(static_cast<unsigned char>(hex[i + 1]));
+                if (valid) {
+                    bytes.push_back(static_cast<uint8_t>(std::stoul(hex.substr(i, 2), nullptr, 16)));
+                }
+            }
+            if (!valid) {
+                std::cout << "Invalid hex bytes: " << hex << "\n";
+                continue;
+            }
+            analyzer.patchBytes(parseAddressOrName(target, analyzer), bytes);
+            continue;
+        }
+        
+        if (cmd == "unpatch") {
+            analyzer.clearPatches();
+            continue;
+        }
+        
+        if (cmd == "repack") {
+            std::string path, flag;
+            iss >> path;
+            if (path.empty()) {
+                std::cout << "Usage: repack <out.nso> [--hc] [--uncompressed]\n";
+                continue;
+            }
+            NsoWriteOptions options;
+            bool valid = true;
+            while (valid && iss >> flag) {
+                valid = parseWriteOption(flag, options);
+            }
+            if (!valid) {
+                std::cout << "Unknown option: " << flag << "\n";
+                continue;
+            }
+            
+            NsoWriter writer;
+            if (writer.write(analyzer.getNso(), path, options)) {
+                printWriteReport(writer, path);
+            } else {
+                std::cout << "Failed to write: " << writer.getError() << "\n";
+            }
+            continue;
+        }
+        
         if (cmd == "info") {
             auto& nso = analyzer.getNso();
             std::cout << "Build ID: " << nso.getBuildId() << "\n";
             std::cout << "Base: 0x" << std::hex << nso.getBaseAddress() << "\n";
-            std::cout << "Text: 0x" << nso.getTextSegment().size << " bytes\n";
-            std::cout << "Rodata: 0x" << nso.getRodataSegment().size << " bytes\n";
-            std::cout << "Data: 0x" << nso.getDataSegment().size << " bytes\n";
+            std::cout << "Text: 0x" << nso.getHeader().text.size << " bytes\n";
+            std::cout << "Rodata: 0x" << nso.getHeader().rodata.size << " bytes\n";
+            std::cout << "Data: 0x" << nso.getHeader().data.size << " bytes\n";
+            
+            auto& space = analyzer.getAddressSpace();
+            if (space.getModuleCount() > 1) {
+                std::cout << "Modules:\n";
+                for (size_t i = 0; i < space.getModuleCount(); i++) {
+                    const Module& mod = space.getModule(i);
+                    std::cout << "  " << std::left << std::setw(8) << mod.name << std::right
+                              << " 0x" << mod.base << "-0x" << mod.end << "\n";
+                }
+            }
             std::cout << std::dec;
             continue;
         }
@@ -256,7 +503,7 @@ int main(int argc, char* argv[]) {
                 continue;
             }
             
-            uint64_t addr = parseAddressOrName(addr_str);
+            uint64_t addr = parseAddressOrName(addr_str, analyzer);
             if (addr == 0) {
                 std::cout << "Invalid address or function name: " << addr_str << "\n";
                 continue;
@@ -276,7 +523,7 @@ int main(int argc, char* argv[]) {
                 continue;
             }
             
-            uint64_t addr = parseAddressOrName(addr_str);
+            uint64_t addr = parseAddressOrName(addr_str, analyzer);
             if (addr == 0) {
                 std::cout << "Invalid address or function name: " << addr_str << "\n";
                 continue;
@@ -296,7 +543,7 @@ int main(int argc, char* argv[]) {
                 continue;
             }
             
-            uint64_t addr = parseAddressOrName(addr_str);
+            uint64_t addr = parseAddressOrName(addr_str, analyzer);
             if (addr == 0) {
                 std::cout << "Invalid address or function name: " << addr_str << "\n";
                 continue;
@@ -1,108 +1,686 @@
 #include "nso_loader.h"
+#include "sha256.h"
+#include "segment_cache.h"
 #include <fstream>
 #include <cstring>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <thread>
 #include <lz4.h>
 
 namespace kiloader {
 
-bool NsoFile::load(const std::string& path) {
-    std::ifstream file(path, std::ios::binary);
-    if (!file) {
-        return false;
+// Where a segment lives in the file and what the header says about it
+struct SegmentSource {
+    const NsoSegmentHeader* hdr;
+    uint32_t comp_size;
+    const uint8_t* hash;
+    bool compressed;
+    const char* name;
+};
+
+static SegmentSource getSegmentSource(const NsoHeader& header, int index) {
+    switch (index) {
+        case 0:
+            return {&header.text, header.text_compressed_size, header.text_hash,
+                    (header.flags & 1) != 0, ".text"};
+        case 1:
+            return {&header.rodata, header.rodata_compressed_size, header.rodata_hash,
+                    (header.flags & 2) != 0, ".rodata"};
+        default:
+            return {&header.data, header.data_compressed_size, header.data_hash,
+                    (header.flags & 4) != 0, ".data"};
+    }
+}
+
+SegmentData::SegmentData(const SegmentData& other)
+    : owned_(other.owned_), ptr_(other.ptr_), size_(other.size_) {
+    if (!owned_.empty()) {
+        ptr_ = owned_.data();
+    }
+}
+
+SegmentData& SegmentData::operator=(const SegmentData& other) {
+    if (this != &other) {
+        owned_ = other.owned_;
+        ptr_ = owned_.empty() ? other.ptr_ : owned_.data();
+        size_ = other.size_;
     }
+    return *this;
+}
+
+SegmentData::SegmentData(SegmentData&& other) noexcept
+    : owned_(std::move(other.owned_)), ptr_(other.ptr_), size_(other.size_) {
+    other.ptr_ = nullptr;
+    other.size_ = 0;
+}
+
+SegmentData& SegmentData::operator=(SegmentData&& other) noexcept {
+    if (this != &other) {
+        owned_ = std::move(other.owned_);
+        ptr_ = other.ptr_;
+        size_ = other.size_;
+        other.ptr_ = nullptr;
+        other.size_ = 0;
+    }
+    return *this;
+}
+
+uint8_t* SegmentData::allocate(size_t size) {
+    ptr_ = owned_.allocate(size);
+    size_ = size;
+    return ptr_;
+}
+
+void SegmentData::view(uint8_t* ptr, size_t size) {
+    owned_.reset();
+    ptr_ = ptr;
+    size_ = size;
+}
+
+void SegmentData::clear() {
+    owned_.reset();
+    ptr_ = nullptr;
+    size_ = 0;
+}
+
+bool NsoFile::load(const std::string& path, const NsoLoadOptions& options) {
+    auto start_time = std::chrono::steady_clock::now();
     
-    // Read entire file
-    file.seekg(0, std::ios::end);
-    size_t file_size = file.tellg();
-    file.seekg(0, std::ios::beg);
+    loaded_ = false;
+    options_ = options;
+    error_.clear();
+    stats_ = NsoLoadStats{};
+    for (int i = 0; i < 3; i++) {
+        segment(i).data.clear();
+        state_[i].ready = false;
+        state_[i].ok = false;
+        state_[i].error.clear();
+        cache_maps_[i].reset();
+        if (cache_writes_[i].valid()) {
+            cache_writes_[i].wait();
+        }
+    }
+    cache_dir_.clear();
+    pending_ = 0;
+    reloc_state_.ready = false;
+    reloc_state_.ok = false;
+    dynamic_ = NsoDynamicInfo{};
+    reloc_bitmap_.clear();
+    reloc_originals_.clear();
+    module_name_.clear();
+    patch_table_.clear();
+    patch_pages_.clear();
+    dirty_pages_.clear();
+    mapping_.reset();
+    file_buf_.clear();
+    file_buf_.shrink_to_fit();
+    file_data_ = nullptr;
     
-    raw_data_.resize(file_size);
-    file.read(reinterpret_cast<char*>(raw_data_.data()), file_size);
-    file.close();
+    // Either map the file or read it whole. Mapped uncompressed segments are
+    // served straight from the mapping; the buffered path copies them out.
+    size_t file_size = 0;
+    
+    if (options.use_mmap) {
+        auto mapping = std::make_unique<MappedFile>();
+        if (!mapping->open(path)) {
+            error_ = mapping->getError();
+            return false;
+        }
+        file_data_ = mapping->data();
+        file_size = mapping->size();
+        mapping_ = std::move(mapping);
+    } else {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            error_ = "Failed to open: " + path;
+            return false;
+        }
+        
+        file.seekg(0, std::ios::end);
+        file_size = file.tellg();
+        file.seekg(0, std::ios::beg);
+        
+        file_buf_.resize(file_size);
+        file.read(reinterpret_cast<char*>(file_buf_.data()), file_size);
+        file_data_ = file_buf_.data();
+    }
     
     // Parse header
     if (file_size < sizeof(NsoHeader)) {
+        error_ = "File too small for NSO header";
         return false;
     }
     
-    std::memcpy(&header_, raw_data_.data(), sizeof(NsoHeader));
+    std::memcpy(&header_, file_data_, sizeof(NsoHeader));
     
     // Check magic
     if (header_.magic != 0x304F534E) {  // "NSO0"
+        error_ = "Bad NSO magic";
         return false;
     }
     
-    // Check flags for compression
-    bool text_compressed = (header_.flags & 1) != 0;
-    bool rodata_compressed = (header_.flags & 2) != 0;
-    bool data_compressed = (header_.flags & 4) != 0;
-    
-    // Load text segment
     text_.type = SegmentType::Text;
-    text_.mem_offset = header_.text.mem_offset;
-    text_.size = header_.text.size;
     text_.is_executable = true;
     text_.is_writable = false;
     
-    if (text_compressed) {
-        if (!decompressSegment(raw_data_.data() + header_.text.file_offset,
-                              header_.text_compressed_size,
-                              text_.data, header_.text.size)) {
+    rodata_.type = SegmentType::Rodata;
+    rodata_.is_executable = false;
+    rodata_.is_writable = false;
+    
+    data_.type = SegmentType::Data;
+    data_.is_executable = false;
+    data_.is_writable = true;
+    
+    // Validate segment bounds up front so decoding can't fault
+    for (int i = 0; i < 3; i++) {
+        Segment& seg = segment(i);
+        SegmentSource src = getSegmentSource(header_, i);
+        
+        seg.mem_offset = src.hdr->mem_offset;
+        seg.size = src.hdr->size;
+        stats_.segments[i].size = src.hdr->size;
+        stats_.segments[i].compressed = src.compressed;
+        
+        size_t stored_size = src.compressed ? src.comp_size : src.hdr->size;
+        if (static_cast<uint64_t>(src.hdr->file_offset) + stored_size > file_size) {
+            error_ = "Segment extends past end of file";
             return false;
         }
-    } else {
-        text_.data.resize(header_.text.size);
-        std::memcpy(text_.data.data(), raw_data_.data() + header_.text.file_offset, header_.text.size);
     }
     
-    // Load rodata segment
-    rodata_.type = SegmentType::Rodata;
-    rodata_.mem_offset = header_.rodata.mem_offset;
-    rodata_.size = header_.rodata.size;
-    rodata_.is_executable = false;
-    rodata_.is_writable = false;
+    if (header_.module_name_size != 0 &&
+        static_cast<uint64_t>(header_.module_name_offset) + header_.module_name_size <= file_size) {
+        const char* name = reinterpret_cast<const char*>(file_data_ + header_.module_name_offset);
+        module_name_.assign(name, strnlen(name, header_.module_name_size));
+    }
+    
+    if (options.cache_dir) {
+        cache_dir_ = options.cache_dir(getBuildId());
+    }
     
-    if (rodata_compressed) {
-        if (!decompressSegment(raw_data_.data() + header_.rodata.file_offset,
-                              header_.rodata_compressed_size,
-                              rodata_.data, header_.rodata.size)) {
+    stats_.used_mmap = options.use_mmap;
+    stats_.file_size = file_size;
+    pending_ = 3;
+    loaded_ = true;
+    file_path_ = path;
+    
+    // Hash checks must fail the load, so verification forces an eager decode.
+    // Otherwise only segments that are free to set up (mapped views) are
+    // ready now; the rest decode when first touched. Relocation always waits
+    // for first use, since the caller may still move the base address.
+    if (!options.lazy || options.verify_hashes) {
+        if (!decompressAll()) {
+            loaded_ = false;
+            error_ = getError();
             return false;
         }
     } else {
-        rodata_.data.resize(header_.rodata.size);
-        std::memcpy(rodata_.data.data(), raw_data_.data() + header_.rodata.file_offset, header_.rodata.size);
+        for (int i = 0; i < 3; i++) {
+            if (options.use_mmap && !stats_.segments[i].compressed) {
+                ensureDecoded(i);
+            }
+        }
     }
     
-    // Load data segment
-    data_.type = SegmentType::Data;
-    data_.mem_offset = header_.data.mem_offset;
-    data_.size = header_.data.size;
-    data_.is_executable = false;
-    data_.is_writable = true;
+    stats_.load_ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start_time).count();
+    return true;
+}
+
+bool NsoFile::decompressAll() {
+    if (!loaded_) {
+        return false;
+    }
+    
+    // The three segments are independent LZ4 blocks, so decompress (and
+    // optionally verify) whichever are still pending concurrently
+    auto stage_start = std::chrono::steady_clock::now();
+    
+    std::vector<std::thread> threads;
+    for (int i = 1; i < 3; i++) {
+        if (!state_[i].ready.load(std::memory_order_acquire)) {
+            threads.emplace_back([this, i]() { ensureDecoded(i); });
+        }
+    }
+    ensureDecoded(0);
+    
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    
+    stats_.decode_ms += std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - stage_start).count();
+    
+    return state_[0].ok && state_[1].ok && state_[2].ok;
+}
+
+Segment& NsoFile::segment(int index) const {
+    return index == 0 ? text_ : index == 1 ? rodata_ : data_;
+}
+
+bool NsoFile::ensureSegment(int index) const {
+    if (!ensureDecoded(index)) {
+        return false;
+    }
+    // Text is never a relocation target (and relocating needs it for MOD0)
+    if (index != 0) {
+        ensureRelocated();
+    }
+    return true;
+}
+
+bool NsoFile::ensureDecoded(int index) const {
+    SegmentState& state = state_[index];
+    if (state.ready.load(std::memory_order_acquire)) {
+        return state.ok;
+    }
+    
+    std::lock_guard<std::mutex> lock(state.mutex);
+    if (!state.ready.load(std::memory_order_relaxed)) {
+        if (!loaded_) {
+            return false;
+        }
+        state.ok = loadSegment(index);
+        if (!state.ok) {
+            // Readers see an empty segment
+            segment(index).data.clear();
+            segment(index).size = 0;
+        }
+        state.ready.store(true, std::memory_order_release);
+        
+        // The last segment to decode drops source bytes nobody views
+        if (pending_.fetch_sub(1) == 1) {
+            releaseFileData();
+        }
+    }
+    return state.ok;
+}
+
+bool NsoFile::ensureRelocated() const {
+    if (reloc_state_.ready.load(std::memory_order_acquire)) {
+        return reloc_state_.ok;
+    }
+    
+    std::lock_guard<std::mutex> lock(reloc_state_.mutex);
+    if (!reloc_state_.ready.load(std::memory_order_relaxed)) {
+        if (!loaded_) {
+            return false;
+        }
+        // Pointers can live in any segment, so all of them must be decoded
+        bool decoded = true;
+        for (int i = 0; i < 3; i++) {
+            decoded = ensureDecoded(i) && decoded;
+        }
+        if (decoded) {
+            relocate();
+        }
+        reloc_state_.ok = decoded;
+        reloc_state_.ready.store(true, std::memory_order_release);
+    }
+    return reloc_state_.ok;
+}
+
+uint8_t* NsoFile::imageAt(uint64_t offset, size_t size) const {
+    // Raw decoded bytes by module offset; callers must have decoded the
+    // segments already (no locking here)
+    uint64_t seg_offset = 0;
+    int index = segmentIndexAt(base_address_ + offset, seg_offset);
+    if (index < 0) {
+        return nullptr;
+    }
+    
+    SegmentData& data = segment(index).data;
+    if (seg_offset + size > data.size()) {
+        return nullptr;
+    }
+    return data.data() + seg_offset;
+}
+
+bool NsoFile::parseDynamic() const {
+    // The u32 at text+4 points to MOD0, which points to .dynamic
+    uint32_t mod0_offset = 0;
+    Mod0Header mod0;
+    const uint8_t* ptr = imageAt(4, sizeof(mod0_offset));
+    if (!ptr) {
+        return false;
+    }
+    std::memcpy(&mod0_offset, ptr, sizeof(mod0_offset));
+    
+    ptr = imageAt(mod0_offset, sizeof(mod0));
+    if (!ptr) {
+        return false;
+    }
+    std::memcpy(&mod0, ptr, sizeof(mod0));
+    if (mod0.magic != 0x30444F4D) {  // "MOD0"
+        return false;
+    }
+    
+    dynamic_.has_mod0 = true;
+    dynamic_.mod0_offset = mod0_offset;
+    dynamic_.dynamic_offset = mod0_offset + static_cast<int64_t>(mod0.dynamic_offset);
+    
+    for (uint64_t offset = dynamic_.dynamic_offset; ; offset += sizeof(Elf64Dyn)) {
+        Elf64Dyn dyn;
+        ptr = imageAt(offset, sizeof(dyn));
+        if (!ptr) {
+            break;
+        }
+        std::memcpy(&dyn, ptr, sizeof(dyn));
+        if (dyn.tag == DT_NULL) {
+            break;
+        }
+        
+        switch (dyn.tag) {
+            case DT_RELA:      dynamic_.rela_offset = dyn.val; break;
+            case DT_RELASZ:    dynamic_.rela_size = dyn.val; break;
+            case DT_RELACOUNT: dynamic_.rela_count = dyn.val; break;
+            case DT_JMPREL:    dynamic_.jmprel_offset = dyn.val; break;
+            case DT_PLTRELSZ:  dynamic_.jmprel_size = dyn.val; break;
+            case DT_SYMTAB:    dynamic_.symtab_offset = dyn.val; break;
+            case DT_STRTAB:    dynamic_.strtab_offset = dyn.val; break;
+            case DT_STRSZ:     dynamic_.strtab_size = dyn.val; break;
+            default: break;
+        }
+    }
+    
+    // dynsym has no count tag; the NSO header knows its size, otherwise
+    // assume the usual layout where dynstr directly follows dynsym
+    if (header_.dynsym_size != 0) {
+        dynamic_.symbol_count = header_.dynsym_size / sizeof(Elf64Sym);
+    } else if (dynamic_.strtab_offset > dynamic_.symtab_offset) {
+        dynamic_.symbol_count = (dynamic_.strtab_offset - dynamic_.symtab_offset) / sizeof(Elf64Sym);
+    }
+    
+    return true;
+}
+
+void NsoFile::relocate() const {
+    auto start = std::chrono::steady_clock::now();
+    
+    NsoRelocStats& stats = stats_.relocs;
+    stats = NsoRelocStats{};
+    reloc_bitmap_.assign((getImageSize() / 8 + 63) / 64, 0);
+    reloc_originals_.clear();
+    
+    if (parseDynamic()) {
+        stats.has_mod0 = true;
+        applyRelaTable(dynamic_.rela_offset, dynamic_.rela_size);
+        applyRelaTable(dynamic_.jmprel_offset, dynamic_.jmprel_size);
+    }
+    
+    stats.applied = true;
+    stats.ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+void NsoFile::applyRelaTable(uint64_t offset, uint64_t size) const {
+    size_t count = size / sizeof(Elf64Rela);
+    const Elf64Rela* rela = reinterpret_cast<const Elf64Rela*>(imageAt(offset, count * sizeof(Elf64Rela)));
+    if (!rela || count == 0) {
+        return;
+    }
+    
+    NsoRelocStats& stats = stats_.relocs;
+    uint64_t* bitmap = reloc_bitmap_.data();
+    
+    size_t i = 0;
+    while (i < count) {
+        // Find the segment holding this target. Relocations are sorted by
+        // offset, so the inner loop keeps writing into the same segment
+        // without looking it up again.
+        uint64_t seg_offset = 0;
+        int index = segmentIndexAt(base_address_ + rela[i].offset, seg_offset);
+        if (index <= 0) {
+            stats.skipped++;  // Unmapped or text
+            i++;
+            continue;
+        }
+        
+        SegmentData& data = segment(index).data;
+        uint8_t* seg_data = data.data();
+        uint64_t seg_start = rela[i].offset - seg_offset;
+        uint64_t seg_end = seg_start + data.size();
+        size_t first = i;
+        
+        for (; i < count; i++) {
+            const Elf64Rela& r = rela[i];
+            if (r.offset < seg_start || r.offset + 8 > seg_end) {
+                break;
+            }
+            
+            uint32_t type = static_cast<uint32_t>(r.info);
+            uint64_t value;
+            if (type == R_AARCH64_RELATIVE) {
+                // The bulk of every table: no symbol, just base + addend
+                value = base_address_ + r.addend;
+                stats.relative++;
+            } else if (type == R_AARCH64_GLOB_DAT || type == R_AARCH64_JUMP_SLOT ||
+                       type == R_AARCH64_ABS64) {
+                uint64_t sym_addr = 0;
+                if (!resolveSymbol(static_cast<uint32_t>(r.info >> 32), sym_addr)) {
+                    stats.unresolved++;
+                    continue;
+                }
+                value = sym_addr + r.addend;
+                stats.symbolic++;
+            } else {
+                stats.skipped++;
+                continue;
+            }
+            
+            // Keep the stored word so the image can be written back out
+            uint8_t* target = seg_data + (r.offset - seg_start);
+            uint64_t& bits = bitmap[r.offset >> 9];
+            uint64_t bit = 1ULL << ((r.offset >> 3) & 63);
+            if (!(bits & bit)) {
+                uint64_t original;
+                std::memcpy(&original, target, sizeof(original));
+                reloc_originals_.emplace_back(r.offset, original);
+                bits |= bit;
+            }
+            std::memcpy(target, &value, sizeof(value));
+        }
+        
+        if (i == first) {
+            stats.skipped++;  // Straddles the segment end
+            i++;
+        }
+    }
+}
+
+bool NsoFile::resolveSymbol(uint32_t index, uint64_t& address) const {
+    if (index >= dynamic_.symbol_count) {
+        return false;
+    }
+    
+    Elf64Sym sym;
+    const uint8_t* ptr = imageAt(dynamic_.symtab_offset + index * sizeof(Elf64Sym), sizeof(sym));
+    if (!ptr) {
+        return false;
+    }
+    std::memcpy(&sym, ptr, sizeof(sym));
+    
+    // Defined here
+    if (sym.shndx != 0) {
+        address = base_address_ + sym.value;
+        return true;
+    }
+    
+    // Imported: ask whoever knows the other modules
+    if (!resolver_ || sym.name >= dynamic_.strtab_size) {
+        return false;
+    }
+    const char* name = reinterpret_cast<const char*>(imageAt(dynamic_.strtab_offset + sym.name, 1));
+    if (!name) {
+        return false;
+    }
+    size_t max_len = dynamic_.strtab_size - sym.name;
+    const void* nul = std::memchr(name, 0, max_len);
+    size_t len = nul ? static_cast<const char*>(nul) - name : max_len;
+    return resolver_(std::string_view(name, len), address);
+}
+
+std::vector<NsoSymbol> NsoFile::readSymbols() const {
+    std::vector<NsoSymbol> result;
+    if (!ensureDecoded(1)) {
+        return result;
+    }
+    
+    // Header offsets are relative to rodata
+    uint64_t symtab = static_cast<uint64_t>(header_.rodata.mem_offset) + header_.dynsym_offset;
+    uint64_t strtab = static_cast<uint64_t>(header_.rodata.mem_offset) + header_.dynstr_offset;
+    size_t count = header_.dynsym_size / sizeof(Elf64Sym);
+    const uint8_t* syms = imageAt(symtab, count * sizeof(Elf64Sym));
+    const char* strs = reinterpret_cast<const char*>(imageAt(strtab, header_.dynstr_size));
+    if (!syms || !strs || count == 0) {
+        return result;
+    }
+    
+    result.reserve(count);
+    for (size_t i = 1; i < count; i++) {  // Entry 0 is the null symbol
+        Elf64Sym sym;
+        std::memcpy(&sym, syms + i * sizeof(Elf64Sym), sizeof(sym));
+        if (sym.name == 0 || sym.name >= header_.dynstr_size) {
+            continue;
+        }
+        
+        size_t max_len = header_.dynstr_size - sym.name;
+        const void* nul = std::memchr(strs + sym.name, 0, max_len);
+        size_t len = nul ? static_cast<const char*>(nul) - (strs + sym.name) : max_len;
+        
+        NsoSymbol entry;
+        entry.name.assign(strs + sym.name, len);
+        entry.is_import = sym.shndx == 0;
+        entry.address = entry.is_import ? 0 : base_address_ + sym.value;
+        entry.size = sym.size;
+        entry.type = sym.info & 0xF;
+        entry.binding = sym.info >> 4;
+        result.push_back(std::move(entry));
+    }
+    
+    return result;
+}
+
+bool NsoFile::isRelocated(uint64_t vaddr) const {
+    if (!ensureRelocated()) {
+        return false;
+    }
+    
+    uint64_t offset = vaddr - base_address_;
+    uint64_t word = offset >> 3;
+    if (word / 64 >= reloc_bitmap_.size()) {
+        return false;
+    }
+    return (reloc_bitmap_[word / 64] >> (word & 63)) & 1;
+}
+
+void NsoFile::releaseFileData() const {
+    for (const auto& seg : stats_.segments) {
+        if (seg.mapped) {
+            return;
+        }
+    }
+    mapping_.reset();
+    file_buf_.clear();
+    file_buf_.shrink_to_fit();
+}
+
+bool NsoFile::loadSegment(int index) const {
+    Segment& seg = segment(index);
+    SegmentSource src = getSegmentSource(header_, index);
+    NsoSegmentStats& stats = stats_.segments[index];
+    SegmentState& state = state_[index];
+    const uint8_t* stored = file_data_ + src.hdr->file_offset;
+    
+    auto start = std::chrono::steady_clock::now();
     
-    if (data_compressed) {
-        if (!decompressSegment(raw_data_.data() + header_.data.file_offset,
-                              header_.data_compressed_size,
-                              data_.data, header_.data.size)) {
+    // Only compressed segments are worth caching, and only with a real hash
+    // to key them on
+    std::string cache_path;
+    if (src.compressed && !cache_dir_.empty() &&
+        std::any_of(src.hash, src.hash + 32, [](uint8_t b) { return b != 0; })) {
+        cache_path = cache_dir_ + "/" + (src.name + 1) + ".seg";
+    }
+    
+    // A cache file is only keyed on the hash in its header; its payload has
+    // to hash to it before it stands in for the segment
+    if (!cache_path.empty()) {
+        cache_maps_[index] = SegmentCache::open(cache_path, src.hash, src.hdr->size);
+    }
+    if (cache_maps_[index]) {
+        uint8_t* cached = cache_maps_[index]->data() + SegmentCache::HEADER_SIZE;
+        uint8_t digest[32];
+        Sha256::hash(cached, src.hdr->size, digest);
+        if (std::memcmp(digest, src.hash, sizeof(digest)) == 0) {
+            seg.data.view(cached, src.hdr->size);
+            stats.cache_hit = true;
+            stats.hash_checked = true;
+            stats.hash_ok = true;
+            stats.hash_ms = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count();
+        } else {
+            cache_maps_[index].reset();
+        }
+    }
+    
+    if (stats.cache_hit) {
+        // Mapped and checked above
+    } else if (src.compressed) {
+        if (!decompressSegment(stored, src.comp_size, seg.data, src.hdr->size)) {
+            state.error = std::string("LZ4 decompression failed for ") + src.name;
             return false;
         }
+    } else if (!options_.use_mmap) {
+        std::memcpy(seg.data.allocate(src.hdr->size), stored, src.hdr->size);
     } else {
-        data_.data.resize(header_.data.size);
-        std::memcpy(data_.data.data(), raw_data_.data() + header_.data.file_offset, header_.data.size);
+        seg.data.view(file_data_ + src.hdr->file_offset, src.hdr->size);
+        stats.mapped = true;
+    }
+    
+    auto decoded = std::chrono::steady_clock::now();
+    stats.decompress_ms = std::chrono::duration<double, std::milli>(decoded - start).count();
+    stats.decoded = true;
+    
+    if (options_.verify_hashes && !stats.cache_hit) {
+        uint8_t digest[32];
+        Sha256::hash(seg.data.data(), seg.data.size(), digest);
+        stats.hash_checked = true;
+        stats.hash_ok = std::memcmp(digest, src.hash, sizeof(digest)) == 0;
+        stats.hash_ms = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - decoded).count();
+        
+        if (!stats.hash_ok) {
+            state.error = std::string("SHA-256 mismatch in ") + src.name;
+            return false;
+        }
+    }
+    
+    // Written in the background from a copy, since relocations and patches
+    // change the segment in place. A failed write just means decompressing
+    // again next time.
+    if (!cache_path.empty() && !stats.cache_hit) {
+        std::vector<uint8_t> bytes(seg.data.data(), seg.data.data() + seg.data.size());
+        std::array<uint8_t, 32> hash;
+        std::memcpy(hash.data(), src.hash, hash.size());
+        cache_writes_[index] = std::async(std::launch::async,
+            [cache_path, hash, bytes = std::move(bytes)]() {
+                return SegmentCache::store(cache_path, hash.data(), bytes.data(), bytes.size());
+            });
+        stats.cache_stored = true;
     }
     
-    loaded_ = true;
-    file_path_ = path;
     return true;
 }
 
 bool NsoFile::decompressSegment(const uint8_t* compressed, size_t comp_size,
-                                std::vector<uint8_t>& output, size_t decomp_size) {
-    output.resize(decomp_size);
+                                SegmentData& output, size_t decomp_size) const {
+    uint8_t* out = output.allocate(decomp_size);
     
     int result = LZ4_decompress_safe(
         reinterpret_cast<const char*>(compressed),
-        reinterpret_cast<char*>(output.data()),
+        reinterpret_cast<char*>(out),
         static_cast<int>(comp_size),
         static_cast<int>(decomp_size)
     );
@@ -120,49 +698,206 @@ std::string NsoFile::getBuildId() const {
     return result;
 }
 
-bool NsoFile::readMemory(uint64_t vaddr, void* buf, size_t size) const {
-    // Adjust for base address
+std::string NsoFile::getError() const {
+    if (!error_.empty()) {
+        return error_;
+    }
+    // Lazy decode failures surface here
+    for (const SegmentState& state : state_) {
+        if (state.ready.load(std::memory_order_acquire) && !state.ok) {
+            return state.error;
+        }
+    }
+    return "";
+}
+
+int NsoFile::segmentIndexAt(uint64_t vaddr, uint64_t& seg_offset) const {
+    // Adjust for base address. Ranges come from the header so that lookups
+    // never wait on a segment that is being decoded.
     uint64_t offset = vaddr - base_address_;
     
-    // Find segment
-    const Segment* seg = nullptr;
-    uint64_t seg_offset = 0;
-    
-    if (offset >= text_.mem_offset && offset < text_.mem_offset + text_.size) {
-        seg = &text_;
-        seg_offset = offset - text_.mem_offset;
-    } else if (offset >= rodata_.mem_offset && offset < rodata_.mem_offset + rodata_.size) {
-        seg = &rodata_;
-        seg_offset = offset - rodata_.mem_offset;
-    } else if (offset >= data_.mem_offset && offset < data_.mem_offset + data_.size) {
-        seg = &data_;
-        seg_offset = offset - data_.mem_offset;
+    if (offset >= header_.text.mem_offset && offset < header_.text.mem_offset + header_.text.size) {
+        seg_offset = offset - header_.text.mem_offset;
+        return 0;
+    } else if (offset >= header_.rodata.mem_offset && offset < header_.rodata.mem_offset + header_.rodata.size) {
+        seg_offset = offset - header_.rodata.mem_offset;
+        return 1;
+    } else if (offset >= header_.data.mem_offset && offset < header_.data.mem_offset + header_.data.size) {
+        seg_offset = offset - header_.data.mem_offset;
+        return 2;
     }
     
-    if (!seg || seg_offset + size > seg->data.size()) {
+    return -1;
+}
+
+bool NsoFile::readMemory(uint64_t vaddr, void* buf, size_t size) const {
+    MemoryView v = view(vaddr, size);
+    if (!v) {
         return false;
     }
     
-    std::memcpy(buf, seg->data.data() + seg_offset, size);
+    std::memcpy(buf, v.data, size);
     return true;
 }
 
+MemoryView NsoFile::view(uint64_t vaddr, size_t size) const {
+    uint64_t seg_offset = 0;
+    int index = segmentIndexAt(vaddr, seg_offset);
+    if (index < 0 || !ensureSegment(index)) {
+        return {};
+    }
+    
+    const SegmentData& data = segment(index).data;
+    if (seg_offset + size > data.size()) {
+        return {};
+    }
+    
+    return {data.data() + seg_offset, size};
+}
+
+std::string_view NsoFile::cstringAt(uint64_t vaddr, size_t max_len) const {
+    uint64_t seg_offset = 0;
+    int index = segmentIndexAt(vaddr, seg_offset);
+    if (index < 0 || !ensureSegment(index)) {
+        return {};
+    }
+    
+    const SegmentData& data = segment(index).data;
+    if (seg_offset >= data.size()) {
+        return {};
+    }
+    
+    const char* str = reinterpret_cast<const char*>(data.data() + seg_offset);
+    size_t limit = std::min<uint64_t>(max_len, data.size() - seg_offset);
+    const void* nul = std::memchr(str, 0, limit);
+    size_t len = nul ? static_cast<const char*>(nul) - str : limit;
+    return std::string_view(str, len);
+}
+
 const Segment* NsoFile::getSegmentAt(uint64_t vaddr) const {
+    uint64_t seg_offset = 0;
+    int index = segmentIndexAt(vaddr, seg_offset);
+    if (index < 0) {
+        return nullptr;
+    }
+    
+    ensureSegment(index);
+    return &segment(index);
+}
+
+bool NsoFile::patch(uint64_t vaddr, const uint8_t* bytes, size_t size) {
+    if (size == 0) {
+        return true;
+    }
+    
+    uint64_t seg_offset = 0;
+    int index = segmentIndexAt(vaddr, seg_offset);
+    if (index < 0 || !ensureSegment(index)) {
+        error_ = "Patch target not mapped";
+        return false;
+    }
+    
+    Segment& seg = segment(index);
+    if (seg_offset + size > seg.data.size()) {
+        error_ = "Patch crosses the end of the " + std::string(index == 0 ? "text" : index == 1 ? "rodata" : "data") + " segment";
+        return false;
+    }
+    
+    // Save each page's original bytes before its first write. Relocation has
+    // already run (ensureSegment), so reverting restores relocated values.
+    if (patch_table_.empty()) {
+        patch_table_.assign(getImageSize() / PATCH_PAGE_SIZE, 0);
+    }
     uint64_t offset = vaddr - base_address_;
+    uint64_t seg_start = seg.mem_offset;
+    uint64_t seg_end = seg.mem_offset + seg.data.size();
+    for (uint64_t page = offset / PATCH_PAGE_SIZE; page <= (offset + size - 1) / PATCH_PAGE_SIZE; page++) {
+        if (page >= patch_table_.size()) {
+            break;
+        }
+        if (patch_table_[page] == 0) {
+            uint64_t start = std::max(page * PATCH_PAGE_SIZE, seg_start);
+            uint64_t end = std::min((page + 1) * PATCH_PAGE_SIZE, seg_end);
+            const uint8_t* src = seg.data.data() + (start - seg_start);
+            PatchPage saved;
+            saved.offset = start;
+            saved.original.assign(src, src + (end - start));
+            patch_pages_.push_back(std::move(saved));
+            patch_table_[page] = static_cast<uint32_t>(patch_pages_.size());
+        }
+        dirty_pages_.push_back(base_address_ + page * PATCH_PAGE_SIZE);
+    }
     
-    if (offset >= text_.mem_offset && offset < text_.mem_offset + text_.size) {
-        return &text_;
-    } else if (offset >= rodata_.mem_offset && offset < rodata_.mem_offset + rodata_.size) {
-        return &rodata_;
-    } else if (offset >= data_.mem_offset && offset < data_.mem_offset + data_.size) {
-        return &data_;
+    std::memcpy(seg.data.data() + seg_offset, bytes, size);
+    return true;
+}
+
+void NsoFile::clearPatches() {
+    for (const PatchPage& saved : patch_pages_) {
+        uint64_t seg_offset = 0;
+        int index = segmentIndexAt(base_address_ + saved.offset, seg_offset);
+        if (index < 0) {
+            continue;
+        }
+        std::memcpy(segment(index).data.data() + seg_offset, saved.original.data(), saved.original.size());
+        dirty_pages_.push_back(base_address_ + (saved.offset & ~(PATCH_PAGE_SIZE - 1)));
+    }
+    patch_table_.clear();
+    patch_pages_.clear();
+}
+
+bool NsoFile::copyFileSegment(SegmentType type, std::vector<uint8_t>& out) const {
+    int index = static_cast<int>(type);
+    if (!ensureSegment(index)) {
+        return false;
     }
     
-    return nullptr;
+    const Segment& seg = segment(index);
+    out.assign(seg.data.begin(), seg.data.end());
+    
+    for (const auto& [offset, original] : reloc_originals_) {
+        if (offset < seg.mem_offset || offset + 8 > seg.mem_offset + out.size()) {
+            continue;
+        }
+        uint8_t* word = out.data() + (offset - seg.mem_offset);
+        
+        // A patch that overwrote the relocated value wins
+        uint32_t entry = patch_table_.empty() ? 0 : patch_table_[offset / PATCH_PAGE_SIZE];
+        if (entry != 0) {
+            const PatchPage& saved = patch_pages_[entry - 1];
+            if (offset >= saved.offset && offset + 8 <= saved.offset + saved.original.size() &&
+                std::memcmp(word, saved.original.data() + (offset - saved.offset), 8) != 0) {
+                continue;
+            }
+        }
+        std::memcpy(word, &original, sizeof(original));
+    }
+    return true;
+}
+
+bool NsoFile::isPatched(uint64_t vaddr) const {
+    uint64_t page = (vaddr - base_address_) / PATCH_PAGE_SIZE;
+    return page < patch_table_.size() && patch_table_[page] != 0;
+}
+
+std::vector<uint64_t> NsoFile::takeDirtyPages() {
+    std::vector<uint64_t> pages;
+    pages.swap(dirty_pages_);
+    std::sort(pages.begin(), pages.end());
+    pages.erase(std::unique(pages.begin(), pages.end()), pages.end());
+    return pages;
+}
+
+uint64_t NsoFile::getImageSize() const {
+    uint64_t text_end = static_cast<uint64_t>(header_.text.mem_offset) + header_.text.size;
+    uint64_t rodata_end = static_cast<uint64_t>(header_.rodata.mem_offset) + header_.rodata.size;
+    uint64_t data_end = static_cast<uint64_t>(header_.data.mem_offset) + header_.data.size + header_.bss_size;
+    uint64_t end = std::max({text_end, rodata_end, data_end});
+    return (end + 0xFFF) & ~static_cast<uint64_t>(0xFFF);
 }
 
 size_t NsoFile::getTotalSize() const {
-    return text_.size + rodata_.size + data_.size + header_.bss_size;
+    return header_.text.size + header_.rodata.size + header_.data.size + header_.bss_size;
 }
 
 } // namespace kiloader
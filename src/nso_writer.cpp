@@ -0,0 +1,171 @@
+#include "nso_writer.h"
+#include "sha256.h"
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+#include <sstream>
+#include <chrono>
+#include <thread>
+#include <filesystem>
+#include <lz4.h>
+#include <lz4hc.h>
+
+namespace kiloader {
+
+namespace fs = std::filesystem;
+
+static double msSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+double NsoWriteStats::getThroughputMBps() const {
+    size_t bytes = segments[0].size + segments[1].size + segments[2].size;
+    return total_ms > 0 ? bytes / (1024.0 * 1024.0) / (total_ms / 1000.0) : 0;
+}
+
+bool NsoWriter::write(const NsoFile& nso, const std::string& path, const NsoWriteOptions& options) {
+    auto start_time = std::chrono::steady_clock::now();
+    stats_ = NsoWriteStats{};
+    error_.clear();
+    
+    if (!nso.isLoaded()) {
+        error_ = "No NSO loaded";
+        return false;
+    }
+    
+    // Segment bytes with relocations undone
+    static const SegmentType types[3] = {SegmentType::Text, SegmentType::Rodata, SegmentType::Data};
+    std::vector<uint8_t> plain[3];
+    for (int i = 0; i < 3; i++) {
+        if (!nso.copyFileSegment(types[i], plain[i])) {
+            error_ = "Failed to read segment: " + nso.getError();
+            return false;
+        }
+    }
+    
+    // Compress and hash every segment concurrently (six independent jobs)
+    auto encode_start = std::chrono::steady_clock::now();
+    std::vector<uint8_t> packed[3];
+    uint8_t hashes[3][32];
+    bool ok[3] = {true, true, true};
+    std::vector<std::thread> threads;
+    
+    for (int i = 0; i < 3; i++) {
+        NsoWriteSegmentStats& seg = stats_.segments[i];
+        seg.size = plain[i].size();
+        seg.compressed = options.compress && !plain[i].empty();
+        
+        if (seg.compressed) {
+            threads.emplace_back([&, i]() {
+                auto start = std::chrono::steady_clock::now();
+                const std::vector<uint8_t>& src = plain[i];
+                int src_size = static_cast<int>(src.size());
+                packed[i].resize(LZ4_compressBound(src_size));
+                
+                const char* in = reinterpret_cast<const char*>(src.data());
+                char* out = reinterpret_cast<char*>(packed[i].data());
+                int capacity = static_cast<int>(packed[i].size());
+                int written = options.high_compression
+                    ? LZ4_compress_HC(in, out, src_size, capacity, options.hc_level)
+                    : LZ4_compress_default(in, out, src_size, capacity);
+                
+                ok[i] = written > 0;
+                packed[i].resize(written > 0 ? written : 0);
+                stats_.segments[i].compress_ms = msSince(start);
+            });
+        }
+        
+        threads.emplace_back([&, i]() {
+            auto start = std::chrono::steady_clock::now();
+            Sha256::hash(plain[i].data(), plain[i].size(), hashes[i]);
+            stats_.segments[i].hash_ms = msSince(start);
+        });
+    }
+    
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    stats_.encode_ms = msSince(encode_start);
+    
+    for (int i = 0; i < 3; i++) {
+        if (!ok[i]) {
+            error_ = "LZ4 compression failed";
+            return false;
+        }
+    }
+    
+    // Header: source identity, new layout. The module name follows the
+    // header, then text, rodata and data back to back.
+    const NsoHeader& src = nso.getHeader();
+    NsoHeader header = src;
+    header.flags = src.flags & ~0x3Fu;
+    header.flags |= 0x38;  // Hashes below are valid: let loaders check them
+    
+    std::string name = nso.getModuleName();
+    name.resize(std::max<size_t>(src.module_name_size, name.size() + 1), '\0');
+    header.module_name_offset = sizeof(NsoHeader);
+    header.module_name_size = static_cast<uint32_t>(name.size());
+    
+    NsoSegmentHeader* seg_headers[3] = {&header.text, &header.rodata, &header.data};
+    uint32_t* stored_sizes[3] = {&header.text_compressed_size, &header.rodata_compressed_size,
+                                 &header.data_compressed_size};
+    uint8_t* hash_fields[3] = {header.text_hash, header.rodata_hash, header.data_hash};
+    
+    uint64_t offset = sizeof(NsoHeader) + name.size();
+    for (int i = 0; i < 3; i++) {
+        NsoWriteSegmentStats& seg = stats_.segments[i];
+        seg.stored_size = seg.compressed ? packed[i].size() : plain[i].size();
+        if (seg.compressed) {
+            header.flags |= 1u << i;
+        }
+        
+        seg_headers[i]->file_offset = static_cast<uint32_t>(offset);
+        seg_headers[i]->size = static_cast<uint32_t>(plain[i].size());
+        *stored_sizes[i] = static_cast<uint32_t>(seg.stored_size);
+        std::memcpy(hash_fields[i], hashes[i], 32);
+        offset += seg.stored_size;
+    }
+    
+    if (offset > UINT32_MAX) {
+        error_ = "Output too large for 32-bit NSO offsets";
+        return false;
+    }
+    
+    // Write to a temp file next to the target, then swap it in
+    auto write_start = std::chrono::steady_clock::now();
+    std::ostringstream tmp;
+    tmp << path << ".tmp." << std::chrono::steady_clock::now().time_since_epoch().count();
+    
+    std::ofstream f(tmp.str(), std::ios::binary | std::ios::trunc);
+    if (!f) {
+        error_ = "Failed to create: " + tmp.str();
+        return false;
+    }
+    f.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    f.write(name.data(), name.size());
+    for (int i = 0; i < 3; i++) {
+        const std::vector<uint8_t>& bytes = stats_.segments[i].compressed ? packed[i] : plain[i];
+        f.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    }
+    f.close();
+    
+    std::error_code ec;
+    if (!f) {
+        fs::remove(tmp.str(), ec);
+        error_ = "Failed to write: " + path;
+        return false;
+    }
+    fs::rename(tmp.str(), path, ec);
+    if (ec) {
+        fs::remove(tmp.str(), ec);
+        error_ = "Failed to rename into place: " + ec.message();
+        return false;
+    }
+    
+    stats_.write_ms = msSince(write_start);
+    stats_.file_size = offset;
+    stats_.total_ms = msSince(start_time);
+    return true;
+}
+
+} // namespace kiloader
@@ -0,0 +1,251 @@
+#include "opcode_scan.h"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KILOADER_SCAN_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#include "cpu_features.h"
+#endif
+
+#if defined(__aarch64__)
+#define KILOADER_SCAN_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace kiloader {
+
+constexpr int NUM_THREADS = 32;
+
+// Encoding of a class: (word & mask) == value. A class may have several.
+struct ClassPattern {
+    uint32_t mask;
+    uint32_t value;
+    OpClass cls;
+};
+
+// Branch, ADRP and RET encodings are the ones in a64_decoder.h
+constexpr ClassPattern CLASS_PATTERNS[] = {
+    {0xFFC07FFF, 0xA9807BFD, OpClass::FrameSave},   // STP X29, X30, [SP, #imm]!
+    {0xFF8003FF, 0xD10003FF, OpClass::StackAlloc},  // SUB SP, SP, #imm{, LSL #12}
+    {0xFFFFFFFF, 0xD503233F, OpClass::Paciasp},
+    {0xFC000000, 0x94000000, OpClass::Bl},
+    {0xFC000000, 0x14000000, OpClass::B},
+    {0x9F000000, 0x90000000, OpClass::Adrp},
+    {0xFFFFFC1F, 0xD65F0000, OpClass::Ret},
+    {0xFFFFFBFF, 0xD65F0BFF, OpClass::Ret},         // RETAA, RETAB
+};
+
+constexpr size_t CLASS_PATTERN_COUNT = sizeof(CLASS_PATTERNS) / sizeof(CLASS_PATTERNS[0]);
+constexpr size_t CLASS_COUNT = OpcodeScan::CLASS_COUNT;
+
+uint32_t OpcodeScan::classify(uint32_t word) {
+    uint32_t classes = 0;
+    for (const ClassPattern& p : CLASS_PATTERNS) {
+        if ((word & p.mask) == p.value) {
+            classes |= opClassBit(p.cls);
+        }
+    }
+    return classes;
+}
+
+// Classify 64-word blocks [first, first + count) of code into bits.
+// Block b covers words 64b .. 64b + 63 and fills bits[c][b].
+using ScanFn = void (*)(const uint8_t* code, size_t first, size_t count, uint64_t* const* bits);
+
+static void scanGeneric(const uint8_t* code, size_t first, size_t count, uint64_t* const* bits) {
+    for (size_t b = first; b < first + count; b++) {
+        uint64_t acc[CLASS_COUNT] = {};
+        const uint8_t* block = code + b * 256;
+        for (size_t i = 0; i < 64; i++) {
+            uint32_t word;
+            std::memcpy(&word, block + i * 4, sizeof(word));
+            for (const ClassPattern& p : CLASS_PATTERNS) {
+                acc[static_cast<size_t>(p.cls)] |= static_cast<uint64_t>((word & p.mask) == p.value) << i;
+            }
+        }
+        for (size_t c = 0; c < CLASS_COUNT; c++) {
+            bits[c][b] = acc[c];
+        }
+    }
+}
+
+#ifdef KILOADER_SCAN_X86
+
+// 8 words per step
+__attribute__((target("avx2")))
+static void scanAvx2(const uint8_t* code, size_t first, size_t count, uint64_t* const* bits) {
+    __m256i masks[CLASS_PATTERN_COUNT];
+    __m256i values[CLASS_PATTERN_COUNT];
+    for (size_t p = 0; p < CLASS_PATTERN_COUNT; p++) {
+        masks[p] = _mm256_set1_epi32(static_cast<int>(CLASS_PATTERNS[p].mask));
+        values[p] = _mm256_set1_epi32(static_cast<int>(CLASS_PATTERNS[p].value));
+    }
+    
+    for (size_t b = first; b < first + count; b++) {
+        uint64_t acc[CLASS_COUNT] = {};
+        const uint8_t* block = code + b * 256;
+        for (size_t i = 0; i < 64; i += 8) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + i * 4));
+            for (size_t p = 0; p < CLASS_PATTERN_COUNT; p++) {
+                __m256i eq = _mm256_cmpeq_epi32(_mm256_and_si256(v, masks[p]), values[p]);
+                uint32_t hits = static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(eq)));
+                acc[static_cast<size_t>(CLASS_PATTERNS[p].cls)] |= static_cast<uint64_t>(hits) << i;
+            }
+        }
+        for (size_t c = 0; c < CLASS_COUNT; c++) {
+            bits[c][b] = acc[c];
+        }
+    }
+}
+
+// 4 words per step (SSE2 is baseline on x86-64)
+__attribute__((target("sse2")))
+static void scanSse2(const uint8_t* code, size_t first, size_t count, uint64_t* const* bits) {
+    __m128i masks[CLASS_PATTERN_COUNT];
+    __m128i values[CLASS_PATTERN_COUNT];
+    for (size_t p = 0; p < CLASS_PATTERN_COUNT; p++) {
+        masks[p] = _mm_set1_epi32(static_cast<int>(CLASS_PATTERNS[p].mask));
+        values[p] = _mm_set1_epi32(static_cast<int>(CLASS_PATTERNS[p].value));
+    }
+    
+    for (size_t b = first; b < first + count; b++) {
+        uint64_t acc[CLASS_COUNT] = {};
+        const uint8_t* block = code + b * 256;
+        for (size_t i = 0; i < 64; i += 4) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + i * 4));
+            for (size_t p = 0; p < CLASS_PATTERN_COUNT; p++) {
+                __m128i eq = _mm_cmpeq_epi32(_mm_and_si128(v, masks[p]), values[p]);
+                uint32_t hits = static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(eq)));
+                acc[static_cast<size_t>(CLASS_PATTERNS[p].cls)] |= static_cast<uint64_t>(hits) << i;
+            }
+        }
+        for (size_t c = 0; c < CLASS_COUNT; c++) {
+            bits[c][b] = acc[c];
+        }
+    }
+}
+
+#endif // KILOADER_SCAN_X86
+
+#ifdef KILOADER_SCAN_NEON
+
+// 4 words per step
+static void scanNeon(const uint8_t* code, size_t first, size_t count, uint64_t* const* bits) {
+    static const uint32_t lane_bits[4] = {1, 2, 4, 8};
+    uint32x4_t lanes = vld1q_u32(lane_bits);
+    
+    for (size_t b = first; b < first + count; b++) {
+        uint64_t acc[CLASS_COUNT] = {};
+        const uint8_t* block = code + b * 256;
+        for (size_t i = 0; i < 64; i += 4) {
+            uint32x4_t v = vreinterpretq_u32_u8(vld1q_u8(block + i * 4));
+            for (size_t p = 0; p < CLASS_PATTERN_COUNT; p++) {
+                uint32x4_t eq = vceqq_u32(vandq_u32(v, vdupq_n_u32(CLASS_PATTERNS[p].mask)),
+                                          vdupq_n_u32(CLASS_PATTERNS[p].value));
+                uint32_t hits = vaddvq_u32(vandq_u32(eq, lanes));
+                acc[static_cast<size_t>(CLASS_PATTERNS[p].cls)] |= static_cast<uint64_t>(hits) << i;
+            }
+        }
+        for (size_t c = 0; c < CLASS_COUNT; c++) {
+            bits[c][b] = acc[c];
+        }
+    }
+}
+
+#endif // KILOADER_SCAN_NEON
+
+struct ScanKernel {
+    ScanFn fn;
+    const char* name;
+};
+
+// Pick the widest kernel this CPU supports (once)
+static const ScanKernel& selectKernel() {
+    static const ScanKernel kernel = []() -> ScanKernel {
+#if defined(KILOADER_SCAN_NEON)
+        return {scanNeon, "neon"};
+#elif defined(KILOADER_SCAN_X86)
+        unsigned int eax, ebx, ecx, edx;
+        bool sse2 = false;
+        if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+            sse2 = (edx & (1u << 26)) != 0;
+        }
+        if (cpuHasUsableAvx2()) {
+            return {scanAvx2, "avx2"};
+        }
+        if (sse2) {
+            return {scanSse2, "sse2"};
+        }
+        return {scanGeneric, "generic"};
+#else
+        return {scanGeneric, "generic"};
+#endif
+    }();
+    return kernel;
+}
+
+const char* OpcodeScan::getKernelName() {
+    return selectKernel().name;
+}
+
+void OpcodeScan::build(const uint8_t* code, size_t size) {
+    words_ = size / 4;
+    size_t blocks = (words_ + 63) / 64;
+    for (auto& bits : bits_) {
+        bits.assign(blocks, 0);
+    }
+    if (words_ == 0) {
+        return;
+    }
+    
+    uint64_t* out[CLASS_COUNT];
+    for (size_t c = 0; c < CLASS_COUNT; c++) {
+        out[c] = bits_[c].data();
+    }
+    
+    // Whole blocks in parallel; threads own disjoint bitmap words
+    size_t full = words_ / 64;
+    ScanFn fn = selectKernel().fn;
+    int thread_count = static_cast<int>(std::min<size_t>(NUM_THREADS, full));
+    if (thread_count > 0) {
+        size_t chunk_size = full / thread_count + 1;
+        std::vector<std::thread> threads;
+        for (int t = 0; t < thread_count; t++) {
+            threads.emplace_back([&, t]() {
+                size_t start = t * chunk_size;
+                size_t end = std::min(start + chunk_size, full);
+                if (start < end) {
+                    fn(code, start, end - start, out);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+    
+    // Partial last block
+    update(code, full * 64, words_);
+}
+
+void OpcodeScan::update(const uint8_t* code, size_t first, size_t last) {
+    last = std::min(last, words_);
+    for (size_t i = first; i < last; i++) {
+        uint32_t word;
+        std::memcpy(&word, code + i * 4, sizeof(word));
+        uint32_t classes = classify(word);
+        uint64_t bit = 1ULL << (i % 64);
+        for (size_t c = 0; c < CLASS_COUNT; c++) {
+            if (classes & (1u << c)) {
+                bits_[c][i / 64] |= bit;
+            } else {
+                bits_[c][i / 64] &= ~bit;
+            }
+        }
+    }
+}
+
+} // namespace kiloader
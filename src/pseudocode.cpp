@@ -1,12 +1,12 @@
 #include "pseudocode.h"
 #include <sstream>
 #include <iomanip>
-#include <regex>
+#include <algorithm>
 
 namespace kiloader {
 
-PseudocodeGenerator::PseudocodeGenerator(NsoFile& nso, FunctionFinder& func_finder, XRefAnalyzer& xref)
-    : nso_(nso), func_finder_(func_finder), xref_(xref) {}
+PseudocodeGenerator::PseudocodeGenerator(AddressSpace& space, FunctionFinder& func_finder, XRefAnalyzer& xref)
+    : space_(space), func_finder_(func_finder), xref_(xref) {}
 
 std::string PseudocodeGenerator::generate(uint64_t func_address) {
     auto* func = func_finder_.getFunction(func_address);
@@ -29,17 +29,32 @@ std::string PseudocodeGenerator::generate(const Function& func) {
     // Signature (simplified)
     ss << "void " << func.name << "(void) {\n";
     
-    // Track register states for basic analysis
-    std::map<std::string, std::string> reg_values;
+    std::vector<ir::Stmt> stmts;
+    ir::liftInstructions(func.instructions, func.address, stmts);
     
+    // Statements are in instruction order; each carries its instruction's
+    // offset. The statements spell out the operands, so Capstone only
+    // renders them for instructions the IR doesn't model.
+    size_t next = 0;
     for (const auto& insn : func.instructions) {
-        ss << "    // 0x" << std::hex << insn.address << ": ";
-        ss << insn.mnemonic << " " << insn.operands << "\n";
+        uint32_t offset = static_cast<uint32_t>(insn.address - func.address);
+        size_t end = next;
+        bool modelled = true;
+        for (; end < stmts.size() && stmts[end].offset == offset; end++) {
+            modelled &= stmts[end].op != ir::Op::Unknown && stmts[end].op != ir::Op::Clobber;
+        }
+        
+        ss << "    // 0x" << std::hex << insn.address << ": " << insn.mnemonic();
+        if (!modelled) {
+            ss << " " << insn.operands();
+        }
+        ss << "\n";
         
-        // Generate pseudocode
-        std::string pseudo = translateInstruction(insn);
-        if (!pseudo.empty()) {
-            ss << "    " << pseudo << "\n";
+        for (; next < end; next++) {
+            std::string pseudo = translateStatement(stmts[next]);
+            if (!pseudo.empty()) {
+                ss << "    " << pseudo << "\n";
+            }
         }
         ss << "\n";
     }
@@ -49,139 +64,161 @@ std::string PseudocodeGenerator::generate(const Function& func) {
     return ss.str();
 }
 
-std::string PseudocodeGenerator::translateInstruction(const Instruction& insn) {
-    std::string m = insn.mnemonic;
-    std::string ops = insn.operands;
-    
-    // Parse operands
-    std::vector<std::string> operands;
-    std::regex op_regex(R"([xwXW]\d+|sp|SP|#-?\d+|#0x[0-9a-fA-F]+|\[[^\]]+\])");
-    std::sregex_iterator it(ops.begin(), ops.end(), op_regex);
-    std::sregex_iterator end;
-    while (it != end) {
-        operands.push_back(it->str());
-        ++it;
-    }
-    
-    // MOV
-    if (m == "mov" && operands.size() >= 2) {
-        return formatRegister(operands[0]) + " = " + formatRegister(operands[1]) + ";";
-    }
-    
-    // ADD
-    if (m == "add" && operands.size() >= 3) {
-        return formatRegister(operands[0]) + " = " + formatRegister(operands[1]) + 
-               " + " + formatRegister(operands[2]) + ";";
-    }
-    
-    // SUB
-    if (m == "sub" && operands.size() >= 3) {
-        return formatRegister(operands[0]) + " = " + formatRegister(operands[1]) + 
-               " - " + formatRegister(operands[2]) + ";";
-    }
-    
-    // MUL
-    if (m == "mul" && operands.size() >= 3) {
-        return formatRegister(operands[0]) + " = " + formatRegister(operands[1]) + 
-               " * " + formatRegister(operands[2]) + ";";
-    }
-    
-    // LDR
-    if ((m == "ldr" || m == "ldrsw" || m == "ldrb" || m == "ldrh") && operands.size() >= 2) {
-        return formatRegister(operands[0]) + " = *(" + operands[1] + ");";
-    }
-    
-    // STR
-    if ((m == "str" || m == "strb" || m == "strh") && operands.size() >= 2) {
-        return "*(" + operands[1] + ") = " + formatRegister(operands[0]) + ";";
-    }
-    
-    // BL (call)
-    if (m == "bl" && insn.branch_target != 0) {
-        std::string target_name;
-        auto* target_func = func_finder_.getFunction(insn.branch_target);
-        if (target_func) {
-            target_name = target_func->name;
-        } else {
+std::string PseudocodeGenerator::translateStatement(const ir::Stmt& s) {
+    using ir::Op;
+    std::string d = formatRegister(s.d, s.width);
+    std::string a = formatRegister(s.a, s.width);
+    std::string b = formatOperand(s);
+    
+    // Binary operators
+    const char* op = nullptr;
+    switch (s.op) {
+        case Op::Add: op = " + "; break;
+        case Op::Sub: op = " - "; break;
+        case Op::Mul: op = " * "; break;
+        case Op::UDiv:
+        case Op::SDiv: op = " / "; break;
+        case Op::And: op = " & "; break;
+        case Op::Or: op = " | "; break;
+        case Op::Xor: op = " ^ "; break;
+        case Op::Shl: op = " << "; break;
+        case Op::Lsr:
+        case Op::Asr: op = " >> "; break;
+        case Op::Ror: op = " ror "; break;
+        default: break;
+    }
+    if (op) {
+        // CMP, CMN, TST
+        if ((s.attrs & ir::SetsFlags) && s.d == ir::ZR) {
+            if (s.op == Op::And) return "// test " + a + ", " + b;
+            return "// compare " + a + ", " + (s.op == Op::Add ? "-" : "") + b;
+        }
+        if (s.b == ir::IMM && s.imm < 0 && (s.op == Op::Add || s.op == Op::Sub)) {
+            op = s.op == Op::Add ? " - " : " + ";
+            b = formatImmediate(-s.imm);
+        }
+        return d + " = " + a + op + b + ";";
+    }
+    
+    switch (s.op) {
+        case Op::Mov:
+            return d + " = " + b + ";";
+        case Op::Not:
+            return d + " = ~" + b + ";";
+        case Op::Sext:
+            if (s.imm == 8 || s.imm == 16 || s.imm == 32) {
+                return d + " = (int" + std::to_string(s.imm) + "_t)" + a + ";";
+            }
+            return d + " = sext(" + a + ", " + std::to_string(s.imm) + ");";
+        case Op::Select:
+            return d + " = " + ir::condName(s.cond) + " ? " + a + " : " + b + ";";
+        case Op::Load:
+        case Op::Store: {
+            static const char* const types[] = {"8", "16", "32", "64", "128"};
+            std::string type = std::string((s.attrs & ir::Signed) ? "int" : "uint") + types[s.width > 4 ? 4 : s.width] + "_t";
+            uint8_t reg_width = s.width;
+            if (s.d < ir::V0) {
+                reg_width = (s.attrs & ir::Signed) ? ((s.attrs & ir::Dest32) ? 2 : 3) : std::max<uint8_t>(s.width, 2);
+            }
+            std::string reg = s.d == ir::NONE ? "?" : formatRegister(s.d, reg_width);
+            std::string mem = "*(" + type + "*)(" + formatMemory(s) + ")";
+            return s.op == Op::Load ? reg + " = " + mem + ";" : mem + " = " + reg + ";";
+        }
+        case Op::ReadSys:
+            return d + " = sysreg(" + formatImmediate(s.imm) + ");";
+        case Op::WriteSys:
+            return "sysreg(" + formatImmediate(s.imm) + ") = " + formatRegister(s.a, 3) + ";";
+        case Op::Jump:
+            return "goto " + formatAddress(s.imm) + ";";
+        case Op::JumpCond:
+            return std::string("if (") + ir::condName(s.cond) + ") goto " + formatAddress(s.imm) + ";";
+        case Op::JumpZero:
+            return "if (" + a + " == 0) goto " + formatAddress(s.imm) + ";";
+        case Op::JumpNonZero:
+            return "if (" + a + " != 0) goto " + formatAddress(s.imm) + ";";
+        case Op::JumpBitClear:
+        case Op::JumpBitSet:
+            return std::string("if (") + (s.op == Op::JumpBitClear ? "!" : "") + "(" + a + " & (1ull << " +
+                   std::to_string(s.cond) + "))) goto " + formatAddress(s.imm) + ";";
+        case Op::JumpReg:
+            return "goto *" + formatRegister(s.a, 3) + ";";
+        case Op::Call: {
+            if (auto* target_func = func_finder_.getFunction(s.imm)) {
+                return target_func->name + "();";
+            }
             std::ostringstream ss;
-            ss << "FUN_" << std::hex << insn.branch_target;
-            target_name = ss.str();
+            ss << "FUN_" << std::hex << s.imm << "();";
+            return ss.str();
         }
-        return target_name + "();";
-    }
-    
-    // RET
-    if (m == "ret") {
-        return "return;";
-    }
-    
-    // CMP
-    if (m == "cmp" && operands.size() >= 2) {
-        return "// compare " + formatRegister(operands[0]) + ", " + formatRegister(operands[1]);
-    }
-    
-    // Conditional branches
-    if (m[0] == 'b' && m.length() > 1 && insn.is_branch) {
-        std::string cond = m.substr(1);
-        std::ostringstream ss;
-        ss << "if (" << cond << ") goto 0x" << std::hex << insn.branch_target << ";";
-        return ss.str();
-    }
-    
-    // B (unconditional)
-    if (m == "b" && insn.branch_target != 0) {
-        std::ostringstream ss;
-        ss << "goto 0x" << std::hex << insn.branch_target << ";";
-        return ss.str();
+        case Op::CallReg:
+            return "(*" + formatRegister(s.a, 3) + ")();";
+        case Op::Ret:
+            return "return;";
+        case Op::Syscall:
+            return "svc(" + formatImmediate(s.imm) + ");";
+        case Op::Trap:
+            return "__builtin_trap();";
+        default:
+            // Nop, Unknown, Clobber: the assembly comment says it all
+            return "";
     }
+}
+
+std::string PseudocodeGenerator::formatRegister(uint8_t reg, uint8_t width) {
+    // Named registers
+    if (reg == ir::ZR) return "0";
+    if (reg == ir::FP && width == 3) return "fp";
+    if (reg == ir::LR && width == 3) return "lr";
     
-    // STP
-    if (m == "stp") {
-        return "// save registers to stack";
+    return ir::regName(reg, width);
+}
+
+std::string PseudocodeGenerator::formatOperand(const ir::Stmt& s) {
+    if (s.b == ir::IMM) {
+        return (s.attrs & ir::IsAddress) ? formatAddress(s.imm) : formatImmediate(s.imm);
     }
-    
-    // LDP
-    if (m == "ldp") {
-        return "// load registers from stack";
+    if (s.b == ir::NONE) {
+        return "";
     }
     
-    // ADRP
-    if (m == "adrp") {
-        return "// load page address";
+    std::string reg;
+    if (s.attrs & ir::ExtendUxtw) {
+        reg = "(uint32_t)" + formatRegister(s.b, 2);
+    } else if (s.attrs & ir::ExtendSxtw) {
+        reg = "(int32_t)" + formatRegister(s.b, 2);
+    } else {
+        // Index registers are 64-bit whatever the access size
+        bool memory = s.op == ir::Op::Load || s.op == ir::Op::Store;
+        reg = formatRegister(s.b, memory ? 3 : s.width);
     }
-    
-    // NOP
-    if (m == "nop") {
-        return "// nop";
+    if (s.shift != 0) {
+        reg = "(" + reg + " << " + std::to_string(s.shift) + ")";
     }
-    
-    return "";
+    return reg;
 }
 
-std::string PseudocodeGenerator::formatRegister(const std::string& reg) {
-    if (reg.empty()) return reg;
-    
-    // Convert to lowercase
-    std::string r = reg;
-    std::transform(r.begin(), r.end(), r.begin(), ::tolower);
-    
-    // Check for immediates
-    if (r[0] == '#') {
-        return r.substr(1);  // Remove #
+std::string PseudocodeGenerator::formatMemory(const ir::Stmt& s) {
+    if (s.a == ir::NONE) {
+        return formatAddress(s.imm);
     }
     
-    // Named registers
-    if (r == "sp") return "sp";
-    if (r == "lr" || r == "x30") return "lr";
-    if (r == "fp" || r == "x29") return "fp";
-    if (r == "xzr" || r == "wzr") return "0";
-    
-    return r;
+    std::string base = formatRegister(s.a, 3);
+    if (s.b != ir::IMM) {
+        return base + " + " + formatOperand(s);
+    }
+    if (s.imm == 0) {
+        return base;
+    }
+    return base + (s.imm < 0 ? " - " : " + ") + formatImmediate(s.imm < 0 ? -s.imm : s.imm);
 }
 
 std::string PseudocodeGenerator::formatImmediate(int64_t value) {
     std::ostringstream ss;
-    ss << "0x" << std::hex << value;
+    if (value < 0) {
+        ss << "-0x" << std::hex << -static_cast<uint64_t>(value);
+    } else {
+        ss << "0x" << std::hex << value;
+    }
     return ss.str();
 }
 
@@ -193,20 +230,7 @@ std::string PseudocodeGenerator::formatAddress(uint64_t addr) {
 
 std::string PseudocodeGenerator::getStringAt(uint64_t addr) {
     // Read null-terminated string from address
-    char buf[256];
-    size_t i = 0;
-    while (i < 255) {
-        uint8_t c;
-        if (!nso_.readMemory(addr + i, &c, 1)) {
-            break;
-        }
-        if (c == 0) {
-            break;
-        }
-        buf[i++] = c;
-    }
-    buf[i] = 0;
-    return std::string(buf);
+    return std::string(space_.cstringAt(addr, 255));
 }
 
 std::map<uint64_t, std::string> PseudocodeGenerator::generateAll() {
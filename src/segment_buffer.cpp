@@ -0,0 +1,105 @@
+#include "segment_buffer.h"
+#include <cstring>
+#include <cstdlib>
+#include <new>
+#include <utility>
+
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace kiloader {
+
+static uint8_t* alignedAlloc(size_t alignment, size_t size) {
+#ifdef _WIN32
+    return static_cast<uint8_t*>(_aligned_malloc(size, alignment));
+#else
+    void* ptr = nullptr;
+    if (posix_memalign(&ptr, alignment, size) != 0) {
+        return nullptr;
+    }
+    return static_cast<uint8_t*>(ptr);
+#endif
+}
+
+static void alignedFree(uint8_t* ptr) {
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+SegmentBuffer::~SegmentBuffer() {
+    reset();
+}
+
+SegmentBuffer::SegmentBuffer(const SegmentBuffer& other) {
+    if (!other.empty()) {
+        std::memcpy(allocate(other.size_), other.data_, other.size_);
+    }
+}
+
+SegmentBuffer& SegmentBuffer::operator=(const SegmentBuffer& other) {
+    if (this != &other) {
+        if (other.empty()) {
+            reset();
+        } else {
+            std::memcpy(allocate(other.size_), other.data_, other.size_);
+        }
+    }
+    return *this;
+}
+
+SegmentBuffer::SegmentBuffer(SegmentBuffer&& other) noexcept
+    : data_(other.data_), size_(other.size_), huge_(other.huge_) {
+    other.data_ = nullptr;
+    other.size_ = 0;
+    other.huge_ = false;
+}
+
+SegmentBuffer& SegmentBuffer::operator=(SegmentBuffer&& other) noexcept {
+    if (this != &other) {
+        reset();
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+        std::swap(huge_, other.huge_);
+    }
+    return *this;
+}
+
+uint8_t* SegmentBuffer::allocate(size_t size) {
+    reset();
+    
+    // Huge-page alignment only pays off once a buffer spans a huge page
+    bool huge = size >= HUGE_PAGE_SIZE;
+    size_t alignment = huge ? HUGE_PAGE_SIZE : ALIGNMENT;
+    size_t total = (size + PADDING + alignment - 1) & ~(alignment - 1);
+    
+    data_ = alignedAlloc(alignment, total);
+    if (!data_) {
+        throw std::bad_alloc();
+    }
+    size_ = size;
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    // Before first touch, so faults can be served with 2 MiB pages
+    huge_ = huge && madvise(data_, total, MADV_HUGEPAGE) == 0;
+#endif
+    
+    std::memset(data_ + size, 0, total - size);
+    return data_;
+}
+
+void SegmentBuffer::reset() {
+    if (data_) {
+        alignedFree(data_);
+    }
+    data_ = nullptr;
+    size_ = 0;
+    huge_ = false;
+}
+
+} // namespace kiloader
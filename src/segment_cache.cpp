@@ -0,0 +1,83 @@
+#include "segment_cache.h"
+#include <fstream>
+#include <cstring>
+#include <filesystem>
+#include <thread>
+#include <chrono>
+#include <sstream>
+
+namespace kiloader {
+
+namespace fs = std::filesystem;
+
+constexpr uint32_t SEGMENT_CACHE_MAGIC = 0x4745534B;  // "KSEG"
+constexpr uint32_t SEGMENT_CACHE_VERSION = 1;
+
+struct SegmentCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t size;
+    uint8_t hash[32];
+    uint8_t reserved[16];
+};
+
+static_assert(sizeof(SegmentCacheHeader) == SegmentCache::HEADER_SIZE, "cache header must stay 64 bytes");
+
+std::unique_ptr<MappedFile> SegmentCache::open(const std::string& path, const uint8_t hash[32], size_t size) {
+    std::error_code ec;
+    if (!fs::is_regular_file(path, ec)) {
+        return nullptr;
+    }
+    
+    auto mapping = std::make_unique<MappedFile>();
+    if (!mapping->open(path) || mapping->size() != HEADER_SIZE + size) {
+        return nullptr;
+    }
+    
+    SegmentCacheHeader header;
+    std::memcpy(&header, mapping->data(), sizeof(header));
+    if (header.magic != SEGMENT_CACHE_MAGIC || header.version != SEGMENT_CACHE_VERSION ||
+        header.size != size || std::memcmp(header.hash, hash, sizeof(header.hash)) != 0) {
+        return nullptr;
+    }
+    
+    return mapping;
+}
+
+bool SegmentCache::store(const std::string& path, const uint8_t hash[32], const uint8_t* data, size_t size) {
+    std::error_code ec;
+    fs::create_directories(fs::path(path).parent_path(), ec);
+    
+    SegmentCacheHeader header{};
+    header.magic = SEGMENT_CACHE_MAGIC;
+    header.version = SEGMENT_CACHE_VERSION;
+    header.size = size;
+    std::memcpy(header.hash, hash, sizeof(header.hash));
+    
+    // Unique temp name so concurrent writers (threads or other processes
+    // opening the same build) never see each other's halves
+    std::ostringstream tmp;
+    tmp << path << ".tmp." << std::this_thread::get_id() << "."
+        << std::chrono::steady_clock::now().time_since_epoch().count();
+    
+    std::ofstream f(tmp.str(), std::ios::binary | std::ios::trunc);
+    if (!f) {
+        return false;
+    }
+    f.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    f.write(reinterpret_cast<const char*>(data), size);
+    f.close();
+    if (!f) {
+        fs::remove(tmp.str(), ec);
+        return false;
+    }
+    
+    fs::rename(tmp.str(), path, ec);
+    if (ec) {
+        fs::remove(tmp.str(), ec);
+        return false;
+    }
+    return true;
+}
+
+} // namespace kiloader
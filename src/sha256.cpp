@@ -0,0 +1,300 @@
+#include "sha256.h"
+#include <cstring>
+#include <algorithm>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KILOADER_SHA_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#include "cpu_features.h"
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_FEATURE_SHA2)
+#define KILOADER_SHA_ARM 1
+#include <arm_neon.h>
+#endif
+
+namespace kiloader {
+
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline uint32_t rotr(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+static inline uint32_t loadBe32(const uint8_t* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+// Process whole 64-byte blocks (portable)
+static inline void compressPortable(uint32_t state[8], const uint8_t* data, size_t blocks) {
+    for (size_t b = 0; b < blocks; b++, data += 64) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++) {
+            w[i] = loadBe32(data + i * 4);
+        }
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        
+        uint32_t a = state[0], b2 = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        
+        for (int i = 0; i < 64; i++) {
+            uint32_t s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+            uint32_t ch = (e & f) ^ (~e & g);
+            uint32_t t1 = h + s1 + ch + K[i] + w[i];
+            uint32_t s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+            uint32_t maj = (a & b2) ^ (a & c) ^ (b2 & c);
+            uint32_t t2 = s0 + maj;
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b2;
+            b2 = a;
+            a = t1 + t2;
+        }
+        
+        state[0] += a; state[1] += b2; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+    }
+}
+
+static void compressGeneric(uint32_t state[8], const uint8_t* data, size_t blocks) {
+    compressPortable(state, data, blocks);
+}
+
+#ifdef KILOADER_SHA_X86
+
+// Same rounds built for AVX2/BMI2 parts, so the rotates become RORX.
+// A single SHA-256 stream is serial per block, so wider vectors only help
+// the message schedule; the gain over the generic build is modest.
+__attribute__((target("avx2,bmi2")))
+static void compressAvx2(uint32_t state[8], const uint8_t* data, size_t blocks) {
+    compressPortable(state, data, blocks);
+}
+
+// SHA extensions: four rounds per SHA256RNDS2 pair, schedule via MSG1/MSG2
+__attribute__((target("sha,sse4.1")))
+static void compressShaNi(uint32_t state[8], const uint8_t* data, size_t blocks) {
+    const __m128i shuf_mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    
+    // Rearrange ABCD/EFGH into the ABEF/CDGH layout the instructions use
+    __m128i tmp = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[0]));
+    __m128i state1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[4]));
+    tmp = _mm_shuffle_epi32(tmp, 0xB1);
+    state1 = _mm_shuffle_epi32(state1, 0x1B);
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+    
+    for (size_t b = 0; b < blocks; b++, data += 64) {
+        __m128i abef_save = state0;
+        __m128i cdgh_save = state1;
+        
+        __m128i w[4];
+        for (int i = 0; i < 4; i++) {
+            w[i] = _mm_shuffle_epi8(
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i * 16)), shuf_mask);
+        }
+        
+        for (int i = 0; i < 16; i++) {
+            __m128i msg = _mm_add_epi32(w[i & 3], _mm_loadu_si128(reinterpret_cast<const __m128i*>(&K[i * 4])));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+            
+            // Finish the schedule word four groups ahead, then start the next one
+            if (i >= 3 && i <= 14) {
+                __m128i& next = w[(i + 1) & 3];
+                next = _mm_add_epi32(next, _mm_alignr_epi8(w[i & 3], w[(i - 1) & 3], 4));
+                next = _mm_sha256msg2_epu32(next, w[i & 3]);
+            }
+            
+            msg = _mm_shuffle_epi32(msg, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+            
+            if (i >= 1 && i <= 12) {
+                w[(i - 1) & 3] = _mm_sha256msg1_epu32(w[(i - 1) & 3], w[i & 3]);
+            }
+        }
+        
+        state0 = _mm_add_epi32(state0, abef_save);
+        state1 = _mm_add_epi32(state1, cdgh_save);
+    }
+    
+    // Back to ABCD/EFGH
+    tmp = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+    state1 = _mm_alignr_epi8(state1, tmp, 8);
+    
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), state0);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[4]), state1);
+}
+
+#endif // KILOADER_SHA_X86
+
+#ifdef KILOADER_SHA_ARM
+
+// ARMv8 crypto extensions (Apple silicon and most AArch64 hosts)
+static void compressArmv8(uint32_t state[8], const uint8_t* data, size_t blocks) {
+    uint32x4_t state0 = vld1q_u32(&state[0]);
+    uint32x4_t state1 = vld1q_u32(&state[4]);
+    
+    for (size_t b = 0; b < blocks; b++, data += 64) {
+        uint32x4_t abcd_save = state0;
+        uint32x4_t efgh_save = state1;
+        
+        uint32x4_t w[4];
+        for (int i = 0; i < 4; i++) {
+            w[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + i * 16)));
+        }
+        
+        for (int i = 0; i < 16; i++) {
+            uint32x4_t wk = vaddq_u32(w[i & 3], vld1q_u32(&K[i * 4]));
+            if (i < 12) {
+                w[i & 3] = vsha256su0q_u32(w[i & 3], w[(i + 1) & 3]);
+            }
+            
+            uint32x4_t prev = state0;
+            state0 = vsha256hq_u32(state0, state1, wk);
+            state1 = vsha256h2q_u32(state1, prev, wk);
+            
+            if (i < 12) {
+                w[i & 3] = vsha256su1q_u32(w[i & 3], w[(i + 2) & 3], w[(i + 3) & 3]);
+            }
+        }
+        
+        state0 = vaddq_u32(state0, abcd_save);
+        state1 = vaddq_u32(state1, efgh_save);
+    }
+    
+    vst1q_u32(&state[0], state0);
+    vst1q_u32(&state[4], state1);
+}
+
+#endif // KILOADER_SHA_ARM
+
+using CompressFn = void (*)(uint32_t state[8], const uint8_t* data, size_t blocks);
+
+struct Sha256Kernel {
+    CompressFn fn;
+    const char* name;
+};
+
+// Pick the fastest kernel this CPU supports (once)
+static const Sha256Kernel& selectKernel() {
+    static const Sha256Kernel kernel = []() -> Sha256Kernel {
+#if defined(KILOADER_SHA_ARM)
+        return {compressArmv8, "armv8-sha2"};
+#elif defined(KILOADER_SHA_X86)
+        unsigned int eax, ebx, ecx, edx;
+        bool sse41 = false, sha = false, avx2 = false, bmi2 = false;
+        if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+            sse41 = (ecx & (1u << 19)) != 0;
+        }
+        if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+            avx2 = cpuHasUsableAvx2();
+            bmi2 = (ebx & (1u << 8)) != 0;
+            sha = (ebx & (1u << 29)) != 0;
+        }
+        if (sha && sse41) {
+            return {compressShaNi, "sha-ni"};
+        }
+        if (avx2 && bmi2) {
+            return {compressAvx2, "avx2"};
+        }
+        return {compressGeneric, "generic"};
+#else
+        return {compressGeneric, "generic"};
+#endif
+    }();
+    return kernel;
+}
+
+static void compressBlocks(uint32_t state[8], const uint8_t* data, size_t blocks) {
+    if (blocks > 0) {
+        selectKernel().fn(state, data, blocks);
+    }
+}
+
+Sha256::Sha256() {
+    static const uint32_t init[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    std::memcpy(state_, init, sizeof(state_));
+}
+
+void Sha256::update(const void* data, size_t size) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    total_len_ += size;
+    
+    // Top up a partial block first
+    if (block_len_ > 0) {
+        size_t take = std::min(size, sizeof(block_) - block_len_);
+        std::memcpy(block_ + block_len_, p, take);
+        block_len_ += take;
+        p += take;
+        size -= take;
+        if (block_len_ < sizeof(block_)) {
+            return;
+        }
+        compressBlocks(state_, block_, 1);
+        block_len_ = 0;
+    }
+    
+    size_t blocks = size / 64;
+    compressBlocks(state_, p, blocks);
+    p += blocks * 64;
+    size -= blocks * 64;
+    
+    std::memcpy(block_, p, size);
+    block_len_ = size;
+}
+
+void Sha256::finish(uint8_t digest[32]) {
+    uint64_t bit_len = total_len_ * 8;
+    
+    block_[block_len_++] = 0x80;
+    if (block_len_ > 56) {
+        std::memset(block_ + block_len_, 0, 64 - block_len_);
+        compressBlocks(state_, block_, 1);
+        block_len_ = 0;
+    }
+    std::memset(block_ + block_len_, 0, 56 - block_len_);
+    for (int i = 0; i < 8; i++) {
+        block_[56 + i] = static_cast<uint8_t>(bit_len >> (56 - i * 8));
+    }
+    compressBlocks(state_, block_, 1);
+    
+    for (int i = 0; i < 8; i++) {
+        digest[i * 4 + 0] = static_cast<uint8_t>(state_[i] >> 24);
+        digest[i * 4 + 1] = static_cast<uint8_t>(state_[i] >> 16);
+        digest[i * 4 + 2] = static_cast<uint8_t>(state_[i] >> 8);
+        digest[i * 4 + 3] = static_cast<uint8_t>(state_[i]);
+    }
+}
+
+const char* Sha256::getKernelName() {
+    return selectKernel().name;
+}
+
+void Sha256::hash(const void* data, size_t size, uint8_t digest[32]) {
+    Sha256 ctx;
+    ctx.update(data, size);
+    ctx.finish(digest);
+}
+
+} // namespace kiloader
@@ -0,0 +1,45 @@
+#include "symbol_table.h"
+
+namespace kiloader {
+
+void SymbolTable::clear() {
+    symbols_.clear();
+    by_name_.clear();
+    by_address_.clear();
+}
+
+void SymbolTable::addModule(size_t module, const std::vector<NsoSymbol>& symbols) {
+    symbols_.reserve(symbols_.size() + symbols.size());
+    by_name_.reserve(by_name_.size() + symbols.size());
+    
+    for (const auto& sym : symbols) {
+        Symbol entry;
+        entry.name = sym.name;
+        entry.address = sym.address;
+        entry.size = sym.size;
+        entry.module = module;
+        entry.is_function = sym.type == STT_FUNC;
+        entry.is_import = sym.is_import;
+        
+        size_t index = symbols_.size();
+        symbols_.push_back(std::move(entry));
+        
+        // Imports have no address to look up
+        if (!sym.is_import) {
+            by_name_.emplace(sym.name, index);
+            by_address_.emplace(sym.address, index);
+        }
+    }
+}
+
+const Symbol* SymbolTable::findByName(const std::string& name) const {
+    auto it = by_name_.find(name);
+    return it != by_name_.end() ? &symbols_[it->second] : nullptr;
+}
+
+const Symbol* SymbolTable::findByAddress(uint64_t address) const {
+    auto it = by_address_.find(address);
+    return it != by_address_.end() ? &symbols_[it->second] : nullptr;
+}
+
+} // namespace kiloader
@@ -1,5 +1,7 @@
 #include "xref_analyzer.h"
+#include "ir.h"
 #include <sstream>
+#include <algorithm>
 #include <thread>
 #include <mutex>
 
@@ -7,8 +9,8 @@ namespace kiloader {
 
 constexpr int NUM_THREADS = 32;
 
-XRefAnalyzer::XRefAnalyzer(NsoFile& nso, Disassembler& disasm, FunctionFinder& func_finder)
-    : nso_(nso), disasm_(disasm), func_finder_(func_finder) {}
+XRefAnalyzer::XRefAnalyzer(AddressSpace& space, FunctionFinder& func_finder)
+    : space_(space), func_finder_(func_finder) {}
 
 void XRefAnalyzer::analyze() {
     xrefs_.clear();
@@ -33,29 +35,8 @@ void XRefAnalyzer::analyze() {
             size_t end = std::min(start + chunk_size, func_addrs.size());
             
             for (size_t i = start; i < end; i++) {
-                uint64_t addr = func_addrs[i];
-                auto* func = func_finder_.getFunction(addr);
-                if (!func) continue;
-                
-                for (const auto& insn : func->instructions) {
-                    // Inline the analysis to avoid race conditions
-                    XRef xref;
-                    xref.from_address = insn.address;
-                    xref.from_function = addr;
-                    xref.from_function_name = func->name;
-                    
-                    if (insn.is_call && insn.branch_target != 0) {
-                        xref.to_address = insn.branch_target;
-                        xref.type = XRefType::Call;
-                        xref.description = "function call";
-                        thread_results[t].push_back(xref);
-                    }
-                    else if (insn.is_branch && insn.branch_target != 0) {
-                        xref.to_address = insn.branch_target;
-                        xref.type = XRefType::Jump;
-                        xref.description = "branch";
-                        thread_results[t].push_back(xref);
-                    }
+                if (auto* func = func_finder_.getFunction(func_addrs[i])) {
+                    collectRefs(*func, thread_results[t]);
                 }
             }
         });
@@ -70,123 +51,106 @@ void XRefAnalyzer::analyze() {
         xrefs_.insert(xrefs_.end(), results.begin(), results.end());
     }
     
-    // Phase 3: Analyze ADRP sequences (needs memory access, do sequentially)
-    for (const auto& [addr, func] : func_finder_.getFunctions()) {
-        for (const auto& insn : func.instructions) {
-            if (insn.mnemonic == "adrp") {
-                analyzeAdrpSequence(insn.address);
-            }
+    buildIndex();
+}
+
+void XRefAnalyzer::reanalyzeFunctions(const std::vector<uint64_t>& func_addrs) {
+    std::set<uint64_t> redo(func_addrs.begin(), func_addrs.end());
+    
+    xrefs_.erase(std::remove_if(xrefs_.begin(), xrefs_.end(), [&](const XRef& xref) {
+        return redo.count(xref.from_function) != 0;
+    }), xrefs_.end());
+    
+    for (uint64_t addr : func_addrs) {
+        if (auto* func = func_finder_.getFunction(addr)) {
+            collectRefs(*func, xrefs_);
         }
     }
     
+    buildIndex();
+}
+
+void XRefAnalyzer::buildIndex() {
     // Build reverse indices
+    refs_to_.clear();
+    refs_from_.clear();
     for (size_t i = 0; i < xrefs_.size(); i++) {
         refs_to_[xrefs_[i].to_address].push_back(i);
         refs_from_[xrefs_[i].from_address].push_back(i);
     }
 }
 
-void XRefAnalyzer::analyzeInstruction(const Instruction& insn, uint64_t func_addr) {
-    XRef xref;
-    xref.from_address = insn.address;
-    xref.from_function = func_addr;
-    
-    auto* func = func_finder_.getFunction(func_addr);
-    xref.from_function_name = func ? func->name : "unknown";
-    
-    if (insn.is_call && insn.branch_target != 0) {
-        xref.to_address = insn.branch_target;
-        xref.type = XRefType::Call;
-        xref.description = "function call";
-        xrefs_.push_back(xref);
-    }
-    else if (insn.is_branch && insn.branch_target != 0) {
-        xref.to_address = insn.branch_target;
-        xref.type = XRefType::Jump;
-        xref.description = "branch";
-        xrefs_.push_back(xref);
-    }
-    
-    // Check for ADRP + ADD/LDR patterns for data references
-    if (insn.mnemonic == "adrp") {
-        analyzeAdrpSequence(insn.address);
-    }
-}
-
-void XRefAnalyzer::analyzeAdrpSequence(uint64_t address) {
-    // ADRP loads a page address
-    // Usually followed by ADD or LDR to get the final address
-    
-    uint8_t code[8];
-    if (!nso_.readMemory(address, code, 8)) {
-        return;
-    }
-    
-    uint32_t adrp_insn = *reinterpret_cast<uint32_t*>(code);
-    uint32_t next_insn = *reinterpret_cast<uint32_t*>(code + 4);
-    
-    // Decode ADRP
-    if ((adrp_insn & 0x9F000000) != 0x90000000) {
-        return;  // Not ADRP
-    }
-    
-    uint32_t rd = adrp_insn & 0x1F;
-    int64_t immhi = (adrp_insn >> 5) & 0x7FFFF;
-    int64_t immlo = (adrp_insn >> 29) & 0x3;
-    int64_t imm = (immhi << 2) | immlo;
-    
-    // Sign extend
-    if (imm & 0x100000) {
-        imm |= 0xFFFFFFFFFFE00000ULL;
-    }
-    
-    uint64_t page_addr = (address & ~0xFFFULL) + (imm << 12);
-    
-    // Check next instruction
-    uint64_t final_addr = 0;
-    XRefType type = XRefType::AddressLoad;
-    
-    // ADD Xd, Xn, #imm
-    if ((next_insn & 0xFF800000) == 0x91000000) {
-        uint32_t rn = (next_insn >> 5) & 0x1F;
-        if (rn == rd) {
-            uint32_t imm12 = (next_insn >> 10) & 0xFFF;
-            final_addr = page_addr + imm12;
-        }
-    }
-    // LDR Xd, [Xn, #imm]
-    else if ((next_insn & 0xFFC00000) == 0xF9400000) {
-        uint32_t rn = (next_insn >> 5) & 0x1F;
-        if (rn == rd) {
-            uint32_t imm12 = ((next_insn >> 10) & 0xFFF) * 8;
-            final_addr = page_addr + imm12;
-            type = XRefType::DataRead;
-        }
-    }
-    // LDR Wd, [Xn, #imm]
-    else if ((next_insn & 0xFFC00000) == 0xB9400000) {
-        uint32_t rn = (next_insn >> 5) & 0x1F;
-        if (rn == rd) {
-            uint32_t imm12 = ((next_insn >> 10) & 0xFFF) * 4;
-            final_addr = page_addr + imm12;
-            type = XRefType::DataRead;
-        }
-    }
-    
-    if (final_addr != 0) {
+void XRefAnalyzer::collectRefs(const Function& func, std::vector<XRef>& out) const {
+    auto add = [&](uint64_t from, uint64_t to, XRefType type, const char* description) {
         XRef xref;
-        xref.from_address = address;
-        xref.to_address = final_addr;
+        xref.from_address = from;
+        xref.to_address = to;
         xref.type = type;
-        xref.description = type == XRefType::DataRead ? "data read" : "address load";
+        xref.description = description;
+        xref.from_function = func.address;
+        xref.from_function_name = func.name;
+        out.push_back(std::move(xref));
+    };
+    
+    // Pages loaded by ADRP (or addresses by ADR), per register, so that the
+    // ADD/LDR/STR using them gives the final address. Attributed to the
+    // ADRP; forgotten when the register is written or at control flow.
+    uint32_t known = 0;
+    uint64_t page[31];
+    uint64_t page_from[31];
+    
+    // Lifted here rather than kept per function: the statements are a
+    // few times the size of the instructions and cheap to redo
+    std::vector<ir::Stmt> stmts;
+    ir::liftInstructions(func.instructions, func.address, stmts);
+    
+    for (const ir::Stmt& s : stmts) {
+        uint64_t at = func.address + s.offset;
+        bool from_page = s.a < 31 && (known >> s.a) & 1 && s.b == ir::IMM;
         
-        auto* func = func_finder_.getFunctionContaining(address);
-        if (func) {
-            xref.from_function = func->address;
-            xref.from_function_name = func->name;
+        switch (s.op) {
+            case ir::Op::Call:
+                add(at, s.imm, XRefType::Call, "function call");
+                break;
+            case ir::Op::Jump:
+            case ir::Op::JumpCond:
+            case ir::Op::JumpZero:
+            case ir::Op::JumpNonZero:
+            case ir::Op::JumpBitClear:
+            case ir::Op::JumpBitSet:
+                add(at, s.imm, XRefType::Jump, "branch");
+                break;
+            case ir::Op::Add:
+                if (from_page && s.width == 3 && !(s.attrs & ir::SetsFlags)) {
+                    add(page_from[s.a], page[s.a] + s.imm, XRefType::AddressLoad, "address load");
+                }
+                break;
+            case ir::Op::Load:
+                if (s.a == ir::NONE) {
+                    add(at, s.imm, XRefType::DataRead, "data read");   // Literal pool
+                } else if (from_page) {
+                    add(page_from[s.a], page[s.a] + s.imm, XRefType::DataRead, "data read");
+                }
+                break;
+            case ir::Op::Store:
+                if (from_page) {
+                    add(page_from[s.a], page[s.a] + s.imm, XRefType::DataWrite, "data write");
+                }
+                break;
+            default:
+                break;
         }
         
-        xrefs_.push_back(xref);
+        if (s.isControl() || s.op == ir::Op::Unknown) {
+            known = 0;
+        } else if (s.writesDest() && s.d < 31) {
+            known &= ~(1u << s.d);
+        }
+        if (s.op == ir::Op::Mov && (s.attrs & ir::IsAddress) && s.d < 31) {
+            known |= 1u << s.d;
+            page[s.d] = static_cast<uint64_t>(s.imm);
+            page_from[s.d] = at;
+        }
     }
 }
 
@@ -240,12 +204,9 @@ std::vector<XRef> XRefAnalyzer::getStringRefs(const std::string& str) const {
 std::vector<XRef> XRefAnalyzer::getRodataRefs() const {
     std::vector<XRef> result;
     
-    const Segment& rodata = nso_.getRodataSegment();
-    uint64_t rodata_start = nso_.getBaseAddress() + rodata.mem_offset;
-    uint64_t rodata_end = rodata_start + rodata.size;
-    
     for (const auto& xref : xrefs_) {
-        if (xref.to_address >= rodata_start && xref.to_address < rodata_end) {
+        const Segment* seg = space_.getSegmentAt(xref.to_address);
+        if (seg && seg->type == SegmentType::Rodata) {
             result.push_back(xref);
         }
     }